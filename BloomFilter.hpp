@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#ifndef _BLOOMFILTER_HPP_
+#define _BLOOMFILTER_HPP_
+#define FILTER_BLOCK_BITS 512
+#define FILTER_BLOCK_WORDS (FILTER_BLOCK_BITS / 64)
+#define FILTER_MAX_PROBES 16
+#define FILTER_FALSE_POSITIVE_RATE 0.01
+
+/**
+ * Bloom filter whose bits for a key all fall in a single 64 byte block,
+ * so a lookup costs one cache line, whatever the number of probes.
+ * Keys are given as hashes, the filter mixes them again, so the low bits
+ * a map uses for its bucket index are fine.
+ * Keys can't be removed, the owner rebuilds the filter instead.
+ */
+class blocked_bloom_filter
+{
+ public:
+  /**
+   * @param keys Number of keys the false positive rate is meant for.
+   * @param false_positive_rate Rate of misses let through, in (0, 1).
+   */
+  blocked_bloom_filter (std::size_t keys, double false_positive_rate)
+      : _false_positive_rate (false_positive_rate)
+  {
+    if (!(false_positive_rate > 0 && false_positive_rate < 1))
+    {
+      throw std::invalid_argument (
+          "The false positive rate must be between 0 and 1.");
+    }
+    // Blocking loses some accuracy to unevenly filled blocks, made up for
+    // by 20% more bits than a classic Bloom filter needs
+    double bits_per_key = 1.2 * -std::log2 (false_positive_rate)
+                          / std::log (2.0);
+    this->_probes = (int) std::lround (bits_per_key * std::log (2.0));
+    this->_probes = std::max (1, std::min (this->_probes, FILTER_MAX_PROBES));
+    double bits = bits_per_key * (double) std::max (keys, (std::size_t) 1);
+    std::size_t blocks = 1;
+    while ((double) blocks * FILTER_BLOCK_BITS < bits)
+    { blocks *= 2; }
+    this->_mask = blocks - 1;
+    // The vector isn't aligned past 16 bytes, so it gets a spare block and
+    // the first aligned word is kept as an offset
+    this->_words.assign ((blocks + 1) * FILTER_BLOCK_WORDS, 0);
+    this->_offset = aligned_offset (this->_words);
+  }
+
+  blocked_bloom_filter (const blocked_bloom_filter &other)
+      : _false_positive_rate (other._false_positive_rate),
+        _probes (other._probes), _mask (other._mask),
+        _words (other._words.size (), 0)
+  {
+    this->_offset = aligned_offset (this->_words);
+    std::copy (other.block (0),
+               other.block (0) + (this->_mask + 1) * FILTER_BLOCK_WORDS,
+               this->block (0));
+  }
+
+  blocked_bloom_filter &operator= (const blocked_bloom_filter &) = delete;
+
+  /**
+   * The rate given at construction.
+   * @return Double value.
+   */
+  double false_positive_rate () const
+  { return this->_false_positive_rate; }
+
+  /**
+   * Add a key.
+   * @param hash Hash of the key.
+   */
+  void add (std::size_t hash)
+  {
+    std::uint64_t mixed = mix (hash);
+    std::uint64_t *words = this->block (this->block_of (mixed));
+    std::uint32_t probe = (std::uint32_t) mixed;
+    std::uint32_t step = (std::uint32_t) (mixed >> 32) | 1;
+    for (int i = 0; i < this->_probes; ++i, probe += step)
+    {
+      std::uint32_t bit = probe % FILTER_BLOCK_BITS;
+      words[bit / 64] |= 1ULL << (bit % 64);
+    }
+  }
+
+  /**
+   * Check if the key may have been added.
+   * @param hash Hash of the key.
+   * @return False if the key was never added, true otherwise.
+   */
+  bool may_contain (std::size_t hash) const
+  {
+    std::uint64_t mixed = mix (hash);
+    const std::uint64_t *words = this->block (this->block_of (mixed));
+    std::uint32_t probe = (std::uint32_t) mixed;
+    std::uint32_t step = (std::uint32_t) (mixed >> 32) | 1;
+    for (int i = 0; i < this->_probes; ++i, probe += step)
+    {
+      std::uint32_t bit = probe % FILTER_BLOCK_BITS;
+      if ((words[bit / 64] & (1ULL << (bit % 64))) == 0)
+      { return false; }
+    }
+    return true;
+  }
+
+  /**
+   * Remove every key.
+   */
+  void clear ()
+  { std::fill (this->_words.begin (), this->_words.end (), 0); }
+
+ private:
+  double _false_positive_rate;
+  int _probes;
+  std::size_t _mask;
+  std::size_t _offset;
+  std::vector<std::uint64_t> _words;
+
+  static std::uint64_t mix (std::uint64_t hash)
+  {
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    return hash ^ (hash >> 31);
+  }
+
+  /**
+   * Block of the key. The probes use all the bits of the mixed hash, so it
+   * is mixed once more to pick the block.
+   */
+  std::size_t block_of (std::uint64_t mixed) const
+  { return (std::size_t) mix (mixed + 0x9E3779B97F4A7C15ULL) & this->_mask; }
+
+  static std::size_t aligned_offset (const std::vector<std::uint64_t> &words)
+  {
+    const std::size_t block_bytes = FILTER_BLOCK_BITS / 8;
+    std::size_t misalign =
+        (std::size_t) ((std::uintptr_t) words.data () % block_bytes);
+    if (misalign == 0)
+    { return 0; }
+    return (block_bytes - misalign) / sizeof (std::uint64_t);
+  }
+
+  std::uint64_t *block (std::size_t index)
+  { return &this->_words[this->_offset + index * FILTER_BLOCK_WORDS]; }
+
+  const std::uint64_t *block (std::size_t index) const
+  { return &this->_words[this->_offset + index * FILTER_BLOCK_WORDS]; }
+};
+
+#endif //_BLOOMFILTER_HPP_
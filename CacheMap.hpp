@@ -0,0 +1,331 @@
+#include "HashMap.hpp"
+
+#ifndef _CACHEMAP_HPP_
+#define _CACHEMAP_HPP_
+#define NO_ENTRY UINT32_MAX
+
+/**
+ * Which entry a full CacheMap evicts.
+ * LRU: the least recently used one, a hit moves the entry to the front.
+ * CLOCK: a hand sweeps the entry slots, sparing (once) entries hit since
+ * its last pass, new entries take the slot of the evicted one.
+ * SIEVE: like CLOCK, but the hand sweeps from the oldest entry to the
+ * newest, and spared entries keep their place, so new entries which are
+ * never hit again are evicted quickly.
+ * CLOCK and SIEVE only set a flag on a hit.
+ */
+enum cache_policy
+{
+  LRU, CLOCK, SIEVE
+};
+
+/**
+ * What the budget of a CacheMap counts, entries or bytes.
+ */
+enum cache_budget
+{
+  ENTRIES, BYTES
+};
+
+/**
+ * Bounded cache on top of HashMap.
+ * The entries live in a slot array, linked from the newest to the oldest
+ * by slot indices, and a HashMap maps every key to its slot. A hit only
+ * updates links or a flag, it never allocates. The HashMap is reserved for
+ * the whole budget of entries and evicted keys are removed without the
+ * LOW_THRESHOLD shrink, so a warm cache never re-hashes.
+ * With a byte budget, an entry weighs its slot, its index pair and the heap
+ * bytes of its strings; the slot array grows until the cache is warm.
+ * Slots are linked by 32 bit indices, which keeps the links of an entry in
+ * 8 bytes and limits a cache to 2^32 - 1 entries.
+ */
+template<typename KeyT, typename ValueT>
+class CacheMap : private HashMap<KeyT, std::uint32_t>
+{
+ public:
+  /**
+   * @param budget Number of entries, or of bytes, the cache may hold.
+   * @param policy Eviction policy.
+   * @param kind What the budget counts.
+   */
+  explicit CacheMap (std::size_t budget, cache_policy policy = LRU,
+                     cache_budget kind = ENTRIES)
+      : _budget (budget), _used (0), _policy (policy), _kind (kind),
+        _head (NO_ENTRY), _tail (NO_ENTRY), _free (NO_ENTRY), _hand (NO_ENTRY),
+        _hits (0), _misses (0)
+  {
+    if (budget == 0)
+    { throw std::invalid_argument ("The budget must be positive."); }
+    if (kind == ENTRIES)
+    {
+      this->_entries.reserve (budget);
+      this->reserve (budget);
+    }
+  }
+
+  using HashMap<KeyT, std::uint32_t>::size;
+  using HashMap<KeyT, std::uint32_t>::empty;
+  using HashMap<KeyT, std::uint32_t>::contains_key;
+
+  /**
+   * The budget given at construction.
+   * @return Number of entries or of bytes.
+   */
+  std::size_t budget () const
+  { return this->_budget; }
+
+  /**
+   * The part of the budget in use.
+   * @return Number of entries or of bytes.
+   */
+  std::size_t used () const
+  { return this->_used; }
+
+  /**
+   * Number of get () calls which found their key.
+   */
+  std::size_t hits () const
+  { return this->_hits; }
+
+  /**
+   * Number of get () calls which missed.
+   */
+  std::size_t misses () const
+  { return this->_misses; }
+
+  /**
+   * Value of the key, marking it as used.
+   * The pointer stays valid until the next put or erase.
+   * @param key Generic type variable.
+   * @return Pointer to the value, nullptr if the key isn't cached.
+   */
+  ValueT *get (const KeyT &key)
+  {
+    std::pair<KeyT, std::uint32_t> *slot = this->lookup (key);
+    if (slot == nullptr)
+    {
+      ++this->_misses;
+      return nullptr;
+    }
+    ++this->_hits;
+    this->touch (slot->second);
+    return &this->_entries[slot->second].value;
+  }
+
+  /**
+   * Cache the value of the key, evicting entries until it fits the budget.
+   * An entry heavier than the whole budget isn't cached.
+   * @param key Generic type variable.
+   * @param value Generic type variable.
+   * @return True if the key is cached now.
+   */
+  bool put (const KeyT &key, const ValueT &value)
+  {
+    std::size_t weight = this->weight_of (key, value);
+    std::size_t hash = this->hash_key (key);
+    std::pair<KeyT, std::uint32_t> *slot = this->find_in_bucket (
+        key, &this->_bucket_list[hash & (this->_capacity - 1)], hash);
+    if (slot != nullptr)
+    {
+      std::uint32_t index = slot->second;
+      if (weight > this->_budget)
+      {
+        this->release (index);
+        return false;
+      }
+      entry &cur = this->_entries[index];
+      this->_used = this->_used - cur.weight + weight;
+      cur.value = value;
+      cur.weight = weight;
+      this->touch (index);
+      while (this->_used > this->_budget)
+      { this->release (this->victim ()); }
+      return true;
+    }
+    if (weight > this->_budget)
+    { return false; }
+    while (this->_used + weight > this->_budget)
+    { this->release (this->victim ()); }
+    std::uint32_t index = this->allocate (key, value, weight);
+    this->link_front (index);
+    this->add_missing (hash, key, index);
+    this->_used += weight;
+    return true;
+  }
+
+  /**
+   * Drop the key from the cache.
+   * @param key Generic type variable.
+   * @return True if the key was cached.
+   */
+  bool erase (const KeyT &key)
+  {
+    std::pair<KeyT, std::uint32_t> *slot = this->lookup (key);
+    if (slot == nullptr)
+    { return false; }
+    this->release (slot->second);
+    return true;
+  }
+
+  /**
+   * Drop every entry, keeping the capacity.
+   */
+  void clear ()
+  {
+    while (this->_head != NO_ENTRY)
+    { this->release (this->_head); }
+  }
+
+ private:
+  struct entry
+  {
+    KeyT key;
+    ValueT value;
+    std::size_t weight;
+    std::uint32_t prev;
+    std::uint32_t next;
+    bool visited;
+    bool used;
+  };
+
+  std::vector<entry> _entries;
+  std::size_t _budget;
+  std::size_t _used;
+  cache_policy _policy;
+  cache_budget _kind;
+  std::uint32_t _head;
+  std::uint32_t _tail;
+  std::uint32_t _free;
+  std::uint32_t _hand;
+  std::size_t _hits;
+  std::size_t _misses;
+
+  std::size_t weight_of (const KeyT &key, const ValueT &value) const
+  {
+    if (this->_kind == ENTRIES)
+    { return 1; }
+    return sizeof (entry) + sizeof (std::pair<KeyT, std::uint32_t>)
+           + 2 * heap_bytes (key) + heap_bytes (value);
+  }
+
+  std::pair<KeyT, std::uint32_t> *lookup (const KeyT &key)
+  {
+    std::size_t hash = this->hash_key (key);
+    return this->find_in_bucket (
+        key, &this->_bucket_list[hash & (this->_capacity - 1)], hash);
+  }
+
+  void touch (std::uint32_t index)
+  {
+    if (this->_policy != LRU)
+    {
+      this->_entries[index].visited = true;
+      return;
+    }
+    if (index != this->_head)
+    {
+      this->unlink (index);
+      this->link_front (index);
+    }
+  }
+
+  void link_front (std::uint32_t index)
+  {
+    entry &cur = this->_entries[index];
+    cur.prev = NO_ENTRY;
+    cur.next = this->_head;
+    if (this->_head != NO_ENTRY)
+    { this->_entries[this->_head].prev = index; }
+    else
+    { this->_tail = index; }
+    this->_head = index;
+  }
+
+  void unlink (std::uint32_t index)
+  {
+    entry &cur = this->_entries[index];
+    if (cur.prev != NO_ENTRY)
+    { this->_entries[cur.prev].next = cur.next; }
+    else
+    { this->_head = cur.next; }
+    if (cur.next != NO_ENTRY)
+    { this->_entries[cur.next].prev = cur.prev; }
+    else
+    { this->_tail = cur.prev; }
+  }
+
+  /**
+   * Slot of the entry to evict next, according to the policy.
+   */
+  std::uint32_t victim ()
+  {
+    if (this->_policy == LRU)
+    { return this->_tail; }
+    if (this->_policy == CLOCK)
+    {
+      std::uint32_t slots = (std::uint32_t) this->_entries.size ();
+      for (;;)
+      {
+        this->_hand = (this->_hand + 1) % slots;
+        entry &cur = this->_entries[this->_hand];
+        if (!cur.used)
+        { continue; }
+        if (!cur.visited)
+        { return this->_hand; }
+        cur.visited = false;
+      }
+    }
+    std::uint32_t index = this->_hand == NO_ENTRY ? this->_tail : this->_hand;
+    while (this->_entries[index].visited)
+    {
+      this->_entries[index].visited = false;
+      index = this->_entries[index].prev;
+      if (index == NO_ENTRY)
+      { index = this->_tail; }
+    }
+    this->_hand = index;
+    return index;
+  }
+
+  std::uint32_t allocate (const KeyT &key, const ValueT &value,
+                          std::size_t weight)
+  {
+    std::uint32_t index = this->_free;
+    if (index == NO_ENTRY)
+    {
+      if (this->_entries.size () >= NO_ENTRY)
+      { throw std::length_error ("The cache has too many entries."); }
+      index = (std::uint32_t) this->_entries.size ();
+      this->_entries.push_back (entry {key, value, weight, NO_ENTRY, NO_ENTRY,
+                                       false, true});
+      return index;
+    }
+    entry &cur = this->_entries[index];
+    this->_free = cur.next;
+    cur.key = key;
+    cur.value = value;
+    cur.weight = weight;
+    cur.visited = false;
+    cur.used = true;
+    return index;
+  }
+
+  /**
+   * Remove the entry of the slot from the index and the links, and put the
+   * slot on the free list.
+   */
+  void release (std::uint32_t index)
+  {
+    entry &cur = this->_entries[index];
+    if (this->_policy == SIEVE && this->_hand == index)
+    { this->_hand = cur.prev; }
+    this->unlink (index);
+    this->remove (cur.key);
+    this->_used -= cur.weight;
+    cur.used = false;
+    cur.next = this->_free;
+    this->_free = index;
+  }
+};
+
+#endif //_CACHEMAP_HPP_
@@ -0,0 +1,657 @@
+#include "HashMap.hpp"
+#include <new>
+
+#ifndef _COLUMNHASHMAP_HPP_
+#define _COLUMNHASHMAP_HPP_
+
+/**
+ * Open addressing variant of HashMap storing its pairs as columns: a byte
+ * array of key fingerprints, an array of keys and a parallel array of
+ * values, instead of one array of pairs.
+ * Probing (contains_key, insert, erase) reads the fingerprints and, on a
+ * fingerprint match, the key; a value is only touched once its key is
+ * found. Iterating keys () reads no value at all. This keeps large values
+ * (long strings in a Dictionary) out of the cache in key heavy workloads.
+ * Slots are probed linearly from hash & (capacity - 1), and erase shifts
+ * the following pairs of the cluster back (no tombstones).
+ * Iterators yield pairs of references, (key, value), built from both
+ * columns. Capacity, growth and shrink follow HashMap (START_CAPACITY,
+ * TOP_THRESHOLD and LOW_THRESHOLD).
+ */
+template<typename KeyT, typename ValueT>
+class ColumnHashMap
+{
+  class iterator_t;
+  class key_iterator_t;
+
+ public:
+  typedef iterator_t const_iterator;
+  typedef key_iterator_t const_key_iterator;
+
+  ColumnHashMap () : _tags (nullptr), _keys (nullptr), _values (nullptr),
+                     _capacity (0), _size (0), _exponent (0)
+  { this->allocate (START_EXPONENT); }
+
+  ColumnHashMap (const std::vector<KeyT> &keys_vector,
+                 const std::vector<ValueT> &values_vector) : ColumnHashMap ()
+  {
+    if (keys_vector.size () != values_vector.size ())
+    { throw std::length_error ("The size of the vectors is unmatched."); }
+    for (std::size_t i = 0; i < keys_vector.size (); ++i)
+    { this->insert_or_assign (keys_vector[i], values_vector[i]); }
+  }
+
+  /**
+   * Copy ctor.
+   * Clones the columns as is, every pair keeps its slot.
+   * @param other ColumnHashMap to copy.
+   */
+  ColumnHashMap (const ColumnHashMap<KeyT, ValueT> &other)
+      : _tags (nullptr), _keys (nullptr), _values (nullptr), _capacity (0),
+        _size (0), _exponent (0)
+  {
+    this->allocate (other._exponent);
+    try
+    {
+      for (std::size_t i = 0; i < other._capacity; ++i)
+      {
+        if (other._tags[i] != EMPTY_TAG)
+        {
+          new (&this->_keys[i]) KeyT (other._keys[i]);
+          try
+          { new (&this->_values[i]) ValueT (other._values[i]); }
+          catch (...)
+          {
+            this->_keys[i].~KeyT ();
+            throw;
+          }
+          this->_tags[i] = other._tags[i];
+          ++this->_size;
+        }
+      }
+    }
+    catch (...)
+    {
+      this->clear ();
+      this->release ();
+      throw;
+    }
+  }
+
+  ~ColumnHashMap ()
+  {
+    this->clear ();
+    this->release ();
+  }
+
+  ColumnHashMap<KeyT, ValueT> &operator= (ColumnHashMap<KeyT, ValueT> rhs)
+  {
+    swap (*this, rhs);
+    return *this;
+  }
+
+  friend void swap (ColumnHashMap<KeyT, ValueT> &src,
+                    ColumnHashMap<KeyT, ValueT> &dst)
+  {
+    std::swap (src._tags, dst._tags);
+    std::swap (src._keys, dst._keys);
+    std::swap (src._values, dst._values);
+    std::swap (src._capacity, dst._capacity);
+    std::swap (src._size, dst._size);
+    std::swap (src._exponent, dst._exponent);
+  }
+
+  /**
+   * Size of elements inside the map.
+   * @return Size_t value.
+   */
+  std::size_t size () const
+  { return this->_size; }
+
+  /**
+   * Number of slots of the map.
+   * @return Size_t value.
+   */
+  std::size_t capacity () const
+  { return this->_capacity; }
+
+  /**
+   * Check if the map is empty.
+   * @return Boolean value.
+   */
+  bool empty () const
+  { return this->_size == 0; }
+
+  double get_load_factor () const
+  { return (double) this->_size / (double) this->_capacity; }
+
+  /**
+   * Insert new pair<Key, Value> into the map.
+   * If key already exists, do nothing.
+   * @param key Generic type value.
+   * @param value Generic type value.
+   * @return True if the pair was inserted.
+   */
+  bool insert (const KeyT &key, const ValueT &value)
+  {
+    std::size_t hash = hash_of (key);
+    if (this->find_slot (key, hash) != NOT_FOUND)
+    { return false; }
+    this->add_missing (hash, key, value);
+    return true;
+  }
+
+  /**
+   * Insert new pair<Key, Value> into the map, or overwrite the value of an
+   * existing key.
+   * @param key Generic type value.
+   * @param value Generic type value.
+   * @return True if a new pair was inserted, false if a value was replaced.
+   */
+  bool insert_or_assign (const KeyT &key, const ValueT &value)
+  {
+    std::size_t hash = hash_of (key);
+    std::size_t slot = this->find_slot (key, hash);
+    if (slot == NOT_FOUND)
+    {
+      this->add_missing (hash, key, value);
+      return true;
+    }
+    this->_values[slot] = value;
+    return false;
+  }
+
+  /**
+   * Grow the capacity once, so that count pairs fit without any more
+   * re-hashing. Never shrinks.
+   * @param count Size_t type variable.
+   */
+  void reserve (std::size_t count)
+  {
+    int exponent = this->_exponent;
+    while ((double) count / (double) ((std::size_t) 1 << exponent)
+           > TOP_THRESHOLD)
+    { ++exponent; }
+    if (exponent != this->_exponent)
+    { this->re_hashing_to (exponent); }
+  }
+
+  /**
+   * Check if given key is already in the map. Reads no value.
+   * @param key Generic type value.
+   * @return Boolean Value.
+   */
+  bool contains_key (const KeyT &key) const
+  { return this->find_slot (key, hash_of (key)) != NOT_FOUND; }
+
+  /**
+   * Given reference to value by key.
+   * If key doesnt exists throw error.
+   * @param key Generic type value.
+   * @return Reference to generic type variable named value.
+   */
+  const ValueT &at (const KeyT &key) const
+  {
+    std::size_t slot = this->find_slot (key, hash_of (key));
+    if (slot == NOT_FOUND)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return this->_values[slot];
+  }
+
+  /**
+   * Given reference to value by key.
+   * If key doesnt exists throw error.
+   * @param key Generic type value.
+   * @return Reference to generic type variable named value.
+   */
+  ValueT &at (const KeyT &key)
+  {
+    std::size_t slot = this->find_slot (key, hash_of (key));
+    if (slot == NOT_FOUND)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return this->_values[slot];
+  }
+
+  ValueT &operator[] (const KeyT &key)
+  {
+    std::size_t hash = hash_of (key);
+    std::size_t slot = this->find_slot (key, hash);
+    if (slot == NOT_FOUND)
+    { slot = this->add_missing (hash, key, ValueT ()); }
+    return this->_values[slot];
+  }
+
+  ValueT operator[] (const KeyT &key) const
+  { return this->at (key); }
+
+  /**
+   * Remove the pair of the given key, shifting the rest of its cluster
+   * back. Shrinks the capacity if the load factor drops below
+   * LOW_THRESHOLD.
+   * @param key Generic type value.
+   * @return True if the key was found and removed.
+   */
+  bool erase (const KeyT &key)
+  {
+    std::size_t slot = this->find_slot (key, hash_of (key));
+    if (slot == NOT_FOUND)
+    { return false; }
+    this->remove_slot (slot);
+    this->shrink_to_fit ();
+    return true;
+  }
+
+  /**
+   * Shrink the capacity with a single re-hashing, to the largest capacity
+   * whose load factor isn't below LOW_THRESHOLD.
+   */
+  void shrink_to_fit ()
+  {
+    int exponent = this->_exponent;
+    while (exponent > START_EXPONENT
+           && (double) this->_size / (double) ((std::size_t) 1 << exponent)
+              < LOW_THRESHOLD)
+    { --exponent; }
+    if (exponent != this->_exponent)
+    { this->re_hashing_to (exponent); }
+  }
+
+  /**
+   * Remove all the pairs, the capacity stays the same.
+   */
+  void clear ()
+  {
+    for (std::size_t i = 0; i < this->_capacity; ++i)
+    {
+      if (this->_tags[i] != EMPTY_TAG)
+      {
+        this->_keys[i].~KeyT ();
+        this->_values[i].~ValueT ();
+        this->_tags[i] = EMPTY_TAG;
+      }
+    }
+    this->_size = 0;
+  }
+
+  const_iterator begin () const
+  { return this->cbegin (); }
+
+  const_iterator cbegin () const
+  { return const_iterator (*this, 0); }
+
+  const_iterator end () const
+  { return this->cend (); }
+
+  const_iterator cend () const
+  { return const_iterator (*this, this->_capacity); }
+
+  /**
+   * Range over the keys only, reading neither the values nor the pairs.
+   */
+  class key_range
+  {
+   private:
+    const_key_iterator _begin;
+    const_key_iterator _end;
+
+   public:
+    key_range (const const_key_iterator &begin, const const_key_iterator &end)
+        : _begin (begin), _end (end)
+    {}
+
+    const_key_iterator begin () const
+    { return this->_begin; }
+
+    const_key_iterator end () const
+    { return this->_end; }
+  };
+
+  /**
+   * The keys of the map, in iteration order.
+   * @return key_range over the key column.
+   */
+  key_range keys () const
+  {
+    return key_range (const_key_iterator (*this, 0),
+                      const_key_iterator (*this, this->_capacity));
+  }
+
+  /**
+   * Two maps are equal if they hold the same (key, value) pairs. The keys
+   * are matched first, values are only compared for keys found in both.
+   */
+  bool operator== (const ColumnHashMap<KeyT, ValueT> &rhs) const
+  {
+    if (this->_size != rhs._size)
+    { return false; }
+    for (std::size_t i = 0; i < rhs._capacity; ++i)
+    {
+      if (rhs._tags[i] == EMPTY_TAG)
+      { continue; }
+      std::size_t slot = this->find_slot (rhs._keys[i],
+                                          hash_of (rhs._keys[i]));
+      if (slot == NOT_FOUND || !(this->_values[slot] == rhs._values[i]))
+      { return false; }
+    }
+    return true;
+  }
+
+  bool operator!= (const ColumnHashMap<KeyT, ValueT> &rhs) const
+  { return !this->operator== (rhs); }
+
+ private:
+  static const std::uint8_t EMPTY_TAG = 0;
+  static const std::size_t NOT_FOUND = (std::size_t) -1;
+
+  /**
+   * Fingerprint of every slot, EMPTY_TAG for empty slots: the top 7 bits
+   * of the hash with the high bit set. Rejects about 127 of 128 keys which
+   * share a cluster without reading them.
+   */
+  std::uint8_t *_tags;
+  KeyT *_keys;
+  ValueT *_values;
+  std::size_t _capacity;
+  std::size_t _size;
+  int _exponent;
+
+  /**
+   * Hash of a key. std::hash is the identity for integers, so it is mixed
+   * before the home slot is taken from the low bits and the tag from the
+   * high bits, or sequential keys would form one cluster, all with one tag.
+   */
+  static std::size_t hash_of (const KeyT &key)
+  {
+    std::uint64_t word = std::hash<KeyT>{} (key);
+    word ^= word >> 33;
+    word *= 0xFF51AFD7ED558CCDULL;
+    word ^= word >> 33;
+    return (std::size_t) word;
+  }
+
+  static std::uint8_t tag_of (std::size_t hash)
+  {
+    return (std::uint8_t) (0x80
+                           | (hash >> (8 * sizeof (std::size_t) - 7)));
+  }
+
+  /**
+   * Allocate empty columns of 2^exponent slots.
+   * @param exponent Int type variable.
+   */
+  void allocate (int exponent)
+  {
+    std::size_t capacity = (std::size_t) 1 << exponent;
+    std::unique_ptr<std::uint8_t[]> tags (new std::uint8_t[capacity] ());
+    void *keys = ::operator new (sizeof (KeyT) * capacity);
+    try
+    {
+      this->_values = static_cast<ValueT *> (
+          ::operator new (sizeof (ValueT) * capacity));
+    }
+    catch (...)
+    {
+      ::operator delete (keys);
+      throw;
+    }
+    this->_tags = tags.release ();
+    this->_keys = static_cast<KeyT *> (keys);
+    this->_capacity = capacity;
+    this->_exponent = exponent;
+  }
+
+  /**
+   * Free the columns, the slots must be empty (or moved from and
+   * destroyed).
+   */
+  void release ()
+  {
+    delete[] this->_tags;
+    ::operator delete (this->_keys);
+    ::operator delete (this->_values);
+    this->_tags = nullptr;
+    this->_keys = nullptr;
+    this->_values = nullptr;
+  }
+
+  /**
+   * Find the slot of the given key, walking the cluster from its home
+   * slot. Keys are only compared when the fingerprint matches.
+   * @return Slot index, or NOT_FOUND.
+   */
+  std::size_t find_slot (const KeyT &key, std::size_t hash) const
+  {
+    std::uint8_t tag = tag_of (hash);
+    for (std::size_t slot = hash & (this->_capacity - 1);;
+         slot = (slot + 1) & (this->_capacity - 1))
+    {
+      std::uint8_t slot_tag = this->_tags[slot];
+      if (slot_tag == EMPTY_TAG)
+      { return NOT_FOUND; }
+      if (slot_tag == tag && this->_keys[slot] == key)
+      { return slot; }
+    }
+  }
+
+  /**
+   * First empty slot from the home slot of the hash onwards.
+   * @return Slot index.
+   */
+  std::size_t free_slot (std::size_t hash) const
+  {
+    std::size_t slot = hash & (this->_capacity - 1);
+    while (this->_tags[slot] != EMPTY_TAG)
+    { slot = (slot + 1) & (this->_capacity - 1); }
+    return slot;
+  }
+
+  /**
+   * Add a pair whose key is known to be missing, growing if needed.
+   * @return Slot of the new pair.
+   */
+  std::size_t add_missing (std::size_t hash, const KeyT &key,
+                           const ValueT &value)
+  {
+    if ((double) (this->_size + 1) / this->_capacity > TOP_THRESHOLD)
+    { this->re_hashing_to (this->_exponent + 1); }
+    std::size_t slot = this->free_slot (hash);
+    new (&this->_keys[slot]) KeyT (key);
+    try
+    { new (&this->_values[slot]) ValueT (value); }
+    catch (...)
+    {
+      this->_keys[slot].~KeyT ();
+      throw;
+    }
+    this->_tags[slot] = tag_of (hash);
+    ++this->_size;
+    return slot;
+  }
+
+  /**
+   * Move the pair of slot from into the empty slot to.
+   */
+  void move_slot (std::size_t from, std::size_t to)
+  {
+    new (&this->_keys[to]) KeyT (std::move (this->_keys[from]));
+    new (&this->_values[to]) ValueT (std::move (this->_values[from]));
+    this->_keys[from].~KeyT ();
+    this->_values[from].~ValueT ();
+    this->_tags[to] = this->_tags[from];
+  }
+
+  /**
+   * Destroy the pair of the given slot, and move back every following pair
+   * of the cluster whose home slot doesn't lie between the hole and its
+   * slot, so no key is ever behind an empty slot of its probe sequence.
+   * Homes are found by hashing the keys again, the values aren't read.
+   * @param slot Slot index.
+   */
+  void remove_slot (std::size_t slot)
+  {
+    std::size_t mask = this->_capacity - 1;
+    std::size_t hole = slot;
+    this->_keys[hole].~KeyT ();
+    this->_values[hole].~ValueT ();
+    for (std::size_t next = (hole + 1) & mask;
+         this->_tags[next] != EMPTY_TAG; next = (next + 1) & mask)
+    {
+      std::size_t home = hash_of (this->_keys[next]) & mask;
+      if (((next - home) & mask) < ((next - hole) & mask))
+      { continue; }
+      this->move_slot (next, hole);
+      hole = next;
+    }
+    this->_tags[hole] = EMPTY_TAG;
+    --this->_size;
+  }
+
+  /**
+   * Change the capacity to 2^exponent slots, and place every pair again.
+   * @param exponent Int type variable.
+   */
+  void re_hashing_to (int exponent)
+  {
+    std::uint8_t *old_tags = this->_tags;
+    KeyT *old_keys = this->_keys;
+    ValueT *old_values = this->_values;
+    std::size_t old_capacity = this->_capacity;
+    this->allocate (exponent);
+    for (std::size_t i = 0; i < old_capacity; ++i)
+    {
+      if (old_tags[i] != EMPTY_TAG)
+      {
+        std::size_t slot = this->free_slot (hash_of (old_keys[i]));
+        new (&this->_keys[slot]) KeyT (std::move (old_keys[i]));
+        new (&this->_values[slot]) ValueT (std::move (old_values[i]));
+        this->_tags[slot] = old_tags[i];
+        old_keys[i].~KeyT ();
+        old_values[i].~ValueT ();
+      }
+    }
+    delete[] old_tags;
+    ::operator delete (old_keys);
+    ::operator delete (old_values);
+  }
+
+  /**
+   * Walks the occupied slots, reading only the fingerprints.
+   */
+  class slot_cursor
+  {
+   protected:
+    const ColumnHashMap<KeyT, ValueT> *_map_container;
+    std::size_t _position;
+
+    slot_cursor (const ColumnHashMap<KeyT, ValueT> &map_container,
+                 std::size_t position)
+        : _map_container (&map_container), _position (position)
+    { this->skip_empty (); }
+
+    void skip_empty ()
+    {
+      while (this->_position < this->_map_container->_capacity
+             && this->_map_container->_tags[this->_position] == EMPTY_TAG)
+      { ++this->_position; }
+    }
+
+    void advance ()
+    {
+      ++this->_position;
+      this->skip_empty ();
+    }
+
+   public:
+    bool operator== (const slot_cursor &rhs) const
+    {
+      return this->_map_container == rhs._map_container
+             && this->_position == rhs._position;
+    }
+
+    bool operator!= (const slot_cursor &rhs) const
+    { return !this->operator== (rhs); }
+  };
+
+  class iterator_t : public slot_cursor
+  {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::pair<const KeyT &, const ValueT &> value_type;
+    typedef value_type reference;
+    typedef std::ptrdiff_t difference_type;
+
+    /**
+     * The pairs of references are built on the fly, -> keeps one alive for
+     * the call.
+     */
+    struct pointer
+    {
+      value_type pair;
+
+      const value_type *operator-> () const
+      { return &this->pair; }
+    };
+
+    iterator_t (const ColumnHashMap<KeyT, ValueT> &map_container,
+                std::size_t position) : slot_cursor (map_container, position)
+    {}
+
+    reference operator* () const
+    {
+      return value_type (this->_map_container->_keys[this->_position],
+                         this->_map_container->_values[this->_position]);
+    }
+
+    pointer operator-> () const
+    { return pointer {this->operator* ()}; }
+
+    iterator_t &operator++ ()
+    {
+      this->advance ();
+      return *this;
+    }
+
+    iterator_t operator++ (int)
+    {
+      iterator_t it (*this);
+      this->advance ();
+      return it;
+    }
+  };
+
+  class key_iterator_t : public slot_cursor
+  {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef const KeyT value_type;
+    typedef value_type &reference;
+    typedef value_type *pointer;
+    typedef std::ptrdiff_t difference_type;
+
+    key_iterator_t (const ColumnHashMap<KeyT, ValueT> &map_container,
+                    std::size_t position)
+        : slot_cursor (map_container, position)
+    {}
+
+    reference operator* () const
+    { return this->_map_container->_keys[this->_position]; }
+
+    pointer operator-> () const
+    { return &(this->operator* ()); }
+
+    key_iterator_t &operator++ ()
+    {
+      this->advance ();
+      return *this;
+    }
+
+    key_iterator_t operator++ (int)
+    {
+      key_iterator_t it (*this);
+      this->advance ();
+      return it;
+    }
+  };
+};
+
+#endif //_COLUMNHASHMAP_HPP_
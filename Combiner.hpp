@@ -0,0 +1,175 @@
+#include "ParallelHashMap.hpp"
+
+#ifndef _COMBINER_HPP_
+#define _COMBINER_HPP_
+#ifndef CACHE_LINE
+#define CACHE_LINE 64
+#endif
+
+/**
+ * HashMap which can be filled one hash partition at a time, from several
+ * threads at once, see HashMap::merge_partition.
+ */
+template<typename KeyT, typename ValueT>
+class partitioned_map : public HashMap<KeyT, ValueT>
+{
+ public:
+  using HashMap<KeyT, ValueT>::merge_partition;
+
+  /**
+   * Account for the pairs the partition merges added.
+   * @param added Size_t type variable.
+   */
+  void add_size (std::size_t added)
+  {
+    this->_size += added;
+    this->_digest_valid = false;
+  }
+};
+
+/**
+ * Aggregation of values from many threads without synchronization.
+ * Each worker writes into its own HashMap, local (worker), e.g.
+ * combiner.local (worker)[key] += 1. combine () then merges all the local
+ * maps into a single one, in parallel: the result is reserved once and
+ * split into partitions by the low bits of the hash, every thread merges
+ * whole partitions, so no two threads touch the same bucket.
+ * Combine is called as combine (accumulated, value) and returns the new
+ * accumulated value, std::plus for counting.
+ */
+template<typename KeyT, typename ValueT,
+    typename Combine = std::plus<ValueT>>
+class Combiner
+{
+ public:
+  /**
+   * @param workers Number of local maps.
+   * @param combine Callable of (ValueT, ValueT) returning ValueT.
+   */
+  explicit Combiner (int workers, Combine combine = Combine ())
+      : _locals (workers), _combine (combine)
+  {
+    if (workers < 1)
+    { throw std::invalid_argument ("At least one worker is needed."); }
+  }
+
+  /**
+   * Number of local maps.
+   * @return Int value.
+   */
+  int workers () const
+  { return (int) this->_locals.size (); }
+
+  /**
+   * The map of the given worker. A local map must only be used by one
+   * thread at a time, and not during combine ().
+   * @param worker Index of the worker, from 0 to workers () - 1.
+   * @return Reference to the local map.
+   */
+  HashMap<KeyT, ValueT> &local (int worker)
+  { return this->_locals[worker].map; }
+
+  /**
+   * Merge all the local maps into one, in parallel, and clear them.
+   * @param threads Int type variable.
+   * @return HashMap with every key of the local maps.
+   */
+  HashMap<KeyT, ValueT> combine (int threads = default_thread_count ())
+  {
+    std::size_t total = 0;
+    for (const auto &local: this->_locals)
+    { total += local.map.size (); }
+    partitioned_map<KeyT, ValueT> merged;
+    merged.reserve (total);
+    std::size_t partitions = 1;
+    while (partitions < (std::size_t) threads * RANGES_PER_THREAD
+           && partitions < merged.capacity ())
+    { partitions *= 2; }
+
+    std::vector<std::size_t> added (partitions, 0);
+    run_on_ranges (partitions, threads, [&] (std::size_t i)
+    {
+      for (const auto &local: this->_locals)
+      {
+        added[i] += merged.merge_partition (local.map, i, partitions,
+                                            this->_combine);
+      }
+    });
+    for (std::size_t count: added)
+    { merged.add_size (count); }
+    // Keys repeated across workers were reserved for more than once
+    merged.shrink_to_fit ();
+
+    run_on_ranges (this->_locals.size (), threads, [this] (std::size_t i)
+    { this->_locals[i].map.clear (); });
+    HashMap<KeyT, ValueT> result;
+    swap (result, merged);
+    return result;
+  }
+
+ private:
+  /**
+   * Local map padded to its own cache lines, so workers updating the size
+   * of neighbouring maps don't share a line.
+   */
+  struct padded_map
+  {
+    HashMap<KeyT, ValueT> map;
+    char padding[CACHE_LINE];
+  };
+
+  std::vector<padded_map> _locals;
+  Combine _combine;
+};
+
+/**
+ * The k pairs with the largest values (the heavy hitters), largest first.
+ * Each range of the map keeps its own k best pairs in a heap, in parallel,
+ * and the heaps are merged at the end.
+ * @param map HashMap to scan.
+ * @param k Number of pairs.
+ * @param threads Int type variable.
+ * @return Vector of at most k pairs.
+ */
+template<typename KeyT, typename ValueT>
+std::vector<std::pair<KeyT, ValueT>>
+top_k (const HashMap<KeyT, ValueT> &map, std::size_t k,
+       int threads = default_thread_count ())
+{
+  typedef std::pair<KeyT, ValueT> pair_type;
+  auto heavier = [] (const pair_type &a, const pair_type &b)
+  { return b.second < a.second; };
+  if (k == 0)
+  { return std::vector<pair_type> (); }
+  auto ranges = map.split_ranges (threads * RANGES_PER_THREAD);
+  std::vector<std::vector<pair_type>> heaps (ranges.size ());
+  run_on_ranges (ranges.size (), threads, [&] (std::size_t i)
+  {
+    std::vector<pair_type> &heap = heaps[i];
+    for (const auto &pair: ranges[i])
+    {
+      if (heap.size () < k)
+      {
+        heap.push_back (pair);
+        std::push_heap (heap.begin (), heap.end (), heavier);
+      }
+      else if (heap.front ().second < pair.second)
+      {
+        std::pop_heap (heap.begin (), heap.end (), heavier);
+        heap.back () = pair;
+        std::push_heap (heap.begin (), heap.end (), heavier);
+      }
+    }
+  });
+
+  std::vector<pair_type> best;
+  for (auto &heap: heaps)
+  { best.insert (best.end (), heap.begin (), heap.end ()); }
+  std::size_t count = std::min (k, best.size ());
+  std::partial_sort (best.begin (), best.begin () + count, best.end (),
+                     heavier);
+  best.resize (count);
+  return best;
+}
+
+#endif //_COMBINER_HPP_
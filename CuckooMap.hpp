@@ -0,0 +1,703 @@
+#include "HashMap.hpp"
+#include <new>
+
+#ifndef _CUCKOOMAP_HPP_
+#define _CUCKOOMAP_HPP_
+#define CUCKOO_SLOTS 4
+#define CUCKOO_MAX_LOAD 0.95
+#define CUCKOO_MAX_KICKS 500
+#define CUCKOO_STASH_SIZE 4
+#define CUCKOO_MAX_RESEEDS 8
+#define CACHE_LINE 64
+
+/**
+ * Bucketized cuckoo hash map, with worst case constant time lookups.
+ * Every key has exactly two candidate buckets of CUCKOO_SLOTS slots, so
+ * at () and contains_key () look at two buckets (two cache lines for small
+ * pairs) and at a small stash, which is empty almost always.
+ * Each slot has a one byte tag (a fingerprint of the hash), so keys are only
+ * compared on a tag match. The second bucket is derived from the first one
+ * and the tag (partial key cuckoo hashing), so pairs can be moved between
+ * their buckets without hashing their keys again.
+ * Insertion kicks pairs to their other bucket for up to CUCKOO_MAX_KICKS
+ * steps, then parks the last pair in the stash. When the stash is full or the
+ * load factor passes CUCKOO_MAX_LOAD, the capacity is doubled.
+ * Every map hashes with its own random seed, and draws a new one when the
+ * pairs don't fit after re-hashing. Keys whose std::hash is equal still share
+ * their two buckets whatever the seed, so inserting more of them than the two
+ * buckets and the stash hold throws std::length_error.
+ */
+template<typename KeyT, typename ValueT>
+class CuckooMap
+{
+  class iterator_t;
+  struct bucket;
+
+ public:
+  typedef iterator_t const_iterator;
+
+  CuckooMap () : _buckets (nullptr), _memory (nullptr), _bucket_count (0),
+                 _size (0), _seed (HashMap<KeyT, ValueT>::random_seed ()),
+                 _random (0x9E3779B97F4A7C15ULL)
+  { this->allocate (START_CAPACITY / CUCKOO_SLOTS); }
+
+  CuckooMap (const std::vector<KeyT> &keys_vector,
+             const std::vector<ValueT> &values_vector) : CuckooMap ()
+  {
+    if (keys_vector.size () != values_vector.size ())
+    { throw std::length_error ("The size of the vectors is unmatched."); }
+    for (std::size_t i = 0; i < keys_vector.size (); ++i)
+    { this->insert_or_assign (keys_vector[i], values_vector[i]); }
+  }
+
+  /**
+   * Copy ctor.
+   * Clones the buckets as is, every pair keeps its slot.
+   * @param other CuckooMap to copy.
+   */
+  CuckooMap (const CuckooMap<KeyT, ValueT> &other)
+      : _buckets (nullptr), _memory (nullptr), _bucket_count (0), _size (0),
+        _stash (other._stash), _seed (other._seed), _random (other._random)
+  {
+    this->allocate (other._bucket_count);
+    for (std::size_t i = 0; i < other._bucket_count; ++i)
+    {
+      for (int j = 0; j < CUCKOO_SLOTS; ++j)
+      {
+        if (other._buckets[i].tags[j] != 0)
+        {
+          new (this->_buckets[i].slot (j))
+              std::pair<KeyT, ValueT> (*other._buckets[i].slot (j));
+          this->_buckets[i].tags[j] = other._buckets[i].tags[j];
+        }
+      }
+    }
+    this->_size = other._size;
+  }
+
+  ~CuckooMap ()
+  {
+    this->clear ();
+    this->release ();
+  }
+
+  CuckooMap<KeyT, ValueT> &operator= (CuckooMap<KeyT, ValueT> rhs)
+  {
+    swap (*this, rhs);
+    return *this;
+  }
+
+  friend void swap (CuckooMap<KeyT, ValueT> &src, CuckooMap<KeyT, ValueT> &dst)
+  {
+    std::swap (src._buckets, dst._buckets);
+    std::swap (src._memory, dst._memory);
+    std::swap (src._bucket_count, dst._bucket_count);
+    std::swap (src._size, dst._size);
+    std::swap (src._stash, dst._stash);
+    std::swap (src._seed, dst._seed);
+    std::swap (src._random, dst._random);
+  }
+
+  /**
+   * Size of elements inside the map.
+   * @return Size_t value.
+   */
+  std::size_t size () const
+  { return this->_size; }
+
+  /**
+   * Number of slots of the map (not counting the stash).
+   * @return Size_t value.
+   */
+  std::size_t capacity () const
+  { return this->_bucket_count * CUCKOO_SLOTS; }
+
+  /**
+   * Check if the map is empty.
+   * @return Boolean value.
+   */
+  bool empty () const
+  { return this->_size == 0; }
+
+  double get_load_factor () const
+  { return (double) this->_size / (double) this->capacity (); }
+
+  /**
+   * Insert new pair<Key, Value> into the map.
+   * If key already exists, do nothing.
+   * @param key Generic type value.
+   * @param value Generic type value.
+   * @return True if the pair was inserted.
+   */
+  bool insert (const KeyT &key, const ValueT &value)
+  {
+    if (this->find (key) != nullptr)
+    { return false; }
+    this->add_missing (key, value);
+    return true;
+  }
+
+  /**
+   * Insert new pair<Key, Value> into the map, or overwrite the value of an
+   * existing key.
+   * @param key Generic type value.
+   * @param value Generic type value.
+   * @return True if a new pair was inserted, false if a value was replaced.
+   */
+  bool insert_or_assign (const KeyT &key, const ValueT &value)
+  {
+    std::pair<KeyT, ValueT> *pair_ptr = this->find (key);
+    if (pair_ptr != nullptr)
+    {
+      pair_ptr->second = value;
+      return false;
+    }
+    this->add_missing (key, value);
+    return true;
+  }
+
+  /**
+   * Check if given key is already in the map.
+   * @param key Generic value.
+   * @return Boolean Value.
+   */
+  bool contains_key (const KeyT &key) const
+  { return this->find (key) != nullptr; }
+
+  /**
+   * Given reference to value by key.
+   * If key doesnt exists throw error.
+   * @param key Generic type.
+   * @return Reference to generic type variable named value.
+   */
+  const ValueT &at (const KeyT &key) const
+  {
+    std::pair<KeyT, ValueT> *pair_ptr = this->find (key);
+    if (pair_ptr == nullptr)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return pair_ptr->second;
+  }
+
+  /**
+   * Given reference to value by key.
+   * If key doesnt exists throw error.
+   * @param key Generic type.
+   * @return Reference to generic type variable named value.
+   */
+  ValueT &at (const KeyT &key)
+  {
+    std::pair<KeyT, ValueT> *pair_ptr = this->find (key);
+    if (pair_ptr == nullptr)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return pair_ptr->second;
+  }
+
+  ValueT &operator[] (const KeyT &key)
+  {
+    std::pair<KeyT, ValueT> *pair_ptr = this->find (key);
+    if (pair_ptr == nullptr)
+    {
+      // The new pair may be kicked around while inserting, so look it up.
+      this->add_missing (key, ValueT ());
+      pair_ptr = this->find (key);
+    }
+    return pair_ptr->second;
+  }
+
+  ValueT operator[] (const KeyT &key) const
+  { return this->at (key); }
+
+  /**
+   * Remove the pair of the given key.
+   * Shrinks the capacity if the load factor drops below LOW_THRESHOLD.
+   * @param key Generic type variable.
+   * @return True if the key was found and removed.
+   */
+  bool erase (const KeyT &key)
+  {
+    if (!this->remove (key))
+    { return false; }
+    this->shrink_to_fit ();
+    return true;
+  }
+
+  /**
+   * Shrink the capacity with a single re-hashing, to the largest capacity
+   * whose load factor isn't below LOW_THRESHOLD.
+   * If the pairs don't fit the smaller capacity, the capacity stays the same.
+   */
+  void shrink_to_fit ()
+  {
+    std::size_t bucket_count = this->_bucket_count;
+    while (bucket_count > 1 && (double) this->_size
+                               / (bucket_count * CUCKOO_SLOTS) < LOW_THRESHOLD)
+    { bucket_count /= 2; }
+    std::size_t previous = this->_bucket_count;
+    if (bucket_count != previous && !this->re_hashing_to (bucket_count))
+    { this->re_hashing_to (previous); }
+  }
+
+  /**
+   * Remove all the pairs, the capacity stays the same.
+   */
+  void clear ()
+  {
+    for (std::size_t i = 0; i < this->_bucket_count; ++i)
+    {
+      for (int j = 0; j < CUCKOO_SLOTS; ++j)
+      {
+        if (this->_buckets[i].tags[j] != 0)
+        {
+          this->_buckets[i].slot (j)->~pair ();
+          this->_buckets[i].tags[j] = 0;
+        }
+      }
+    }
+    this->_stash.clear ();
+    this->_size = 0;
+  }
+
+  const_iterator begin () const
+  { return this->cbegin (); }
+
+  const_iterator cbegin () const
+  { return const_iterator (*this, 0); }
+
+  const_iterator end () const
+  { return this->cend (); }
+
+  const_iterator cend () const
+  { return const_iterator (*this, this->capacity () + this->_stash.size ()); }
+
+  bool operator== (const CuckooMap<KeyT, ValueT> &rhs) const
+  {
+    if (this->_size != rhs._size)
+    { return false; }
+    for (const auto &pair: rhs)
+    {
+      const std::pair<KeyT, ValueT> *pair_ptr = this->find (pair.first);
+      if (pair_ptr == nullptr || !(pair_ptr->second == pair.second))
+      { return false; }
+    }
+    return true;
+  }
+
+  bool operator!= (const CuckooMap<KeyT, ValueT> &rhs) const
+  { return !this->operator== (rhs); }
+
+ private:
+  /**
+   * CUCKOO_SLOTS tags (0 for an empty slot) followed by the pairs, aligned
+   * to a cache line.
+   */
+  struct alignas (CACHE_LINE) bucket
+  {
+    std::uint8_t tags[CUCKOO_SLOTS];
+    typename std::aligned_storage<sizeof (std::pair<KeyT, ValueT>),
+                                  alignof (std::pair<KeyT, ValueT>)>::type
+        slots[CUCKOO_SLOTS];
+
+    std::pair<KeyT, ValueT> *slot (int i)
+    { return reinterpret_cast<std::pair<KeyT, ValueT> *> (&this->slots[i]); }
+
+    /**
+     * Index of a free slot, or -1.
+     */
+    int free_slot () const
+    {
+      for (std::size_t i = 0; i < CUCKOO_SLOTS; ++i)
+      {
+        if (this->tags[i] == 0)
+        { return i; }
+      }
+      return -1;
+    }
+  };
+
+  bucket *_buckets;
+  void *_memory;
+  std::size_t _bucket_count;
+  std::size_t _size;
+  std::vector<std::pair<KeyT, ValueT>> _stash;
+  std::size_t _seed;
+  std::uint64_t _random;
+
+  /**
+   * Gives access to the seeded hash of HashMap.
+   */
+  struct key_hasher : HashMap<KeyT, ValueT>
+  {
+    using HashMap<KeyT, ValueT>::seeded_hash;
+  };
+
+  /**
+   * Seeded hash of a key, mixed so the bucket index can be taken from the
+   * low bits and the tag from the high bits.
+   */
+  std::size_t hash_of (const KeyT &key) const
+  { return key_hasher::seeded_hash (key, this->_seed); }
+
+  static std::uint8_t tag_of (std::size_t hash)
+  {
+    auto tag = (std::uint8_t) ((std::uint64_t) hash >> 56);
+    return tag == 0 ? 1 : tag;
+  }
+
+  std::size_t index_of (std::size_t hash) const
+  { return hash & (this->_bucket_count - 1); }
+
+  /**
+   * The other bucket of a pair, from one of its buckets and its tag.
+   * Applying it twice gives back the first bucket. The xor term is odd, so
+   * the two buckets differ whenever there are two buckets or more.
+   */
+  std::size_t alternate (std::size_t index, std::uint8_t tag) const
+  {
+    return (index ^ ((std::size_t) ((std::uint32_t) tag * 0x5BD1E995U) | 1))
+           & (this->_bucket_count - 1);
+  }
+
+  /**
+   * Allocate bucket_count empty buckets, aligned to a cache line, and make
+   * them the table. The previous buckets must be released or empty; if the
+   * allocation throws, the table stays as it was.
+   * @param bucket_count Power of 2.
+   */
+  void allocate (std::size_t bucket_count)
+  {
+    void *memory = ::operator new (sizeof (bucket) * bucket_count + CACHE_LINE);
+    auto address = reinterpret_cast<std::uintptr_t> (memory);
+    address = (address + CACHE_LINE - 1) & ~(std::uintptr_t) (CACHE_LINE - 1);
+    auto buckets = reinterpret_cast<bucket *> (address);
+    for (std::size_t i = 0; i < bucket_count; ++i)
+    {
+      for (int j = 0; j < CUCKOO_SLOTS; ++j)
+      { buckets[i].tags[j] = 0; }
+    }
+    void *previous = this->_memory;
+    this->_buckets = buckets;
+    this->_memory = memory;
+    this->_bucket_count = bucket_count;
+    ::operator delete (previous);
+  }
+
+  /**
+   * Free the buckets, they must be empty (or moved from and destroyed).
+   */
+  void release ()
+  {
+    ::operator delete (this->_memory);
+    this->_memory = nullptr;
+    this->_buckets = nullptr;
+  }
+
+  /**
+   * Look the key up in its two buckets, then in the stash.
+   * @return Pointer to the pair, or nullptr.
+   */
+  std::pair<KeyT, ValueT> *find (const KeyT &key) const
+  {
+    std::size_t hash = this->hash_of (key);
+    std::uint8_t tag = tag_of (hash);
+    std::size_t first = this->index_of (hash);
+    bucket &bucket_ref = this->_buckets[first];
+    for (int j = 0; j < CUCKOO_SLOTS; ++j)
+    {
+      if (bucket_ref.tags[j] == tag && bucket_ref.slot (j)->first == key)
+      { return bucket_ref.slot (j); }
+    }
+    bucket &other_ref = this->_buckets[this->alternate (first, tag)];
+    for (int j = 0; j < CUCKOO_SLOTS; ++j)
+    {
+      if (other_ref.tags[j] == tag && other_ref.slot (j)->first == key)
+      { return other_ref.slot (j); }
+    }
+    if (!this->_stash.empty ())
+    {
+      for (const auto &pair: this->_stash)
+      {
+        if (pair.first == key)
+        { return const_cast<std::pair<KeyT, ValueT> *> (&pair); }
+      }
+    }
+    return nullptr;
+  }
+
+  /**
+   * Remove the pair of the given key, without shrinking.
+   * @return True if the key was found and removed.
+   */
+  bool remove (const KeyT &key)
+  {
+    std::size_t hash = this->hash_of (key);
+    std::uint8_t tag = tag_of (hash);
+    std::size_t first = this->index_of (hash);
+    std::size_t buckets[2] = {first, this->alternate (first, tag)};
+    for (std::size_t b: buckets)
+    {
+      for (int j = 0; j < CUCKOO_SLOTS; ++j)
+      {
+        if (this->_buckets[b].tags[j] == tag
+            && this->_buckets[b].slot (j)->first == key)
+        {
+          this->_buckets[b].slot (j)->~pair ();
+          this->_buckets[b].tags[j] = 0;
+          --this->_size;
+          this->unstash ();
+          return true;
+        }
+      }
+    }
+    for (auto it = this->_stash.begin (); it != this->_stash.end (); ++it)
+    {
+      if (it->first == key)
+      {
+        this->_stash.erase (it);
+        --this->_size;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Add a pair whose key is known to be missing, growing if needed.
+   * If the pairs don't fit twice the capacity under any seed, the pair isn't
+   * added and std::length_error is thrown.
+   */
+  void add_missing (const KeyT &key, const ValueT &value)
+  {
+    if ((double) (this->_size + 1) / this->capacity () > CUCKOO_MAX_LOAD
+        && !this->re_hashing_to (this->_bucket_count * 2))
+    { throw std::length_error ("Too many keys with equal hashes."); }
+    // The kicked out pair may have to go to the stash, make room first.
+    this->_stash.reserve (this->_stash.size () + 1);
+    std::pair<KeyT, ValueT> pair (key, value);
+    if (this->place (pair))
+    {
+      ++this->_size;
+      return;
+    }
+    // The last kicked pair is now in pair.
+    this->_stash.push_back (std::move (pair));
+    ++this->_size;
+    if ((int) this->_stash.size () > CUCKOO_STASH_SIZE
+        && !this->re_hashing_to (this->_bucket_count * 2))
+    {
+      this->remove (key);
+      throw std::length_error ("Too many keys with equal hashes.");
+    }
+  }
+
+  /**
+   * Place a pair in one of its buckets, kicking other pairs to their other
+   * bucket if both are full.
+   * @param pair Pair to place. If placing fails, holds the last kicked pair.
+   * @return True if every pair found a slot.
+   */
+  bool place (std::pair<KeyT, ValueT> &pair)
+  {
+    std::size_t hash = this->hash_of (pair.first);
+    std::uint8_t tag = tag_of (hash);
+    std::size_t index = this->index_of (hash);
+    std::size_t indexes[2] = {index, this->alternate (index, tag)};
+    for (std::size_t b: indexes)
+    {
+      int free_slot = this->_buckets[b].free_slot ();
+      if (free_slot != -1)
+      {
+        this->fill (b, free_slot, tag, pair);
+        return true;
+      }
+    }
+
+    index = indexes[this->next_random () & 1];
+    for (int kick = 0; kick < CUCKOO_MAX_KICKS; ++kick)
+    {
+      bucket &bucket_ref = this->_buckets[index];
+      int victim = (int) (this->next_random () % CUCKOO_SLOTS);
+      std::swap (pair, *bucket_ref.slot (victim));
+      std::swap (tag, bucket_ref.tags[victim]);
+      index = this->alternate (index, tag);
+      int free_slot = this->_buckets[index].free_slot ();
+      if (free_slot != -1)
+      {
+        this->fill (index, free_slot, tag, pair);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void fill (std::size_t index, int slot, std::uint8_t tag,
+             std::pair<KeyT, ValueT> &pair)
+  {
+    new (this->_buckets[index].slot (slot))
+        std::pair<KeyT, ValueT> (std::move (pair));
+    this->_buckets[index].tags[slot] = tag;
+  }
+
+  /**
+   * Move the stashed pairs back to the table, if a slot got free for them.
+   */
+  void unstash ()
+  {
+    for (auto it = this->_stash.begin (); it != this->_stash.end ();)
+    {
+      std::size_t hash = this->hash_of (it->first);
+      std::uint8_t tag = tag_of (hash);
+      std::size_t index = this->index_of (hash);
+      std::size_t indexes[2] = {index, this->alternate (index, tag)};
+      bool moved = false;
+      for (std::size_t b: indexes)
+      {
+        int free_slot = this->_buckets[b].free_slot ();
+        if (!moved && free_slot != -1)
+        {
+          this->fill (b, free_slot, tag, *it);
+          moved = true;
+        }
+      }
+      it = moved ? this->_stash.erase (it) : it + 1;
+    }
+  }
+
+  /**
+   * Move every pair of the buckets to the stash.
+   * The stash must have room for them, so this doesn't throw.
+   */
+  void stash_all ()
+  {
+    for (std::size_t i = 0; i < this->_bucket_count; ++i)
+    {
+      for (int j = 0; j < CUCKOO_SLOTS; ++j)
+      {
+        if (this->_buckets[i].tags[j] != 0)
+        {
+          this->_stash.push_back (std::move (*this->_buckets[i].slot (j)));
+          this->_buckets[i].slot (j)->~pair ();
+          this->_buckets[i].tags[j] = 0;
+        }
+      }
+    }
+  }
+
+  /**
+   * Change the number of buckets, and place every pair again.
+   * The pairs wait in the stash, so the map stays valid if the allocation
+   * throws. If they don't fit, a new seed is drawn, up to CUCKOO_MAX_RESEEDS
+   * times; after that the pairs left over stay in the stash, still found
+   * but with slower lookups.
+   * @param bucket_count Power of 2.
+   * @return False if the pairs didn't fit.
+   */
+  bool re_hashing_to (std::size_t bucket_count)
+  {
+    this->_stash.reserve (this->_size);
+    this->stash_all ();
+    this->allocate (bucket_count);
+    for (int reseeds = 0;; ++reseeds)
+    {
+      std::size_t kept = 0;
+      for (std::size_t i = 0; i < this->_stash.size (); ++i)
+      {
+        std::pair<KeyT, ValueT> pair = std::move (this->_stash[i]);
+        if (!this->place (pair))
+        { this->_stash[kept++] = std::move (pair); }
+      }
+      this->_stash.erase (this->_stash.begin () + kept, this->_stash.end ());
+      if (kept <= CUCKOO_STASH_SIZE)
+      {
+        this->_stash.shrink_to_fit ();
+        return true;
+      }
+      if (reseeds == CUCKOO_MAX_RESEEDS)
+      { return false; }
+      this->stash_all ();
+      this->_seed = HashMap<KeyT, ValueT>::random_seed ();
+    }
+  }
+
+  /**
+   * xorshift64, picks the bucket and the slot to kick.
+   */
+  std::uint64_t next_random ()
+  {
+    this->_random ^= this->_random << 13;
+    this->_random ^= this->_random >> 7;
+    this->_random ^= this->_random << 17;
+    return this->_random;
+  }
+
+  /**
+   * Walks the slots of all the buckets, then the stash.
+   */
+  class iterator_t
+  {
+   private:
+    const CuckooMap<KeyT, ValueT> *_map_container;
+    std::size_t _position;
+
+    bool is_valid () const
+    {
+      std::size_t slots = this->_map_container->capacity ();
+      if (this->_position >= slots)
+      { return true; }
+      return this->_map_container->_buckets[this->_position / CUCKOO_SLOTS]
+                 .tags[this->_position % CUCKOO_SLOTS] != 0;
+    }
+
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef const std::pair<KeyT, ValueT> value_type;
+    typedef value_type &reference;
+    typedef value_type *pointer;
+    typedef std::ptrdiff_t difference_type;
+
+    iterator_t (const CuckooMap<KeyT, ValueT> &map_container,
+                std::size_t position)
+        : _map_container (&map_container), _position (position)
+    {
+      while (!this->is_valid ())
+      { ++this->_position; }
+    }
+
+    reference operator* () const
+    {
+      std::size_t slots = this->_map_container->capacity ();
+      if (this->_position >= slots)
+      { return this->_map_container->_stash[this->_position - slots]; }
+      return *this->_map_container->_buckets[this->_position / CUCKOO_SLOTS]
+          .slot (this->_position % CUCKOO_SLOTS);
+    }
+
+    pointer operator-> () const
+    { return &(this->operator* ()); }
+
+    iterator_t &operator++ ()
+    {
+      do
+      { ++this->_position; }
+      while (!this->is_valid ());
+      return *this;
+    }
+
+    iterator_t operator++ (int)
+    {
+      iterator_t it (*this);
+      this->operator++ ();
+      return it;
+    }
+
+    bool operator== (const iterator_t &rhs) const
+    {
+      return this->_map_container == rhs._map_container
+             && this->_position == rhs._position;
+    }
+
+    bool operator!= (const iterator_t &rhs) const
+    { return !this->operator== (rhs); }
+  };
+};
+
+#endif //_CUCKOOMAP_HPP_
@@ -17,22 +17,49 @@ class InvalidKey : public std::invalid_argument
 class Dictionary : public HashMap<std::string, std::string>
 {
  public:
-  using HashMap<std::string, std::string>::HashMap;
+  using HashMap<std::string, std::string>::erase;
+
+  /**
+   * Dictionary keys usually come from outside, so every instance hashes with
+   * its own random seed, see HashMap::reseed.
+   */
+  Dictionary ()
+  { this->reseed (random_seed ()); }
+
+  Dictionary (const std::vector<std::string> &keys_vector,
+              const std::vector<std::string> &values_vector)
+  : Dictionary ()
+  { this->insert_vectors (keys_vector, values_vector); }
+
+  /**
+   * Remove the pair of the given key, throw InvalidKey if it doesn't exist.
+   * @param key String.
+   * @return True if removed.
+   */
   bool erase (const std::string &key) override
   {
-    if (!HashMap<std::string, std::string>::contains_key (key))
+    if (!this->try_erase (key))
     { throw InvalidKey ("Key doesn't exists."); }
-    return HashMap<std::string, std::string>::erase (key);
+    return true;
   }
 
+  /**
+   * Remove the pair of the given key, with a single lookup and no
+   * exception on a miss.
+   * @param key String.
+   * @return True if the key was found and removed.
+   */
+  bool try_erase (const std::string &key)
+  { return HashMap<std::string, std::string>::erase (key); }
+
+  /**
+   * Insert or overwrite every pair of the given range.
+   * Reserves once and looks every key up a single time, see HashMap::merge.
+   * @param begin Iterator to the first pair.
+   * @param end Iterator past the last pair.
+   */
   template<typename V>
   void update (const V &begin, const V &end)
-  {
-    if (begin != end)
-    {
-      for (V it = begin; it != end; ++it)
-      { this->operator[] (it->first) = it->second; }
-    }
-  }
+  { this->merge (begin, end, OVERWRITE); }
 };
 #endif //_DICTIONARY_HPP_
@@ -0,0 +1,484 @@
+#include "PersistentHashMap.hpp"
+#include "Serialization.hpp"
+#include <cstdio>
+#include <exception>
+#include <thread>
+
+#ifndef _DURABLEDICTIONARY_HPP_
+#define _DURABLEDICTIONARY_HPP_
+#define WAL_GROUP_COMMIT 64
+#define WAL_PUT 1
+#define WAL_ERASE 2
+#define SNAPSHOT_MAGIC 0x50414E53u
+#define SNAPSHOT_CHUNK (1 << 20)
+
+/**
+ * Dictionary backed by an append-only write-ahead log.
+ * Every insert, assignment and erase is appended to the log of the current
+ * generation (log.<generation> inside the directory) as a single record
+ * with its own CRC. Records are buffered and written with one write and
+ * one fdatasync per WAL_GROUP_COMMIT records (group commit), or on sync ();
+ * a crash loses at most the records since the last sync.
+ * The pairs live in a PersistentDictionary, so compact () hands an O(1)
+ * snapshot of it to a background thread, which writes it to a snapshot
+ * file and drops the logs it covers, while new writes go to a fresh log
+ * generation.
+ * Opening the directory recovers the dictionary: the snapshot is read with
+ * a single read, and the logs are replayed up to their first torn or
+ * corrupted record.
+ */
+class DurableDictionary
+{
+ public:
+  /**
+   * A value of the dictionary, as returned by operator[].
+   * Assigning to it is logged like insert_or_assign, a single record.
+   * Reading it inserts (and logs) an empty value if the key doesn't exist.
+   */
+  class value_ref
+  {
+    friend class DurableDictionary;
+   private:
+    DurableDictionary *_dictionary;
+    std::string _key;
+
+    value_ref (DurableDictionary *dictionary, const std::string &key)
+        : _dictionary (dictionary), _key (key)
+    {}
+
+   public:
+    value_ref &operator= (const std::string &value)
+    {
+      this->_dictionary->insert_or_assign (this->_key, value);
+      return *this;
+    }
+
+    operator const std::string & () const
+    {
+      this->_dictionary->insert (this->_key, std::string ());
+      return this->_dictionary->at (this->_key);
+    }
+  };
+
+  /**
+   * Open the dictionary stored in the given directory, creating the
+   * directory if it doesn't exist.
+   * @param directory Path of the directory.
+   * @param group_commit Number of records per fdatasync, 1 syncs every
+   * write.
+   */
+  explicit DurableDictionary (const std::string &directory,
+                              int group_commit = WAL_GROUP_COMMIT)
+      : _directory (directory), _group_commit (group_commit), _log_fd (-1),
+        _generation (1), _snapshot_generation (1), _pending_records (0)
+  {
+    if (group_commit < 1)
+    { throw std::invalid_argument ("Group commit must be positive."); }
+    if (::mkdir (directory.c_str (), 0755) != 0 && errno != EEXIST)
+    { throw_errno ("mkdir " + directory); }
+    this->recover ();
+  }
+
+  DurableDictionary (const DurableDictionary &) = delete;
+
+  DurableDictionary &operator= (const DurableDictionary &) = delete;
+
+  /**
+   * Close the dictionary if close () wasn't called. Errors of the last sync
+   * and of a running compaction can't be reported here, call close () first
+   * to see them.
+   */
+  ~DurableDictionary ()
+  {
+    try
+    { this->close (); }
+    catch (...)
+    {}
+  }
+
+  /**
+   * Size of elements inside the dictionary.
+   * @return Size_t value.
+   */
+  std::size_t size () const
+  { return this->_map.size (); }
+
+  /**
+   * Check if the dictionary is empty.
+   * @return True if empty, false otherwise.
+   */
+  bool empty () const
+  { return this->_map.empty (); }
+
+  /**
+   * Check if the key exists in the dictionary.
+   * @param key String.
+   * @return True if exist, false otherwise.
+   */
+  bool contains_key (const std::string &key) const
+  { return this->_map.contains_key (key); }
+
+  /**
+   * Value of the key, throw exception if the key doesn't exist.
+   * @param key String.
+   * @return Value of the key.
+   */
+  const std::string &at (const std::string &key) const
+  { return this->_map.at (key); }
+
+  /**
+   * The dictionary in memory, for reading and iterating.
+   * Take a snapshot () of it to read it while writing.
+   * @return Const reference to the dictionary.
+   */
+  const PersistentDictionary &dictionary () const
+  { return this->_map; }
+
+  PersistentDictionary::const_iterator begin () const
+  { return this->_map.begin (); }
+
+  PersistentDictionary::const_iterator end () const
+  { return this->_map.end (); }
+
+  /**
+   * Insert key and value, if the key doesn't exist in the dictionary.
+   * @param key String.
+   * @param value String.
+   * @return True if the pair was inserted, false otherwise.
+   */
+  bool insert (const std::string &key, const std::string &value)
+  {
+    this->check_open ();
+    if (!this->_map.insert (key, value))
+    { return false; }
+    this->log (WAL_PUT, key, &value);
+    return true;
+  }
+
+  /**
+   * Insert key and value, or overwrite the value of the key.
+   * @param key String.
+   * @param value String.
+   * @return True if the pair was inserted, false if it was assigned.
+   */
+  bool insert_or_assign (const std::string &key, const std::string &value)
+  {
+    this->check_open ();
+    bool inserted = this->_map.insert_or_assign (key, value);
+    this->log (WAL_PUT, key, &value);
+    return inserted;
+  }
+
+  /**
+   * Value of the key, to read or assign. Nothing is inserted or logged
+   * until the value_ref is used, so an assignment logs one record.
+   * @param key String.
+   * @return value_ref to read or assign the value.
+   */
+  value_ref operator[] (const std::string &key)
+  { return value_ref (this, key); }
+
+  /**
+   * Remove the key, throw InvalidKey if it doesn't exist.
+   * @param key String.
+   * @return True if removed.
+   */
+  bool erase (const std::string &key)
+  {
+    this->check_open ();
+    this->_map.erase (key);
+    this->log (WAL_ERASE, key, nullptr);
+    return true;
+  }
+
+  /**
+   * Write the buffered records to the log and wait for the disk.
+   */
+  void sync ()
+  {
+    if (this->_pending.empty ())
+    { return; }
+    write_all (this->_log_fd, this->_pending.data (), this->_pending.size ());
+    if (::fdatasync (this->_log_fd) != 0)
+    { throw_errno ("fdatasync"); }
+    this->_pending.clear ();
+    this->_pending_records = 0;
+  }
+
+  /**
+   * Sync the log, wait for a running compaction and close the log.
+   * The dictionary can't be written after that.
+   * Throws the first error of the sync or the compaction, the log is closed
+   * either way.
+   */
+  void close ()
+  {
+    if (this->_log_fd < 0)
+    { return; }
+    std::exception_ptr error;
+    try
+    { this->sync (); }
+    catch (...)
+    { error = std::current_exception (); }
+    try
+    { this->wait_compaction (); }
+    catch (...)
+    {
+      if (!error)
+      { error = std::current_exception (); }
+    }
+    ::close (this->_log_fd);
+    this->_log_fd = -1;
+    if (error)
+    { std::rethrow_exception (error); }
+  }
+
+  /**
+   * Start writing a snapshot of the dictionary on a background thread.
+   * The dictionary is snapshotted in O(1), writes can go on right away,
+   * into a new log generation; they copy the trie nodes they share with
+   * the snapshot. The logs covered by the snapshot are removed once it is
+   * safely renamed in place.
+   * A compaction still running is waited for first.
+   */
+  void compact ()
+  {
+    this->check_open ();
+    this->wait_compaction ();
+    this->sync ();
+    std::uint64_t generation = this->_generation + 1;
+    int fd = this->open_log (generation);
+    ::close (this->_log_fd);
+    this->_log_fd = fd;
+    this->_generation = generation;
+
+    // Owned here and dropped after the join, so the trie nodes are only
+    // released by the writing thread
+    this->_compacted = this->_map.snapshot ();
+    std::uint64_t first = this->_snapshot_generation;
+    this->_snapshot_generation = generation;
+    this->_compaction = std::thread ([this, first, generation] ()
+    {
+      try
+      {
+        write_snapshot (this->_directory, this->_compacted, generation);
+        for (std::uint64_t i = first; i < generation; ++i)
+        { ::unlink (log_path (this->_directory, i).c_str ()); }
+      }
+      catch (...)
+      { this->_compaction_error = std::current_exception (); }
+    });
+  }
+
+  /**
+   * Wait for the running compaction, rethrowing its error if it failed.
+   */
+  void wait_compaction ()
+  {
+    if (this->_compaction.joinable ())
+    { this->_compaction.join (); }
+    this->_compacted.clear ();
+    if (this->_compaction_error)
+    {
+      std::exception_ptr error = this->_compaction_error;
+      this->_compaction_error = nullptr;
+      std::rethrow_exception (error);
+    }
+  }
+
+ private:
+  std::string _directory;
+  int _group_commit;
+  PersistentDictionary _map;
+  PersistentDictionary _compacted;
+  int _log_fd;
+  std::uint64_t _generation;
+  std::uint64_t _snapshot_generation;
+  std::string _pending;
+  int _pending_records;
+  std::thread _compaction;
+  std::exception_ptr _compaction_error;
+
+  static std::string log_path (const std::string &directory,
+                               std::uint64_t generation)
+  { return directory + "/log." + std::to_string (generation); }
+
+  static std::string snapshot_path (const std::string &directory)
+  { return directory + "/snapshot"; }
+
+  void check_open () const
+  {
+    if (this->_log_fd < 0)
+    { throw std::logic_error ("Durable dictionary is closed."); }
+  }
+
+  int open_log (std::uint64_t generation) const
+  {
+    std::string path = log_path (this->_directory, generation);
+    int fd = ::open (path.c_str (), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                     0644);
+    if (fd < 0)
+    { throw_errno ("open " + path); }
+    sync_directory (this->_directory);
+    return fd;
+  }
+
+  /**
+   * Buffer a record: op, key, value (for WAL_PUT) and the CRC of all three.
+   */
+  void log (unsigned char op, const std::string &key, const std::string *value)
+  {
+    std::size_t start = this->_pending.size ();
+    put_value (this->_pending, op);
+    put_value (this->_pending, key);
+    if (value != nullptr)
+    { put_value (this->_pending, *value); }
+    put_value (this->_pending, crc32 (this->_pending.data () + start,
+                                      this->_pending.size () - start));
+    if (++this->_pending_records >= this->_group_commit)
+    { this->sync (); }
+  }
+
+  /**
+   * End of the record starting at pos, or nullptr if it is torn or
+   * corrupted.
+   */
+  static const char *record_end (const char *pos, const char *end,
+                                 unsigned char &op)
+  {
+    const char *start = pos;
+    std::uint32_t length, crc;
+    if (!get_value (pos, end, op) || (op != WAL_PUT && op != WAL_ERASE))
+    { return nullptr; }
+    for (int field = op == WAL_PUT ? 2 : 1; field > 0; --field)
+    {
+      if (!get_value (pos, end, length) || (std::size_t) (end - pos) < length)
+      { return nullptr; }
+      pos += length;
+    }
+    std::size_t size = (std::size_t) (pos - start);
+    if (!get_value (pos, end, crc) || crc != crc32 (start, size))
+    { return nullptr; }
+    return pos;
+  }
+
+  static void write_snapshot (const std::string &directory,
+                              const PersistentDictionary &map,
+                              std::uint64_t generation)
+  {
+    std::string path = snapshot_path (directory);
+    std::string temp_path = path + ".tmp";
+    int fd = ::open (temp_path.c_str (),
+                     O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    { throw_errno ("open " + temp_path); }
+    try
+    {
+      std::string buffer;
+      std::uint32_t crc = 0;
+      put_value (buffer, SNAPSHOT_MAGIC);
+      put_value (buffer, generation);
+      put_value (buffer, (std::uint64_t) map.size ());
+      for (const auto &pair: map)
+      {
+        put_value (buffer, pair.first);
+        put_value (buffer, pair.second);
+        if (buffer.size () >= SNAPSHOT_CHUNK)
+        {
+          crc = crc32 (buffer.data (), buffer.size (), crc);
+          write_all (fd, buffer.data (), buffer.size ());
+          buffer.clear ();
+        }
+      }
+      crc = crc32 (buffer.data (), buffer.size (), crc);
+      put_value (buffer, crc);
+      write_all (fd, buffer.data (), buffer.size ());
+      if (::fsync (fd) != 0)
+      { throw_errno ("fsync " + temp_path); }
+    }
+    catch (...)
+    {
+      ::close (fd);
+      ::unlink (temp_path.c_str ());
+      throw;
+    }
+    ::close (fd);
+    if (std::rename (temp_path.c_str (), path.c_str ()) != 0)
+    { throw_errno ("rename " + temp_path); }
+    sync_directory (directory);
+  }
+
+  /**
+   * Load the snapshot, replay the logs after it, and open a new log
+   * generation, so a torn record is never followed by new ones.
+   */
+  void recover ()
+  {
+    std::string buffer;
+    if (read_file (snapshot_path (this->_directory), buffer))
+    { this->load_snapshot (buffer); }
+    // Logs left behind by a compaction interrupted after its rename
+    for (std::uint64_t i = this->_generation - 1; i > 0; --i)
+    {
+      if (::unlink (log_path (this->_directory, i).c_str ()) != 0)
+      { break; }
+    }
+    while (read_file (log_path (this->_directory, this->_generation), buffer))
+    {
+      this->replay (buffer);
+      ++this->_generation;
+    }
+    this->_log_fd = this->open_log (this->_generation);
+  }
+
+  void load_snapshot (const std::string &buffer)
+  {
+    const char *pos = buffer.data ();
+    const char *end = pos + buffer.size ();
+    std::uint32_t magic, crc;
+    std::uint64_t count;
+    if (buffer.size () < sizeof (crc)
+        || !get_value (pos, end, magic) || magic != SNAPSHOT_MAGIC
+        || !get_value (pos, end, this->_generation)
+        || !get_value (pos, end, count))
+    { throw std::runtime_error ("Corrupted snapshot."); }
+    end -= sizeof (crc);
+    std::memcpy (&crc, end, sizeof (crc));
+    if (crc != crc32 (buffer.data (), buffer.size () - sizeof (crc)))
+    { throw std::runtime_error ("Corrupted snapshot."); }
+    this->_snapshot_generation = this->_generation;
+    std::string key, value;
+    for (std::uint64_t i = 0; i < count; ++i)
+    {
+      if (!get_value (pos, end, key) || !get_value (pos, end, value))
+      { throw std::runtime_error ("Corrupted snapshot."); }
+      this->_map.insert_or_assign (key, value);
+    }
+  }
+
+  /**
+   * Apply the records of a log, up to its first torn or corrupted record.
+   */
+  void replay (const std::string &buffer)
+  {
+    const char *pos = buffer.data ();
+    const char *end = pos + buffer.size ();
+    const char *next;
+    unsigned char op = 0;
+    std::string key, value;
+    while ((next = record_end (pos, end, op)) != nullptr)
+    {
+      // The record already passed record_end
+      if (!get_value (pos, next, op) || !get_value (pos, next, key)
+          || (op == WAL_PUT && !get_value (pos, next, value)))
+      { throw std::runtime_error ("Corrupted log record."); }
+      if (op == WAL_PUT)
+      { this->_map.insert_or_assign (key, value); }
+      else if (this->_map.contains_key (key))
+      { this->_map.erase (key); }
+      pos = next;
+    }
+  }
+};
+
+#endif //_DURABLEDICTIONARY_HPP_
@@ -0,0 +1,417 @@
+#include "Dictionary.hpp"
+#include <chrono>
+
+#ifndef _EXPIRINGMAP_HPP_
+#define _EXPIRINGMAP_HPP_
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 6
+#define NO_DEADLINE 0
+
+/**
+ * Value of an ExpiringMap, with its deadline and its links in the timer
+ * wheel.
+ */
+template<typename KeyT, typename ValueT>
+struct ttl_entry
+{
+  ValueT value;
+  std::uint64_t deadline;
+  std::pair<KeyT, ttl_entry> *prev;
+  std::pair<KeyT, ttl_entry> *next;
+  int level;
+  int slot;
+};
+
+/**
+ * HashMap variant whose entries may expire.
+ * Time is counted in ticks of one millisecond of Clock. Entries with a TTL
+ * are linked into a hierarchical timer wheel: WHEEL_LEVELS levels of
+ * WHEEL_SLOTS slots, a slot of level L covering WHEEL_SLOTS^L ticks. An
+ * entry sits in the lowest level its deadline fits in, and moves down a
+ * level each time the wheel reaches its slot, until it expires from level
+ * 0. Deadlines past the last level wait in its farthest slot.
+ * The wheel jumps straight to its next non empty slot (found through an
+ * occupancy bitmap per level), so expiring costs O(expired entries), not
+ * O(elapsed ticks).
+ * Every write expires what is due first, and expire () can be called
+ * explicitly. Lookups never return an entry past its deadline, even if it
+ * wasn't removed yet; size () counts such entries until the next write.
+ */
+template<typename KeyT, typename ValueT,
+    typename Clock = std::chrono::steady_clock>
+class ExpiringMap : private HashMap<KeyT, ttl_entry<KeyT, ValueT>>
+{
+  typedef ttl_entry<KeyT, ValueT> entry;
+  typedef HashMap<KeyT, entry> map_type;
+  typedef std::pair<KeyT, entry> node;
+
+ public:
+  ExpiringMap () : _tick (ticks (Clock::now ())), _scheduled (0)
+  { this->reset_wheel (); }
+
+  ExpiringMap (const ExpiringMap<KeyT, ValueT, Clock> &) = delete;
+
+  ExpiringMap<KeyT, ValueT, Clock> &
+  operator= (const ExpiringMap<KeyT, ValueT, Clock> &) = delete;
+
+  virtual ~ExpiringMap () = default;
+
+  using map_type::size;
+  using map_type::empty;
+  using map_type::reseed;
+  using map_type::random_seed;
+
+  /**
+   * Number of entries with a TTL.
+   * @return Size_t value.
+   */
+  std::size_t scheduled () const
+  { return this->_scheduled; }
+
+  /**
+   * Insert key and value without a TTL, if the key doesn't exist.
+   * @param key Generic type variable.
+   * @param value Generic type variable.
+   * @return True if the pair was inserted, false otherwise.
+   */
+  bool insert (const KeyT &key, const ValueT &value)
+  {
+    this->expire ();
+    return this->insert_with_deadline (key, value, NO_DEADLINE);
+  }
+
+  /**
+   * Insert key and value expiring after ttl, if the key doesn't exist.
+   * @param key Generic type variable.
+   * @param value Generic type variable.
+   * @param ttl Time to live, at least a tick.
+   * @return True if the pair was inserted, false otherwise.
+   */
+  bool insert_with_ttl (const KeyT &key, const ValueT &value,
+                        std::chrono::milliseconds ttl)
+  {
+    if (ttl.count () <= 0)
+    { throw std::invalid_argument ("TTL must be positive."); }
+    this->expire ();
+    return this->insert_with_deadline (key, value,
+                                       this->_tick + (std::uint64_t) ttl.count ());
+  }
+
+  /**
+   * Insert key and value without a TTL, or overwrite the value of the key,
+   * keeping its TTL.
+   * @param key Generic type variable.
+   * @param value Generic type variable.
+   * @return True if the pair was inserted, false if it was assigned.
+   */
+  bool insert_or_assign (const KeyT &key, const ValueT &value)
+  {
+    this->expire ();
+    node *node_ptr = this->lookup (key);
+    if (node_ptr != nullptr)
+    {
+      node_ptr->second.value = value;
+      return false;
+    }
+    return this->insert_with_deadline (key, value, NO_DEADLINE);
+  }
+
+  /**
+   * Make an existing key expire after ttl (from now), replacing its TTL.
+   * @param key Generic type variable.
+   * @param ttl Time to live, at least a tick.
+   * @return True if the key exists, false otherwise.
+   */
+  bool expire_after (const KeyT &key, std::chrono::milliseconds ttl)
+  {
+    if (ttl.count () <= 0)
+    { throw std::invalid_argument ("TTL must be positive."); }
+    this->expire ();
+    node *node_ptr = this->lookup (key);
+    if (node_ptr == nullptr)
+    { return false; }
+    if (node_ptr->second.deadline != NO_DEADLINE)
+    { this->unschedule (node_ptr); }
+    node_ptr->second.deadline = this->_tick + (std::uint64_t) ttl.count ();
+    this->schedule (node_ptr);
+    return true;
+  }
+
+  /**
+   * Check if the key exists in the map and is not expired.
+   * @param key Generic type variable.
+   * @return True if exist, false otherwise.
+   */
+  bool contains_key (const KeyT &key) const
+  { return this->live_lookup (key) != nullptr; }
+
+  /**
+   * Value of the key, throw exception if the key doesn't exist or expired.
+   * @param key Generic type variable.
+   * @return Value of the key.
+   */
+  const ValueT &at (const KeyT &key) const
+  {
+    const node *node_ptr = this->live_lookup (key);
+    if (node_ptr == nullptr)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return node_ptr->second.value;
+  }
+
+  /**
+   * Value of the key, throw exception if the key doesn't exist or expired.
+   * @param key Generic type variable.
+   * @return Reference to the value of the key.
+   */
+  ValueT &at (const KeyT &key)
+  {
+    this->expire ();
+    node *node_ptr = this->lookup (key);
+    if (node_ptr == nullptr)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return node_ptr->second.value;
+  }
+
+  /**
+   * Remove the key and its value from the map.
+   * @param key Generic type variable.
+   * @return True if removed, false otherwise.
+   */
+  virtual bool erase (const KeyT &key)
+  {
+    this->expire ();
+    node *node_ptr = this->lookup (key);
+    if (node_ptr == nullptr)
+    { return false; }
+    if (node_ptr->second.deadline != NO_DEADLINE)
+    { this->unschedule (node_ptr); }
+    this->remove (key);
+    this->shrink_to_fit ();
+    return true;
+  }
+
+  /**
+   * Remove all the elements of the map.
+   */
+  void clear ()
+  {
+    map_type::clear ();
+    this->reset_wheel ();
+  }
+
+  /**
+   * Remove the entries whose deadline is due by the current time of Clock.
+   * @return Number of removed entries.
+   */
+  std::size_t expire ()
+  { return this->expire (Clock::now ()); }
+
+  /**
+   * Remove the entries whose deadline is due by the given time.
+   * Runs in O(expired entries), plus the entries moved down a level.
+   * @param now Time point of Clock.
+   * @return Number of removed entries.
+   */
+  std::size_t expire (typename Clock::time_point now)
+  {
+    std::uint64_t target = ticks (now);
+    std::size_t expired = 0;
+    while (this->_scheduled > 0)
+    {
+      std::uint64_t next = this->next_event ();
+      if (next > target)
+      { break; }
+      this->_tick = next;
+      for (int level = WHEEL_LEVELS - 1; level > 0; --level)
+      {
+        if ((next & ((1ULL << (WHEEL_BITS * level)) - 1)) == 0)
+        {
+          this->cascade (level,
+                         (int) (next >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+        }
+      }
+      expired += this->expire_slot ((int) next & (WHEEL_SLOTS - 1));
+    }
+    if (target > this->_tick)
+    { this->_tick = target; }
+    if (expired > 0)
+    { this->shrink_to_fit (); }
+    return expired;
+  }
+
+ private:
+  std::uint64_t _tick;
+  std::size_t _scheduled;
+  node *_wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+  std::uint64_t _occupied[WHEEL_LEVELS];
+
+  static std::uint64_t ticks (typename Clock::time_point time)
+  {
+    return (std::uint64_t) std::chrono::duration_cast<std::chrono::milliseconds> (
+        time.time_since_epoch ()).count ();
+  }
+
+  void reset_wheel ()
+  {
+    for (int level = 0; level < WHEEL_LEVELS; ++level)
+    {
+      this->_occupied[level] = 0;
+      for (int slot = 0; slot < WHEEL_SLOTS; ++slot)
+      { this->_wheel[level][slot] = nullptr; }
+    }
+    this->_scheduled = 0;
+  }
+
+  node *lookup (const KeyT &key) const
+  {
+    return this->find_in_bucket (
+        key, &this->_bucket_list[this->hash_key (key) & (this->_capacity - 1)]);
+  }
+
+  const node *live_lookup (const KeyT &key) const
+  {
+    const node *node_ptr = this->lookup (key);
+    if (node_ptr == nullptr || node_ptr->second.deadline == NO_DEADLINE
+        || node_ptr->second.deadline > ticks (Clock::now ()))
+    { return node_ptr; }
+    return nullptr;
+  }
+
+  bool insert_with_deadline (const KeyT &key, const ValueT &value,
+                             std::uint64_t deadline)
+  {
+    std::size_t hash = this->hash_key (key);
+    if (this->find_in_bucket (
+        key, &this->_bucket_list[hash & (this->_capacity - 1)]) != nullptr)
+    { return false; }
+    node *node_ptr = this->add_missing (
+        hash, key, entry {value, deadline, nullptr, nullptr, 0, 0});
+    if (deadline != NO_DEADLINE)
+    { this->schedule (node_ptr); }
+    return true;
+  }
+
+  /**
+   * Link the node into the slot of its deadline, relative to the current
+   * tick. The level is the lowest one whose span covers the deadline.
+   */
+  void schedule (node *node_ptr)
+  {
+    std::uint64_t deadline = node_ptr->second.deadline;
+    std::uint64_t delta = deadline - this->_tick;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1
+           && delta >= (1ULL << (WHEEL_BITS * (level + 1))))
+    { ++level; }
+    if (delta >= (1ULL << (WHEEL_BITS * WHEEL_LEVELS)))
+    { deadline = this->_tick + (1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1; }
+    int slot = (int) (deadline >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+
+    node *&head = this->_wheel[level][slot];
+    node_ptr->second.level = level;
+    node_ptr->second.slot = slot;
+    node_ptr->second.prev = nullptr;
+    node_ptr->second.next = head;
+    if (head != nullptr)
+    { head->second.prev = node_ptr; }
+    head = node_ptr;
+    this->_occupied[level] |= 1ULL << slot;
+    ++this->_scheduled;
+  }
+
+  void unschedule (node *node_ptr)
+  {
+    entry &cur = node_ptr->second;
+    if (cur.prev != nullptr)
+    { cur.prev->second.next = cur.next; }
+    else
+    { this->_wheel[cur.level][cur.slot] = cur.next; }
+    if (cur.next != nullptr)
+    { cur.next->second.prev = cur.prev; }
+    if (this->_wheel[cur.level][cur.slot] == nullptr)
+    { this->_occupied[cur.level] &= ~(1ULL << cur.slot); }
+    --this->_scheduled;
+  }
+
+  /**
+   * The first tick after the current one at which a non empty slot is
+   * reached, on any level.
+   */
+  std::uint64_t next_event () const
+  {
+    std::uint64_t next = ~0ULL;
+    for (int level = 0; level < WHEEL_LEVELS; ++level)
+    {
+      std::uint64_t mask = this->_occupied[level];
+      if (mask == 0)
+      { continue; }
+      int shift = WHEEL_BITS * level;
+      std::uint64_t unit = (this->_tick >> shift) + 1;
+      int rotation = (int) unit & (WHEEL_SLOTS - 1);
+      if (rotation != 0)
+      { mask = (mask >> rotation) | (mask << (WHEEL_SLOTS - rotation)); }
+      std::uint64_t candidate = (unit + __builtin_ctzll (mask)) << shift;
+      if (candidate < next)
+      { next = candidate; }
+    }
+    return next;
+  }
+
+  /**
+   * Move the nodes of a slot down to the levels matching their deadline,
+   * now that the wheel reached the slot.
+   */
+  void cascade (int level, int slot)
+  {
+    node *node_ptr = this->_wheel[level][slot];
+    this->_wheel[level][slot] = nullptr;
+    this->_occupied[level] &= ~(1ULL << slot);
+    while (node_ptr != nullptr)
+    {
+      node *next = node_ptr->second.next;
+      --this->_scheduled;
+      this->schedule (node_ptr);
+      node_ptr = next;
+    }
+  }
+
+  std::size_t expire_slot (int slot)
+  {
+    node *node_ptr = this->_wheel[0][slot];
+    this->_wheel[0][slot] = nullptr;
+    this->_occupied[0] &= ~(1ULL << slot);
+    std::size_t expired = 0;
+    while (node_ptr != nullptr)
+    {
+      node *next = node_ptr->second.next;
+      --this->_scheduled;
+      this->remove (node_ptr->first);
+      ++expired;
+      node_ptr = next;
+    }
+    return expired;
+  }
+};
+
+/**
+ * Dictionary whose entries may expire, see ExpiringMap.
+ */
+class ExpiringDictionary : public ExpiringMap<std::string, std::string>
+{
+ public:
+  /**
+   * Seeded like Dictionary, the keys usually come from outside.
+   */
+  ExpiringDictionary ()
+  { this->reseed (random_seed ()); }
+
+  bool erase (const std::string &key) override
+  {
+    if (!this->contains_key (key))
+    { throw InvalidKey ("Key doesn't exists."); }
+    return ExpiringMap<std::string, std::string>::erase (key);
+  }
+};
+
+#endif //_EXPIRINGMAP_HPP_
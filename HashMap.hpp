@@ -4,11 +4,51 @@
 #include <iostream>
 #include <complex>
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "BloomFilter.hpp"
+#include "TableAllocator.hpp"
 #ifndef _HASHMAP_HPP_
 #define _HASHMAP_HPP_
 #define START_CAPACITY 16
+#define START_EXPONENT 4
 #define TOP_THRESHOLD (3.0 / 4.0)
 #define LOW_THRESHOLD (1.0 / 4.0)
+#define TREEIFY_THRESHOLD 8
+#define UNTREEIFY_THRESHOLD 6
+#define BULK_MAX_PARTITION_BITS 16
+#define BULK_PAIRS_PER_PARTITION_BITS 4
+
+/**
+ * Estimated heap bytes a value owns beyond its object, for the byte
+ * budgets of the maps (CacheMap, SpillHashMap).
+ * @return Size_t value.
+ */
+template<typename T>
+std::size_t heap_bytes (const T &)
+{ return 0; }
+
+/**
+ * Heap bytes of a string: none while it fits the inline buffer (the
+ * small string optimization), its bytes and terminator past it. Counted
+ * from the size rather than the capacity, so a copy weighs the same as
+ * its original.
+ * @return Size_t value.
+ */
+inline std::size_t heap_bytes (const std::string &value)
+{
+  static const std::size_t inline_capacity = std::string ().capacity ();
+  return value.size () > inline_capacity ? value.size () + 1 : 0;
+}
 
 template<typename KeyT, typename ValueT>
 class HashMap
@@ -20,65 +60,88 @@ class HashMap
  public:
   typedef iterator_t<const std::pair<KeyT, ValueT>> const_iterator;
 
-  HashMap<KeyT, ValueT> () : _bucket_list (new bucket[(size_t)START_CAPACITY]),
-                _capacity (START_CAPACITY), _size (0), _exponent (4) {}
+  /**
+   * Empty ctor, allocates nothing: the map shares a static array of empty
+   * buckets until its first insert (see own_table), so maps which stay
+   * empty cost no heap allocation.
+   */
+  HashMap<KeyT, ValueT> () : _bucket_list (empty_table ()),
+                _capacity (START_CAPACITY), _size (0), _exponent (START_EXPONENT), _seed (0),
+                _digest_enabled (false), _digest_valid (false), _digest (0),
+                _table_policy (), _filter (), _filter_stale (0) {}
 
   HashMap<KeyT, ValueT> (const std::vector<KeyT> &keys_vector, const
   std::vector<ValueT> &values_vector)
   : HashMap<KeyT, ValueT> ()
-  {
-    if (keys_vector.size () != values_vector.size ())
-    { throw std::length_error ("The size of the vectors is unmatched."); }
-    for (std::size_t i = 0; i < keys_vector.size (); ++i)
-    {
-      if (this->contains_key (keys_vector[i]))
-      { this->at(keys_vector[i]) = values_vector[i]; }
-      else
-      { this->insert (keys_vector[i], values_vector[i]); }
-    }
-  }
+  { this->insert_vectors (keys_vector, values_vector); }
 
+  /**
+   * Copy ctor.
+   * The source is already duplicate free and laid out for the same capacity,
+   * so every bucket is cloned as is, without hashing or re-inserting pairs.
+   * A copy of a map which never allocated doesn't allocate either.
+   * @param other HashMap to copy.
+   */
   HashMap<KeyT, ValueT> (const HashMap<KeyT, ValueT> &other)
+  : _bucket_list (other._bucket_list == empty_table () ? empty_table ()
+                  : allocate_buckets (other._capacity, other._table_policy)),
+    _capacity (other._capacity),
+    _size (other._size), _exponent (other._exponent), _seed (other._seed),
+    _digest_enabled (other._digest_enabled),
+    _digest_valid (other._digest_valid), _digest (other._digest),
+    _table_policy (other._table_policy), _filter (),
+    _filter_stale (other._filter_stale)
   {
-    this->_bucket_list = new bucket[other.capacity ()];
-    this->_capacity = other.capacity ();
-    this->_size = 0;
-    this->_exponent = other._exponent;
-
-    for (int i = 0; i < other.capacity (); ++i)
+    try
     {
-      bucket *other_bucket_ptr = &other._bucket_list[i];
-      auto pair = other_bucket_ptr->get_bucket ().begin ();
-      while (pair != other_bucket_ptr->get_bucket ().end ())
+      for (std::size_t i = 0; this->_bucket_list != empty_table ()
+                              && i < other._capacity; ++i)
       {
-        this->insert (pair->first, pair->second);
-        ++pair;
+        this->_bucket_list[i].get_bucket () = other._bucket_list[i].get_bucket ();
+        if (other._bucket_list[i].is_tree ())
+        { this->treeify (&this->_bucket_list[i]); }
       }
+      if (other._filter)
+      { this->_filter.reset (new blocked_bloom_filter (*other._filter)); }
+    }
+    catch (...)
+    {
+      free_buckets (this->_bucket_list, this->_capacity, this->_table_policy);
+      throw;
     }
   }
 
   virtual ~HashMap<KeyT, ValueT> ()
   {
     this->clear ();
+    free_buckets (this->_bucket_list, this->_capacity, this->_table_policy);
     this->_capacity = 0;
     this->_exponent = 0;
-    delete[] this->_bucket_list;
   }
 
   /**
    * Size of elements inside the HashMap.
-   * @return Int value.
+   * @return Size_t value.
    */
-  int size () const
+  std::size_t size () const
   { return this->_size; }
 
   /**
    * Size of capacity for the Hashmap elements.
-   * @return Int value.
+   * @return Size_t value.
    */
-  int capacity () const
+  std::size_t capacity () const
   { return this->_capacity; }
 
+  /**
+   * The capacity a map needs to hold count pairs without re-hashing, never
+   * below START_CAPACITY.
+   * @param count Size_t type variable.
+   * @return Size_t value.
+   */
+  static std::size_t capacity_for (std::size_t count)
+  { return (std::size_t) 1 << exponent_for (count, START_EXPONENT); }
+
   /**
    * Check if the Hashmap is empty.
    * @return Boolean value.
@@ -96,110 +159,427 @@ class HashMap
    */
   bool insert (const KeyT &key, const ValueT &value)
   {
-    if (this->contains_key (key))
+    std::size_t hash = this->hash_key (key);
+    bucket *bucket_ptr = &this->_bucket_list[hash & (this->_capacity - 1)];
+    if (this->find_in_bucket (key, bucket_ptr, hash) != nullptr)
     { return false; }
-    ++this->_size;
-    if (this->get_load_factor () > TOP_THRESHOLD)
-    { this->re_hashing ("increase"); }
-    std::size_t index = std::hash<KeyT>{} (key) & (this->_capacity - 1);
-    bucket *bucket_ptr = &this->_bucket_list[index];
-    bucket_ptr->update_bucket (key, value);
+    this->add_missing (hash, key, value);
     return true;
   }
 
+  /**
+   * Insert new pair<Key, Value> into the HashMap, or overwrite the value of
+   * an existing key. Unlike writing through at() or operator[], the write is
+   * tracked by the digest.
+   * @param key Generic type value.
+   * @param value Generic type value.
+   * @return True if a new pair was inserted, false if a value was replaced.
+   */
+  bool insert_or_assign (const KeyT &key, const ValueT &value)
+  {
+    std::size_t hash = this->hash_key (key);
+    std::pair<KeyT, ValueT> *pair_ptr = this->find_in_bucket (
+        key, &this->_bucket_list[hash & (this->_capacity - 1)], hash);
+    if (pair_ptr == nullptr)
+    {
+      this->add_missing (hash, key, value);
+      return true;
+    }
+    this->digest_sub (pair_ptr->first, pair_ptr->second);
+    pair_ptr->second = value;
+    this->digest_add (pair_ptr->first, pair_ptr->second);
+    return false;
+  }
+
+  /**
+   * Insert count pairs from parallel arrays, like a loop of insert: keys
+   * already in the map keep their value, and of a key repeated in the
+   * batch the first pair wins.
+   * The keys are hashed in one pass (a branch free loop, which the compiler
+   * vectorizes for integral keys), the map is reserved once for the keys
+   * it doesn't hold yet, and the pairs are counting sorted by the high bits
+   * of their bucket index, so the buckets are filled in address order.
+   * The capacity ends where a loop of insert would leave it: if keys repeat
+   * in the batch, the surplus of the reservation is given back.
+   * @param keys Pointer to the first key.
+   * @param values Pointer to the first value.
+   * @param count Number of pairs.
+   * @return Number of pairs inserted.
+   */
+  std::size_t insert_bulk (const KeyT *keys, const ValueT *values,
+                           std::size_t count)
+  {
+    if (count == 0)
+    { return 0; }
+    std::vector<std::size_t> hashes (count);
+    this->hash_keys (keys, count, hashes.data ());
+    int exponent = this->_exponent;
+    std::size_t missing = count;
+    for (std::size_t i = 0; this->_size != 0 && i < count; ++i)
+    {
+      bucket *bucket_ptr = &this->_bucket_list[hashes[i] & (this->_capacity - 1)];
+      if (this->find_in_bucket (keys[i], bucket_ptr, hashes[i]) != nullptr)
+      { --missing; }
+    }
+    if (missing == 0)
+    { return 0; }
+    this->reserve (this->_size + missing);
+    int bits = 0;
+    while (bits < this->_exponent && bits < BULK_MAX_PARTITION_BITS
+           && (count >> (bits + BULK_PAIRS_PER_PARTITION_BITS)) != 0)
+    { ++bits; }
+    int shift = this->_exponent - bits;
+    std::size_t mask = this->_capacity - 1;
+    std::vector<std::size_t> starts (((std::size_t) 1 << bits) + 1, 0);
+    for (std::size_t i = 0; i < count; ++i)
+    { ++starts[((hashes[i] & mask) >> shift) + 1]; }
+    for (std::size_t p = 1; p < starts.size (); ++p)
+    { starts[p] += starts[p - 1]; }
+    // Stable, so the first pair of a repeated key stays first
+    std::vector<std::size_t> order (count);
+    for (std::size_t i = 0; i < count; ++i)
+    { order[starts[(hashes[i] & mask) >> shift]++] = i; }
+    std::size_t inserted = 0;
+    for (std::size_t i: order)
+    {
+      bucket *bucket_ptr = &this->_bucket_list[hashes[i] & mask];
+      if (this->find_in_bucket (keys[i], bucket_ptr, hashes[i]) != nullptr)
+      { continue; }
+      bucket_ptr->update_bucket (keys[i], values[i]);
+      this->link_last (bucket_ptr, hashes[i]);
+      ++this->_size;
+      this->digest_add (keys[i], values[i]);
+      ++inserted;
+    }
+    this->fit_reservation (exponent);
+    return inserted;
+  }
+
+  /**
+   * Insert the pairs of a keys vector and a values vector of the same
+   * size, see insert_bulk above.
+   * @param keys_vector Vector of keys.
+   * @param values_vector Vector of values.
+   * @return Number of pairs inserted.
+   */
+  std::size_t insert_bulk (const std::vector<KeyT> &keys_vector,
+                           const std::vector<ValueT> &values_vector)
+  {
+    if (keys_vector.size () != values_vector.size ())
+    { throw std::length_error ("The size of the vectors is unmatched."); }
+    return this->insert_bulk (keys_vector.data (), values_vector.data (),
+                              keys_vector.size ());
+  }
+
+  /**
+   * Policies for keys which exist on both sides of a merge.
+   * OVERWRITE takes the incoming value, KEEP leaves the existing one.
+   */
+  enum merge_policy
+  {
+    OVERWRITE, KEEP
+  };
+
+  /**
+   * Grow the capacity once, so that count pairs fit without any more
+   * re-hashing. Never shrinks.
+   * @param count Size_t type variable.
+   */
+  void reserve (std::size_t count)
+  {
+    int exponent = exponent_for (count, this->_exponent);
+    if (exponent != this->_exponent)
+    { this->re_hashing_to (exponent); }
+    // Callers may fill the buckets in parallel next (see merge_partition)
+    if (count != 0)
+    { this->own_table (); }
+  }
+
+  /**
+   * Copy every pair of other into this map.
+   * Reserves once for both maps, and if the capacities match, pairs go to
+   * the matching bucket without hashing. If many keys were in both maps,
+   * the surplus of the reservation is given back afterwards.
+   * @param other HashMap to merge from.
+   * @param policy What to do with keys that are already in this map.
+   */
+  void merge (const HashMap<KeyT, ValueT> &other,
+              merge_policy policy = OVERWRITE)
+  {
+    if (&other == this)
+    { return; }
+    int exponent = this->_exponent;
+    this->reserve (this->_size + other._size);
+    this->merge_buckets (other._bucket_list, other._capacity,
+                         other._seed, false,
+                         policy_resolver {policy});
+    this->fit_reservation (exponent);
+  }
+
+  /**
+   * Move every pair of other into this map, leaving other empty.
+   * The list nodes of other are spliced into this map, so no pair is
+   * copied or allocated.
+   * @param other HashMap to merge from.
+   * @param policy What to do with keys that are already in this map.
+   */
+  void merge (HashMap<KeyT, ValueT> &&other, merge_policy policy = OVERWRITE)
+  {
+    if (&other == this)
+    { return; }
+    int exponent = this->_exponent;
+    this->reserve (this->_size + other._size);
+    clear_guard guard {other};
+    this->merge_buckets (other._bucket_list, other._capacity,
+                         other._seed, true,
+                         policy_resolver {policy});
+    this->fit_reservation (exponent);
+  }
+
+  /**
+   * Copy every pair of other into this map.
+   * Values of keys that are already in this map are replaced by
+   * combine (existing, incoming).
+   * @param other HashMap to merge from.
+   * @param combine Callable returning the merged value.
+   */
+  template<typename Combine>
+  void merge (const HashMap<KeyT, ValueT> &other, Combine combine)
+  {
+    if (&other == this)
+    { return; }
+    int exponent = this->_exponent;
+    this->reserve (this->_size + other._size);
+    this->merge_buckets (other._bucket_list, other._capacity,
+                         other._seed, false,
+                         combine_resolver<Combine> {combine});
+    this->fit_reservation (exponent);
+  }
+
+  /**
+   * Move every pair of other into this map, leaving other empty.
+   * Values of keys that are already in this map are replaced by
+   * combine (existing, incoming).
+   * If combine throws, the pairs of other not merged yet are dropped,
+   * other is left empty either way.
+   * @param other HashMap to merge from.
+   * @param combine Callable returning the merged value.
+   */
+  template<typename Combine>
+  void merge (HashMap<KeyT, ValueT> &&other, Combine combine)
+  {
+    if (&other == this)
+    { return; }
+    int exponent = this->_exponent;
+    this->reserve (this->_size + other._size);
+    clear_guard guard {other};
+    this->merge_buckets (other._bucket_list, other._capacity,
+                         other._seed, true,
+                         combine_resolver<Combine> {combine});
+    this->fit_reservation (exponent);
+  }
+
+  /**
+   * Merge a range of pairs into this map.
+   * If the size of the range is known (forward iterators), reserves once
+   * up front. Later pairs of the range win over earlier ones of the same key
+   * unless the policy is KEEP.
+   * @param begin Iterator to the first pair.
+   * @param end Iterator past the last pair.
+   * @param policy What to do with keys that are already in this map.
+   */
+  template<typename It>
+  void merge (It begin, It end, merge_policy policy = OVERWRITE)
+  { this->merge_range (begin, end, policy_resolver {policy}); }
+
+  /**
+   * Merge a range of pairs into this map.
+   * Values of keys that are already in this map are replaced by
+   * combine (existing, incoming).
+   * @param begin Iterator to the first pair.
+   * @param end Iterator past the last pair.
+   * @param combine Callable returning the merged value.
+   */
+  template<typename It, typename Combine>
+  void merge (It begin, It end, Combine combine)
+  { this->merge_range (begin, end, combine_resolver<Combine> {combine}); }
+
   /**
    * Check if given key is already in the HashMap.
    * @param key Generic value.
    * @return Boolean Value.
    */
   bool contains_key (const KeyT &key) const
+  { return this->find_pair (key) != nullptr; }
+
+  /**
+   * Find the pair of the given key, without throwing on a miss.
+   * @param key Generic type.
+   * @return Iterator to the pair, or end () if the key doesn't exist.
+   */
+  const_iterator find (const KeyT &key) const
   {
-    std::size_t index = std::hash<KeyT>{} (key) & (this->_capacity - 1);
-    bucket *bucket_ptr = &this->_bucket_list[index];
-    return this->is_in_bucket (key, bucket_ptr);
+    std::size_t hash = this->hash_key (key);
+    std::size_t index = hash & (this->_capacity - 1);
+    bucket_data &chain = this->_bucket_list[index].get_bucket ();
+    auto it = this->_bucket_list[index].find (key, hash);
+    if (it == chain.end ())
+    { return this->cend (); }
+    return const_iterator (*this, index,
+                           (std::size_t) std::distance (chain.begin (), it));
   }
 
   /**
-   * Check if given key is already in the HashMap.
-   * @param key Generic value.
-   * @return Boolean Value.
+   * Value of the given key, without throwing on a miss.
+   * @param key Generic type.
+   * @return Pointer to the value, or nullptr if the key doesn't exist.
+   */
+  const ValueT *try_get (const KeyT &key) const
+  {
+    const std::pair<KeyT, ValueT> *pair_ptr = this->find_pair (key);
+    return pair_ptr == nullptr ? nullptr : &pair_ptr->second;
+  }
+
+  /**
+   * Value of the given key, without throwing on a miss.
+   * @param key Generic type.
+   * @return Pointer to the value, or nullptr if the key doesn't exist.
+   */
+  ValueT *try_get (const KeyT &key)
+  {
+    // The caller may write through the pointer, which the digest can't see.
+    this->_digest_valid = false;
+    std::pair<KeyT, ValueT> *pair_ptr = this->find_pair (key);
+    return pair_ptr == nullptr ? nullptr : &pair_ptr->second;
+  }
+
+  /**
+   * Value of the given key, or the fallback if the key doesn't exist.
+   * @param key Generic type.
+   * @param fallback Value returned on a miss.
+   * @return Copy of the value.
    */
-  bool contains_key (const KeyT &key)
+  ValueT get_or (const KeyT &key, const ValueT &fallback) const
   {
-    std::size_t index = std::hash<KeyT>{} (key) & (this->_capacity - 1);
-    bucket *bucket_ptr = &this->_bucket_list[index];
-    return this->is_in_bucket (key, bucket_ptr);
+    const ValueT *value_ptr = this->try_get (key);
+    return value_ptr == nullptr ? fallback : *value_ptr;
   }
 
   /**
    * Given reference to value by key.
-   * If key doesnt exists throw error.
+   * If key doesnt exists throw error, see try_get for a lookup which
+   * doesn't throw.
    * @param key Generic type.
    * @return Reference to generic type variable named value.
    */
   const ValueT &at (const KeyT &key) const
   {
-    std::size_t index = std::hash<KeyT>{} (key) & (this->_capacity - 1);
-    bucket *bucket_ptr = &this->_bucket_list[index];
-    if (!this->is_in_bucket (key, bucket_ptr))
+    const ValueT *value_ptr = this->try_get (key);
+    if (value_ptr == nullptr)
     { throw std::invalid_argument ("Key doesn't exists."); }
-    for (auto it = bucket_ptr->get_bucket ().begin (); it <
-                                                       bucket_ptr->get_bucket ().end (); ++it)
-    {
-      if (it->first == key)
-      { return it->second; }
-    }
+    return *value_ptr;
   }
 
   /**
    * Given reference to value by key.
-   * If key doesnt exists throw error.
+   * If key doesnt exists throw error, see try_get for a lookup which
+   * doesn't throw.
    * @param key Generic type.
    * @return Reference to generic type variable named value.
    */
   ValueT &at (const KeyT &key)
   {
-    std::size_t index = std::hash<KeyT>{} (key) & (this->_capacity - 1);
-    bucket *bucket_ptr = &this->_bucket_list[index];
-    if (this->is_in_bucket (key, bucket_ptr))
-    {
-      for (auto it = bucket_ptr->get_bucket ().begin (); it !=
-                                       bucket_ptr->get_bucket ().end (); ++it)
-      {
-        if (it->first == key)
-        { return it->second; }
-      }
-    }
-    throw std::invalid_argument ("Key doesn't exists.");
+    ValueT *value_ptr = this->try_get (key);
+    if (value_ptr == nullptr)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return *value_ptr;
   }
 
   /**
-   *
-   * @param key
-   * @return
+   * Remove the pair of the given key, with a single lookup.
+   * Shrinks the capacity if the load factor drops below LOW_THRESHOLD.
+   * @param key Generic type variable.
+   * @return True if the key was found and removed.
    */
   virtual bool erase (const KeyT &key)
   {
-    if (this->get_load_factor () < LOW_THRESHOLD)
-    { this->re_hashing ("decrease"); }
-
-    if (!this->contains_key (key))
+    if (!this->remove (key))
     { return false; }
-    std::size_t index = std::hash<KeyT>{} (key) & (this->_capacity - 1);
-    bucket *bucket_ptr = &this->_bucket_list[index];
-    for (auto it = bucket_ptr->get_bucket ().begin (); it !=
-                                       bucket_ptr->get_bucket ().end (); ++it)
+    this->shrink_to_fit ();
+    return true;
+  }
+
+  /**
+   * Remove the pair the given iterator points to.
+   * Never shrinks, so the other iterators stay valid while erasing during a
+   * scan. Call shrink_to_fit () once done.
+   * @param pos Iterator to a pair of this map.
+   * @return Iterator to the pair after the removed one.
+   */
+  const_iterator erase (const_iterator pos)
+  {
+    bucket *bucket_ptr = &this->_bucket_list[pos._bucket_index];
+    bucket_data &cur_bucket = bucket_ptr->get_bucket ();
+    auto it = cur_bucket.begin ();
+    std::advance (it, pos._pair_index);
+    this->digest_sub (it->first, it->second);
+    this->remove_node (bucket_ptr, it);
+    --this->_size;
+    if (pos._pair_index < cur_bucket.size ())
+    { return const_iterator (*this, pos._bucket_index, pos._pair_index); }
+    return const_iterator (*this, pos._bucket_index + 1, 0);
+  }
+
+  /**
+   * Remove every pair the predicate holds for, in a single pass.
+   * The shrink decision is taken once, after all the removals.
+   * @param predicate Callable taking a const pair<Key, Value> &.
+   * @return Number of removed pairs.
+   */
+  template<typename Predicate>
+  std::size_t erase_if (Predicate predicate)
+  {
+    if (this->_bucket_list == empty_table ())
+    { return 0; }
+    std::size_t removed = 0;
+    for (std::size_t i = 0; i < this->_capacity; ++i)
     {
-      if (it->first == key)
+      bucket *bucket_ptr = &this->_bucket_list[i];
+      bucket_data &cur_bucket = bucket_ptr->get_bucket ();
+      auto it = cur_bucket.begin ();
+      while (it != cur_bucket.end ())
       {
-        bucket_ptr->get_bucket ().remove (*it);
-        --this->_size;
-        if (this->get_load_factor () < LOW_THRESHOLD)
-        { this->re_hashing ("decrease"); }
-        return true;
+        if (predicate (static_cast<const std::pair<KeyT, ValueT> &> (*it)))
+        {
+          this->digest_sub (it->first, it->second);
+          it = this->remove_node (bucket_ptr, it);
+          ++removed;
+        }
+        else
+        { ++it; }
       }
     }
-    return false;
+    this->_size -= removed;
+    this->shrink_to_fit ();
+    return removed;
+  }
+
+  /**
+   * Shrink the capacity with a single re-hashing, to the largest capacity
+   * whose load factor isn't below LOW_THRESHOLD.
+   * A map which never had a pair keeps sharing the empty table.
+   */
+  void shrink_to_fit ()
+  {
+    if (this->_bucket_list == empty_table ())
+    { return; }
+    int exponent = this->_exponent;
+    while (exponent > 0
+           && (double) this->_size / (double) ((std::size_t) 1 << exponent)
+              < LOW_THRESHOLD)
+    { --exponent; }
+    if (exponent != this->_exponent)
+    { this->re_hashing_to (exponent); }
   }
 
   /**
@@ -210,32 +590,31 @@ class HashMap
   { return (double) this->_size / (double) this->_capacity; }
 
   /**
-   *
-   * @param key
-   * @return
+   * Number of pairs in the bucket of the given key.
+   * If key doesnt exists throw error.
+   * @param key Generic type.
+   * @return Size_t value.
    */
-  int bucket_size (const KeyT &key)
+  std::size_t bucket_size (const KeyT &key)
   {
-    std::size_t index = std::hash<KeyT>{} (key) & (this->_capacity - 1);
-    bucket *bucket_ptr = &this->_bucket_list[index];
-    if (this->is_in_bucket (key, bucket_ptr))
-    { return bucket_ptr->get_bucket ().size (); }
-    throw std::invalid_argument ("Key doesn't exists.");
+    const_iterator it = this->find (key);
+    if (it == this->cend ())
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return this->_bucket_list[it._bucket_index].get_bucket ().size ();
   }
 
   /**
-   *
-   * @param key
-   * @return
+   * Index of the bucket of the given key.
+   * If key doesnt exists throw error.
+   * @param key Generic type.
+   * @return Size_t value.
    */
-  int bucket_index (const KeyT &key)
+  std::size_t bucket_index (const KeyT &key)
   {
-    std::size_t index = std::hash<KeyT>{} (key) & (this->_capacity - 1);
-    bucket *bucket_ptr = &this->_bucket_list[index];
-    if (this->is_in_bucket (key, bucket_ptr))
-    { return (int) index; }
-
-    throw std::invalid_argument ("Key doesn't exists.");
+    const_iterator it = this->find (key);
+    if (it == this->cend ())
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return it._bucket_index;
   }
 
   /**
@@ -243,13 +622,139 @@ class HashMap
    */
   void clear ()
   {
-    for (int i = 0; i < this->_capacity; ++i)
+    for (std::size_t i = 0; this->_bucket_list != empty_table ()
+                            && i < this->_capacity; ++i)
     {
-      bucket *bucket_ptr = &this->_bucket_list[i];
-      if (!bucket_ptr->get_bucket ().empty ())
-      { bucket_ptr->get_bucket ().clear (); }
+      this->_bucket_list[i].clear ();
     }
     this->_size = 0;
+    this->_digest = 0;
+    this->_digest_valid = this->_digest_enabled;
+    if (this->_filter)
+    {
+      this->_filter->clear ();
+      this->_filter_stale = 0;
+    }
+  }
+
+  /**
+   * Hash the keys with the given seed from now on, re-hashing the pairs.
+   * A seed of 0 means plain std::hash, other seeds make the bucket of a key
+   * unpredictable to whoever doesn't know the seed (see random_seed ()).
+   * @param seed Seed value.
+   */
+  void reseed (std::size_t seed)
+  {
+    this->_seed = seed;
+    if (this->_size != 0)
+    { this->re_hashing_to (this->_exponent); }
+  }
+
+  /**
+   * Allocate the bucket array with the given page and NUMA policy from now
+   * on, moving the pairs to a new array right away. For maps of many GB,
+   * huge pages cut the TLB misses of random lookups, and interleaving keeps
+   * the table off the single node which happened to grow it.
+   * Arrays smaller than HUGE_PAGE_SIZE stay on the heap (see
+   * TableAllocator.hpp).
+   * @param policy Allocation policy.
+   */
+  void set_table_policy (const table_policy &policy)
+  { this->re_hashing_to (this->_exponent, policy); }
+
+  /**
+   * The policy the bucket array is allocated with.
+   * @return Allocation policy.
+   */
+  const table_policy &get_table_policy () const
+  { return this->_table_policy; }
+
+  /**
+   * Put a blocked Bloom filter in front of contains_key, so most misses are
+   * rejected with one cache line access instead of a bucket walk. Worth it
+   * when most lookups miss, e.g. blocklist checks; every insert pays one
+   * more hash. The filter is kept up to date by inserts, and rebuilt when
+   * the map re-hashes or once enough keys were erased.
+   * @param false_positive_rate Rate of misses which still walk a bucket.
+   */
+  void enable_filter (double false_positive_rate = FILTER_FALSE_POSITIVE_RATE)
+  {
+    std::unique_ptr<blocked_bloom_filter> previous (std::move (this->_filter));
+    try
+    {
+      this->_filter.reset (new blocked_bloom_filter (1, false_positive_rate));
+      this->rebuild_filter ();
+    }
+    catch (...)
+    {
+      this->_filter = std::move (previous);
+      throw;
+    }
+  }
+
+  /**
+   * Drop the filter of enable_filter.
+   */
+  void disable_filter ()
+  { this->_filter.reset (); }
+
+  /**
+   * Check if a filter is in front of contains_key.
+   * @return Boolean value.
+   */
+  bool filter_enabled () const
+  { return this->_filter != nullptr; }
+
+  /**
+   * A fresh, unpredictable, non zero hash seed.
+   * Drawn from std::random_device once per process, and mixed with a
+   * counter for every call.
+   * @return Seed value.
+   */
+  static std::size_t random_seed ()
+  {
+    static const std::uint64_t base =
+        ((std::uint64_t) std::random_device {} () << 32)
+        ^ std::random_device {} ();
+    static std::atomic<std::uint64_t> counter (0);
+    std::uint64_t seed = mix (base + ++counter * 0x9E3779B97F4A7C15ULL);
+    return seed == 0 ? 1 : (std::size_t) seed;
+  }
+
+  /**
+   * Start tracking an order independent digest of all the (key, value)
+   * pairs, so unequal maps can be told apart in O(1) by operator==.
+   * The digest is kept up to date by insert, insert_or_assign and erase.
+   * Handing out a mutable reference (at, operator[]) drops it, and it is
+   * recomputed on the next call to digest().
+   */
+  void enable_digest ()
+  {
+    static_assert (decltype (probe_hash<ValueT> (0))::value,
+                   "The digest requires std::hash of the value type.");
+    this->_digest_enabled = true;
+    this->_digest_valid = false;
+    this->digest ();
+  }
+
+  /**
+   * Order independent digest of all the (key, value) pairs.
+   * Recomputed from scratch if it was dropped since the last call.
+   * @return Digest value, or 0 if the digest isn't enabled.
+   */
+  std::uint64_t digest () const
+  {
+    if (this->_digest_enabled && !this->_digest_valid)
+    {
+      this->_digest = 0;
+      for (std::size_t i = 0; i < this->_capacity; ++i)
+      {
+        for (const auto &pair: this->_bucket_list[i].get_bucket ())
+        { this->_digest += pair_digest (pair.first, pair.second, 0); }
+      }
+      this->_digest_valid = true;
+    }
+    return this->_digest;
   }
 
   const_iterator begin () 
@@ -269,13 +774,78 @@ class HashMap
 
   const_iterator cend () const
   { return const_iterator (*this, this->_capacity, 0); }
+
+  /**
+   * A run of whole buckets of the map, usable as a standalone iterator pair
+   * (and in a range based for loop).
+   */
+  class const_range
+  {
+   private:
+    const_iterator _begin;
+    const_iterator _end;
+
+   public:
+    const_range (const const_iterator &begin, const const_iterator &end)
+        : _begin (begin), _end (end)
+    {}
+
+    const_iterator begin () const
+    { return this->_begin; }
+
+    const_iterator end () const
+    { return this->_end; }
+  };
+
+  /**
+   * Split the bucket array into at most count consecutive ranges which hold
+   * about the same number of pairs (weighted by occupancy, not by bucket
+   * index). A range never splits a bucket, and empty ranges are dropped.
+   * The ranges stay valid as long as the map isn't modified.
+   * @param count Int type variable.
+   * @return Vector of ranges, covering the whole map in iteration order.
+   */
+  std::vector<const_range> split_ranges (int count) const
+  {
+    std::vector<const_range> ranges;
+    if (count < 1 || this->_size == 0)
+    { return ranges; }
+    double per_range = (double) this->_size / count;
+    std::size_t first_bucket = 0;
+    std::size_t in_range = 0;
+    std::size_t seen = 0;
+    for (std::size_t i = 0; i < this->_capacity && seen < this->_size; ++i)
+    {
+      std::size_t bucket_size = this->_bucket_list[i].get_bucket ().size ();
+      seen += bucket_size;
+      in_range += bucket_size;
+      if (in_range > 0 && (seen == this->_size
+                           || seen >= per_range * (double) (ranges.size () + 1)))
+      {
+        ranges.emplace_back (const_iterator (*this, first_bucket, 0),
+                             const_iterator (*this, i + 1, 0));
+        first_bucket = i + 1;
+        in_range = 0;
+      }
+    }
+    return ranges;
+  }
 	
+	friend class set_algebra;
+
 	friend void swap (HashMap<KeyT, ValueT> &src, HashMap<KeyT, ValueT> &dst)
 	{
 		std::swap(src._size, dst._size);
 		std::swap(src._capacity, dst._capacity);
 		std::swap(src._exponent, dst._exponent);
+		std::swap(src._seed, dst._seed);
 		std::swap(src._bucket_list, dst._bucket_list);
+		std::swap(src._digest_enabled, dst._digest_enabled);
+		std::swap(src._digest_valid, dst._digest_valid);
+		std::swap(src._digest, dst._digest);
+		std::swap(src._table_policy, dst._table_policy);
+		std::swap(src._filter, dst._filter);
+		std::swap(src._filter_stale, dst._filter_stale);
 	}
 
 	HashMap<KeyT, ValueT> &operator= (HashMap<KeyT, ValueT> rhs)
@@ -307,53 +877,56 @@ class HashMap
   }
 */
 
+  /**
+   * Value of the given key, inserting a default value if the key doesn't
+   * exist. Hashes the key once.
+   * @param key Generic type.
+   * @return Reference to generic type variable named value.
+   */
   ValueT &operator[] (const KeyT &key)
   {
-    if (!this->contains_key (key))
-    { this->insert (key, ValueT ()); }
-    return this->at (key);
+    // The caller may write through the reference, which the digest can't see.
+    this->_digest_valid = false;
+    std::size_t hash = this->hash_key (key);
+    bucket *bucket_ptr = &this->_bucket_list[hash & (this->_capacity - 1)];
+    auto it = bucket_ptr->find (key, hash);
+    if (it != bucket_ptr->get_bucket ().end ())
+    { return it->second; }
+    return this->add_missing (hash, key, ValueT ())->second;
   }
 
   ValueT operator[] (const KeyT &key) const
   { return this->at (key); }
 
+  /**
+   * Two maps are equal if they hold the same (key, value) pairs.
+   * If both maps track a digest, unequal digests reject in O(1) (unless a
+   * digest was dropped and has to be recomputed first).
+   * If both maps share the same capacity and seed, the pairs of a bucket can
+   * only be in the matching bucket of this map, so no hashing is needed.
+   * @param rhs HashMap to compare with.
+   * @return Boolean value.
+   */
   bool operator== (const HashMap<KeyT, ValueT> &rhs) const
   {
     if (this->_size != rhs._size)
     { return false; }
-    for (auto i = 0; i < rhs._capacity; ++i)
-    {
-      bucket &bucket_ref = rhs._bucket_list[i];
-      if (!bucket_ref.get_bucket ().empty ())
-      {
-        for (const auto &pair: bucket_ref.get_bucket ())
-        {
-          if (!this->contains_key (pair.first))
-          { return false; }
-          if (this->at (pair.first) != pair.second)
-          { return false; }
-        }
-      }
-    }
-    return true;
-  }
-
-  bool operator== (const HashMap<KeyT, ValueT> &rhs)
-  {
-    if (this->_size != rhs._size)
+    if (this->_digest_enabled && rhs._digest_enabled
+        && this->digest () != rhs.digest ())
     { return false; }
-    for (auto i = 0; i < rhs._capacity; ++i)
+    bool same_layout = this->shares_layout (rhs._capacity, rhs._seed);
+    for (std::size_t i = 0; i < rhs._capacity; ++i)
     {
       bucket &bucket_ref = rhs._bucket_list[i];
-      if (!bucket_ref.get_bucket ().empty ())
+      for (const auto &pair: bucket_ref.get_bucket ())
       {
-        for (const auto &pair: bucket_ref.get_bucket ())
-        {
-          if (!this->contains_key (pair.first))
-          { return false; }
-          if (this->at (pair.first) != pair.second)
-          { return false; }
-        }
+        bucket *bucket_ptr = same_layout ? &this->_bucket_list[i]
+            : &this->_bucket_list[this->hash_key (pair.first)
+                                  & (this->_capacity - 1)];
+        const std::pair<KeyT, ValueT> *pair_ptr =
+            this->find_in_bucket (pair.first, bucket_ptr);
+        if (pair_ptr == nullptr || !(pair_ptr->second == pair.second))
+        { return false; }
       }
     }
     return true;
@@ -362,14 +935,18 @@ class HashMap
   bool operator!= (const HashMap<KeyT, ValueT> &rhs) const
   { return !this->operator== (rhs); }
 
-  bool operator!= (const HashMap<KeyT, ValueT> &rhs)
-  { return !this->operator== (rhs); }
-
  protected:
   bucket *_bucket_list;
-  int _capacity;
-  int _size;
+  std::size_t _capacity;
+  std::size_t _size;
   int _exponent;
+  std::size_t _seed;
+  bool _digest_enabled;
+  mutable bool _digest_valid;
+  mutable std::uint64_t _digest;
+  table_policy _table_policy;
+  std::unique_ptr<blocked_bloom_filter> _filter;
+  std::size_t _filter_stale;
 
   /**
    * Check if the give key is exists in the given bucket.
@@ -377,52 +954,729 @@ class HashMap
    * @param bucket_ptr Pointer to bucket object.
    * @return Boolean type.
    */
-  bool is_in_bucket (const KeyT &key, bucket *bucket_ptr)
+  bool is_in_bucket (const KeyT &key, bucket *bucket_ptr) const
+  { return this->find_in_bucket (key, bucket_ptr) != nullptr; }
+
+  /**
+   * Find the pair of the given key, hashing it once. Misses the filter
+   * rejects never touch the bucket.
+   * @param key Generic type variable.
+   * @return Pointer to the pair, or nullptr if the key doesn't exist.
+   */
+  std::pair<KeyT, ValueT> *find_pair (const KeyT &key) const
   {
-    bucket_data &cur_bucket = bucket_ptr->get_bucket ();
-    for (auto it = cur_bucket.begin (); it != cur_bucket.end (); it++)
+    std::size_t hash = this->hash_key (key);
+    if (this->_filter && !this->_filter->may_contain (hash))
+    { return nullptr; }
+    bucket *bucket_ptr = &this->_bucket_list[hash & (this->_capacity - 1)];
+    auto it = bucket_ptr->find (key, hash);
+    return it == bucket_ptr->get_bucket ().end () ? nullptr : &*it;
+  }
+
+  /**
+   * Find the pair of the given key in the given bucket.
+   * @param key Generic type variable.
+   * @param bucket_ptr Pointer to bucket object.
+   * @return Pointer to the pair, or nullptr if the key isn't in the bucket.
+   */
+  std::pair<KeyT, ValueT> *find_in_bucket (const KeyT &key,
+                                           bucket *bucket_ptr) const
+  {
+    auto it = bucket_ptr->find (key, bucket_ptr->is_tree () ? this->hash_key (key)
+                                                            : 0);
+    return it == bucket_ptr->get_bucket ().end () ? nullptr : &*it;
+  }
+
+  /**
+   * Find the pair of the given key in the given bucket, for callers which
+   * already hashed it.
+   * @param key Generic type variable.
+   * @param bucket_ptr Pointer to bucket object.
+   * @param hash Hash of the key.
+   * @return Pointer to the pair, or nullptr if the key isn't in the bucket.
+   */
+  std::pair<KeyT, ValueT> *find_in_bucket (const KeyT &key, bucket *bucket_ptr,
+                                           std::size_t hash) const
+  {
+    auto it = bucket_ptr->find (key, hash);
+    return it == bucket_ptr->get_bucket ().end () ? nullptr : &*it;
+  }
+
+  /**
+   * Combine into this map the pairs of other whose hash falls in the given
+   * partition (hash & (partitions - 1) == partition), without updating the
+   * size or the digest.
+   * Merges of different partitions touch disjoint buckets of this map, so
+   * they may run in parallel, as long as partitions is a power of 2 not
+   * above the capacity, and the map isn't resized meanwhile. If other
+   * shares the seed and has at least partitions buckets, only its buckets
+   * of the partition are read.
+   * The filter of enable_filter is shared by all the partitions, so a map
+   * with a filter throws std::logic_error instead of racing on it.
+   * @param other HashMap to merge from.
+   * @param partition Size_t type variable.
+   * @param partitions Size_t type variable.
+   * @param combine Callable of (ValueT, ValueT) returning the merged value.
+   * @return Number of pairs added to this map.
+   */
+  template<typename Combine>
+  std::size_t merge_partition (const HashMap<KeyT, ValueT> &other,
+                               std::size_t partition, std::size_t partitions,
+                               Combine &combine)
+  {
+    if (this->_filter)
+    { throw std::logic_error ("Partition merges can't update a filter."); }
+    std::size_t added = 0;
+    bool aligned = other._seed == this->_seed && other._capacity >= partitions;
+    std::size_t step = aligned ? partitions : 1;
+    for (std::size_t i = aligned ? partition : 0; i < other._capacity;
+         i += step)
     {
-      if (it->first == key)
-      { return true; }
+      for (const auto &pair: other._bucket_list[i].get_bucket ())
+      {
+        std::size_t hash = this->hash_key (pair.first);
+        if (!aligned && (hash & (partitions - 1)) != partition)
+        { continue; }
+        bucket *bucket_ptr = &this->_bucket_list[hash & (this->_capacity - 1)];
+        std::pair<KeyT, ValueT> *pair_ptr =
+            this->find_in_bucket (pair.first, bucket_ptr, hash);
+        if (pair_ptr != nullptr)
+        { pair_ptr->second = combine (pair_ptr->second, pair.second); }
+        else
+        {
+          bucket_ptr->update_bucket (pair.first, pair.second);
+          this->link_last (bucket_ptr, hash);
+          ++added;
+        }
+      }
     }
-    return false;
+    return added;
+  }
+
+  /**
+   * Remove the pair of the given key, without ever shrinking.
+   * For containers built on HashMap which keep a fixed capacity.
+   * @param key Generic type variable.
+   * @return True if the key was found and removed.
+   */
+  bool remove (const KeyT &key)
+  {
+    std::size_t hash = this->hash_key (key);
+    bucket *bucket_ptr = &this->_bucket_list[hash & (this->_capacity - 1)];
+    auto it = bucket_ptr->find (key, hash);
+    if (it == bucket_ptr->get_bucket ().end ())
+    { return false; }
+    this->digest_sub (it->first, it->second);
+    this->remove_node (bucket_ptr, it, hash);
+    --this->_size;
+    return true;
+  }
+
+  /**
+   * Fill the map from a keys vector and a values vector of the same size.
+   * Later duplicates of a key overwrite the earlier ones.
+   * @param keys_vector Vector of keys.
+   * @param values_vector Vector of values.
+   */
+  void insert_vectors (const std::vector<KeyT> &keys_vector,
+                       const std::vector<ValueT> &values_vector)
+  {
+    if (keys_vector.size () != values_vector.size ())
+    { throw std::length_error ("The size of the vectors is unmatched."); }
+    for (std::size_t i = 0; i < keys_vector.size (); ++i)
+    { this->insert_or_assign (keys_vector[i], values_vector[i]); }
+  }
+
+  /**
+   * Hash of a key, plain std::hash if the map isn't seeded.
+   * @param key Generic type variable.
+   * @return Hash value.
+   */
+  std::size_t hash_key (const KeyT &key) const
+  {
+    if (this->_seed == 0)
+    { return std::hash<KeyT>{} (key); }
+    return seeded_hash (key, this->_seed);
+  }
+
+  /**
+   * Hash count keys into hashes, the same values as hash_key.
+   * The seed check is out of the loop, so for integral keys the loop is
+   * straight multiply, shift and xor over the array.
+   */
+  void hash_keys (const KeyT *keys, std::size_t count,
+                  std::size_t *hashes) const
+  {
+    if (this->_seed == 0)
+    {
+      for (std::size_t i = 0; i < count; ++i)
+      { hashes[i] = std::hash<KeyT>{} (keys[i]); }
+      return;
+    }
+    std::size_t seed = this->_seed;
+    for (std::size_t i = 0; i < count; ++i)
+    { hashes[i] = seeded_hash (keys[i], seed); }
+  }
+
+  /**
+   * Check if the pairs of a map with the given capacity and seed would sit
+   * in the same buckets in this map.
+   */
+  bool shares_layout (std::size_t capacity, std::size_t seed) const
+  { return this->_capacity == capacity && this->_seed == seed; }
+
+  /**
+   * Seeded hash of a generic key.
+   * Keys which collide under std::hash still collide, but their buckets
+   * can't be predicted without the seed.
+   */
+  template<typename K>
+  static std::size_t seeded_hash (const K &key, std::size_t seed)
+  { return (std::size_t) mix ((std::uint64_t) std::hash<K>{} (key) ^ seed); }
+
+  /**
+   * Seeded hash of a string key, SipHash-1-3 of its bytes.
+   * std::hash of a string is unseeded, so colliding strings could be
+   * precomputed, this one can't without the seed.
+   */
+  static std::size_t seeded_hash (const std::string &key, std::size_t seed)
+  {
+    return (std::size_t) sip_hash (key.data (), key.size (), seed,
+                                   mix (seed));
+  }
+
+  /**
+   * 64 bit finalizer (from SplitMix64).
+   */
+  static std::uint64_t mix (std::uint64_t word)
+  {
+    word ^= word >> 30;
+    word *= 0xBF58476D1CE4E5B9ULL;
+    word ^= word >> 27;
+    word *= 0x94D049BB133111EBULL;
+    word ^= word >> 31;
+    return word;
+  }
+
+  static std::uint64_t rotate (std::uint64_t word, int bits)
+  { return (word << bits) | (word >> (64 - bits)); }
+
+  static void sip_round (std::uint64_t &v0, std::uint64_t &v1,
+                         std::uint64_t &v2, std::uint64_t &v3)
+  {
+    v0 += v1;
+    v1 = rotate (v1, 13);
+    v1 ^= v0;
+    v0 = rotate (v0, 32);
+    v2 += v3;
+    v3 = rotate (v3, 16);
+    v3 ^= v2;
+    v0 += v3;
+    v3 = rotate (v3, 21);
+    v3 ^= v0;
+    v2 += v1;
+    v1 = rotate (v1, 17);
+    v1 ^= v2;
+    v2 = rotate (v2, 32);
+  }
+
+  /**
+   * SipHash-1-3 of the given bytes, under the key (k0, k1).
+   */
+  static std::uint64_t sip_hash (const char *data, std::size_t length,
+                                 std::uint64_t k0, std::uint64_t k1)
+  {
+    std::uint64_t v0 = k0 ^ 0x736F6D6570736575ULL;
+    std::uint64_t v1 = k1 ^ 0x646F72616E646F6DULL;
+    std::uint64_t v2 = k0 ^ 0x6C7967656E657261ULL;
+    std::uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+    std::size_t blocks = length / 8;
+    for (std::size_t i = 0; i < blocks; ++i)
+    {
+      std::uint64_t block;
+      std::memcpy (&block, data + i * 8, 8);
+      v3 ^= block;
+      sip_round (v0, v1, v2, v3);
+      v0 ^= block;
+    }
+    std::uint64_t last = (std::uint64_t) length << 56;
+    for (std::size_t i = 0; i < length % 8; ++i)
+    { last |= (std::uint64_t) (unsigned char) data[blocks * 8 + i] << (8 * i); }
+    v3 ^= last;
+    sip_round (v0, v1, v2, v3);
+    v0 ^= last;
+    v2 ^= 0xFF;
+    sip_round (v0, v1, v2, v3);
+    sip_round (v0, v1, v2, v3);
+    sip_round (v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+  }
+
+  /**
+   * Index the pairs of the given bucket by hash, see bucket::treeify.
+   */
+  void treeify (bucket *bucket_ptr) const
+  {
+    bucket_ptr->treeify ([this] (const KeyT &key)
+                         { return this->hash_key (key); });
+  }
+
+  /**
+   * Register the last node of the bucket list (just added to it), and index
+   * the bucket by hash once its chain passes TREEIFY_THRESHOLD.
+   * @param bucket_ptr Pointer to bucket object.
+   */
+  void link_last (bucket *bucket_ptr)
+  {
+    bool hashed = this->_filter || bucket_ptr->is_tree ();
+    this->link_last (bucket_ptr, hashed ? this->hash_key (
+        bucket_ptr->get_bucket ().back ().first) : 0);
+  }
+
+  /**
+   * Register the last node of the bucket list, see link_last above, for
+   * callers which already hashed its key.
+   * @param bucket_ptr Pointer to bucket object.
+   * @param hash Hash of the key of the last node.
+   */
+  void link_last (bucket *bucket_ptr, std::size_t hash)
+  {
+    if (this->_filter)
+    { this->_filter->add (hash); }
+    if (bucket_ptr->is_tree ())
+    { bucket_ptr->link_last (hash); }
+    else if (bucket_ptr->get_bucket ().size () > TREEIFY_THRESHOLD)
+    { this->treeify (bucket_ptr); }
+  }
+
+  /**
+   * Erase a node of the bucket list, dropping the index of the bucket once
+   * its chain is back to UNTREEIFY_THRESHOLD.
+   * @param bucket_ptr Pointer to bucket object.
+   * @param node Iterator to the node.
+   * @return Iterator to the next node.
+   */
+  typename std::list<std::pair<KeyT, ValueT>>::iterator
+  remove_node (bucket *bucket_ptr,
+               typename std::list<std::pair<KeyT, ValueT>>::iterator node)
+  {
+    return this->remove_node (bucket_ptr, node,
+                              bucket_ptr->is_tree () ? this->hash_key (node->first)
+                                                     : 0);
+  }
+
+  /**
+   * Erase a node of the bucket list, see remove_node above, for callers
+   * which already hashed its key.
+   * @param bucket_ptr Pointer to bucket object.
+   * @param node Iterator to the node.
+   * @param hash Hash of the key of the node.
+   * @return Iterator to the next node.
+   */
+  typename std::list<std::pair<KeyT, ValueT>>::iterator
+  remove_node (bucket *bucket_ptr,
+               typename std::list<std::pair<KeyT, ValueT>>::iterator node,
+               std::size_t hash)
+  {
+    if (bucket_ptr->is_tree ())
+    { bucket_ptr->unlink (node, hash); }
+    auto next = bucket_ptr->get_bucket ().erase (node);
+    if (bucket_ptr->get_bucket ().size () <= UNTREEIFY_THRESHOLD)
+    { bucket_ptr->untreeify (); }
+    // Erased keys still pass the filter, which is rebuilt once they are as
+    // many as half the keys it was sized for
+    if (this->_filter
+        && ++this->_filter_stale > filter_keys (this->_capacity) / 2)
+    { this->rebuild_filter (); }
+    return next;
+  }
+
+  /**
+   * Number of keys the filter of a table is sized for, the most the table
+   * holds before growing.
+   * @param capacity Capacity of the table.
+   * @return Size_t value.
+   */
+  static std::size_t filter_keys (std::size_t capacity)
+  { return (std::size_t) ((double) capacity * TOP_THRESHOLD); }
+
+  /**
+   * Refill the filter with the keys of the map, sized for the capacity.
+   */
+  void rebuild_filter ()
+  {
+    std::unique_ptr<blocked_bloom_filter> filter (new blocked_bloom_filter (
+        filter_keys (this->_capacity), this->_filter->false_positive_rate ()));
+    for (std::size_t i = 0; i < this->_capacity; ++i)
+    {
+      for (const auto &pair: this->_bucket_list[i].get_bucket ())
+      { filter->add (this->hash_key (pair.first)); }
+    }
+    this->_filter = std::move (filter);
+    this->_filter_stale = 0;
+  }
+
+  /**
+   * Add a pair to the digest, if it is tracked and up to date.
+   */
+  void digest_add (const KeyT &key, const ValueT &value)
+  {
+    if (this->_digest_valid)
+    { this->_digest += pair_digest (key, value, 0); }
+  }
+
+  /**
+   * Remove a pair from the digest, if it is tracked and up to date.
+   */
+  void digest_sub (const KeyT &key, const ValueT &value)
+  {
+    if (this->_digest_valid)
+    { this->_digest -= pair_digest (key, value, 0); }
+  }
+
+  /**
+   * Mix the hashes of a key and its value into a single word.
+   * The digest is the sum of these words, so it doesn't depend on the order
+   * of the pairs, and a pair can be removed by subtracting its word.
+   */
+  template<typename V = ValueT>
+  static auto pair_digest (const KeyT &key, const V &value, int)
+  -> decltype (std::hash<V>{} (value), std::uint64_t ())
+  {
+    std::uint64_t word = (std::uint64_t) std::hash<KeyT>{} (key)
+                         * 0x9E3779B97F4A7C15ULL;
+    word ^= (std::uint64_t) std::hash<V>{} (value) + 0x632BE59BD9B4E019ULL
+            + (word << 6) + (word >> 2);
+    word ^= word >> 31;
+    word *= 0xBF58476D1CE4E5B9ULL;
+    word ^= word >> 29;
+    return word;
+  }
+
+  template<typename V = ValueT>
+  static std::uint64_t pair_digest (const KeyT &, const V &, long)
+  { return 0; }
+
+  template<typename V>
+  static auto probe_hash (int)
+  -> decltype (std::hash<V>{} (std::declval<const V &> ()), std::true_type ());
+
+  template<typename V>
+  static std::false_type probe_hash (long);
+
+  /**
+   * Give back the surplus of a reservation made before duplicate keys were
+   * known, so the capacity ends where adding the pairs one at a time would
+   * leave it.
+   * @param exponent Exponent before the reservation.
+   */
+  void fit_reservation (int exponent)
+  {
+    int needed = exponent_for (this->_size, exponent);
+    if (needed < this->_exponent)
+    { this->re_hashing_to (needed); }
+  }
+
+  /**
+   * The smallest exponent, not below the given one, whose capacity holds
+   * count pairs under TOP_THRESHOLD. The capacity is an integer shift, no
+   * floating point pow.
+   */
+  static int exponent_for (std::size_t count, int exponent)
+  {
+    while ((double) count / (double) ((std::size_t) 1 << exponent)
+           > TOP_THRESHOLD)
+    { ++exponent; }
+    return exponent;
   }
 
   /**
    * Increase or decrease capacity (memory) for buckets in HashMap.
-   * After the capacity change, calculate new bucket index for each pair,
-   * and insert them again.
    * @param operation String type variable.
    */
   void re_hashing (const std::string &operation)
   {
-    int old_capacity = this->_capacity;
-    int old_size = this->_size;
+    int exponent = this->_exponent;
     if (operation == "increase")
-    { ++this->_exponent; }
+    { ++exponent; }
     else if (operation == "decrease")
-    { --this->_exponent; }
-    int new_capacity = std::pow (2, this->_exponent);
-    auto *temp = new bucket[new_capacity];
-    for (int i = 0; i < old_capacity; ++i)
-    {
-      bucket *old_bucket_ptr = &this->_bucket_list[i];
-      auto pair = old_bucket_ptr->get_bucket ().begin ();
-      while (pair != old_bucket_ptr->get_bucket ().end ())
+    { --exponent; }
+    this->re_hashing_to (exponent);
+  }
+
+  /**
+   * Change the capacity to 2^exponent buckets.
+   * After the capacity change, calculate new bucket index for each pair,
+   * and splice its list node into the new bucket, so no pair is copied.
+   * @param exponent Int type variable.
+   */
+  void re_hashing_to (int exponent)
+  { this->re_hashing_to (exponent, this->_table_policy); }
+
+  /**
+   * Change the capacity to 2^exponent buckets, in an array allocated with
+   * the given policy.
+   * @param exponent Int type variable.
+   * @param policy Allocation policy.
+   */
+  void re_hashing_to (int exponent, const table_policy &policy)
+  {
+    std::size_t new_capacity = (std::size_t) 1 << exponent;
+    std::unique_ptr<blocked_bloom_filter> filter;
+    if (this->_filter)
+    {
+      // Refilled by link_last as the pairs move
+      filter.reset (new blocked_bloom_filter (
+          filter_keys (new_capacity), this->_filter->false_positive_rate ()));
+    }
+    bucket *temp = allocate_buckets (new_capacity, policy);
+    if (filter)
+    {
+      this->_filter = std::move (filter);
+      this->_filter_stale = 0;
+    }
+    for (std::size_t i = 0; i < this->_capacity; ++i)
+    {
+      bucket_data &old_bucket = this->_bucket_list[i].get_bucket ();
+      while (!old_bucket.empty ())
       {
-        std::size_t index =
-            std::hash<KeyT>{} (pair->first) & (new_capacity - 1);
-        bucket *new_bucket_ptr = &temp[index];
-        new_bucket_ptr->update_bucket (pair->first, pair->second);
-        ++pair;
+        std::size_t hash = this->hash_key (old_bucket.front ().first);
+        bucket *bucket_ptr = &temp[hash & (new_capacity - 1)];
+        bucket_data &new_bucket = bucket_ptr->get_bucket ();
+        new_bucket.splice (new_bucket.end (), old_bucket, old_bucket.begin ());
+        this->link_last (bucket_ptr, hash);
       }
     }
 
-    this->clear ();
-    delete[] this->_bucket_list;
-    this->_capacity = new_capacity;
-    this->_size = old_size;
+    free_buckets (this->_bucket_list, this->_capacity, this->_table_policy);
     this->_bucket_list = temp;
+    this->_capacity = new_capacity;
+    this->_exponent = exponent;
+    this->_table_policy = policy;
+  }
+
+  /**
+   * Allocate an array of empty buckets, mapped if the policy asks for it.
+   * @param count Number of buckets.
+   * @param policy Allocation policy.
+   * @return Pointer to the array, released by free_buckets.
+   */
+  static bucket *allocate_buckets (std::size_t count,
+                                   const table_policy &policy)
+  {
+    std::size_t bytes = count * sizeof (bucket);
+    if (!maps_table (bytes, policy))
+    { return new bucket[count]; }
+    auto *table = static_cast<bucket *> (map_table (bytes, policy));
+    // The buckets are constructed after the NUMA policy is set, so their
+    // first touch already lands on the right nodes
+    for (std::size_t i = 0; i < count; ++i)
+    { new (&table[i]) bucket (); }
+    return table;
+  }
+
+  /**
+   * Release an array from allocate_buckets. The shared empty table is never
+   * released.
+   * @param table Pointer to the array.
+   * @param count Number of buckets.
+   * @param policy Allocation policy the array was allocated with.
+   */
+  static void free_buckets (bucket *table, std::size_t count,
+                            const table_policy &policy)
+  {
+    if (table == empty_table ())
+    { return; }
+    std::size_t bytes = count * sizeof (bucket);
+    if (!maps_table (bytes, policy))
+    {
+      delete[] table;
+      return;
+    }
+    for (std::size_t i = 0; i < count; ++i)
+    { table[i].~bucket (); }
+    unmap_table (table, bytes);
+  }
+
+  /**
+   * The START_CAPACITY empty buckets every default constructed map points
+   * to until its first insert. Lookups and iteration read it like any other
+   * table, it is never written to.
+   * @return Pointer to the shared array.
+   */
+  static bucket *empty_table ()
+  {
+    static bucket table[START_CAPACITY];
+    return table;
+  }
+
+  /**
+   * Give the map a bucket array of its own, if it still points to the
+   * shared empty table. Must run before any bucket is written to.
+   */
+  void own_table ()
+  {
+    if (this->_bucket_list == empty_table ())
+    {
+      this->_bucket_list = allocate_buckets (this->_capacity,
+                                             this->_table_policy);
+    }
+  }
+
+  /**
+   * Add a pair whose key is known to be missing, growing if needed.
+   * @param hash Hash of the key.
+   * @param key Generic type variable.
+   * @param value Generic type variable.
+   * @return Pointer to the new pair, which keeps its address until erased.
+   */
+  std::pair<KeyT, ValueT> *add_missing (std::size_t hash, const KeyT &key,
+                                        const ValueT &value)
+  {
+    ++this->_size;
+    if (this->get_load_factor () > TOP_THRESHOLD)
+    { this->re_hashing ("increase"); }
+    this->own_table ();
+    bucket *bucket_ptr = &this->_bucket_list[hash & (this->_capacity - 1)];
+    bucket_ptr->update_bucket (key, value);
+    this->link_last (bucket_ptr, hash);
+    this->digest_add (key, value);
+    return &bucket_ptr->get_bucket ().back ();
+  }
+
+  /**
+   * Empties the source of a move merge on leaving the scope, also when a
+   * combine throws half way, since its nodes are spliced one at a time.
+   */
+  struct clear_guard
+  {
+    HashMap<KeyT, ValueT> &map;
+
+    ~clear_guard ()
+    { this->map.clear (); }
+  };
+
+  /**
+   * Conflict resolver of a merge policy.
+   */
+  struct policy_resolver
+  {
+    merge_policy policy;
+
+    template<typename V>
+    void operator() (ValueT &existing, V &&incoming)
+    {
+      if (this->policy == OVERWRITE)
+      { existing = std::forward<V> (incoming); }
+    }
+  };
+
+  /**
+   * Conflict resolver of a user combine function.
+   */
+  template<typename Combine>
+  struct combine_resolver
+  {
+    Combine combine;
+
+    template<typename V>
+    void operator() (ValueT &existing, V &&incoming)
+    { existing = this->combine (existing, incoming); }
+  };
+
+  /**
+   * Merge a range of pairs, see merge (It, It, merge_policy).
+   */
+  template<typename It, typename Resolve>
+  void merge_range (It begin, It end, Resolve resolve)
+  {
+    typedef typename std::iterator_traits<It>::iterator_category category;
+    int exponent = this->_exponent;
+    if (std::is_base_of<std::forward_iterator_tag, category>::value)
+    { this->reserve (this->_size + (std::size_t) std::distance (begin, end)); }
+    for (; begin != end; ++begin)
+    {
+      std::size_t hash = this->hash_key (begin->first);
+      std::pair<KeyT, ValueT> *pair_ptr = this->find_in_bucket (
+          begin->first, &this->_bucket_list[hash & (this->_capacity - 1)],
+          hash);
+      if (pair_ptr == nullptr)
+      {
+        this->add_missing (hash, begin->first, begin->second);
+        continue;
+      }
+      this->digest_sub (pair_ptr->first, pair_ptr->second);
+      resolve (pair_ptr->second, begin->second);
+      this->digest_add (pair_ptr->first, pair_ptr->second);
+    }
+    this->fit_reservation (exponent);
+  }
+
+  /**
+   * Merge every pair of the given bucket array into this map.
+   * Missing keys are added, and conflicting keys are handed to resolve
+   * together with the incoming value.
+   * If steal is set, the list nodes of the source are spliced instead of
+   * copied, and the incoming values are moved.
+   * @param buckets Bucket array of the source map.
+   * @param capacity Capacity of the source map.
+   * @param seed Hash seed of the source map.
+   * @param steal Boolean type variable.
+   * @param resolve Callable of (ValueT &existing, incoming value).
+   */
+  template<typename Resolve>
+  void merge_buckets (bucket *buckets, std::size_t capacity, std::size_t seed,
+                      bool steal, Resolve resolve)
+  {
+    bool same_layout = this->shares_layout (capacity, seed);
+    for (std::size_t i = 0; i < capacity; ++i)
+    {
+      bucket_data &source = buckets[i].get_bucket ();
+      auto it = source.begin ();
+      while (it != source.end ())
+      {
+        auto next = std::next (it);
+        // Sources of the same layout keep their bucket, no hash needed
+        // unless the filter or a bucket index wants it
+        bool hashed = !same_layout || this->_filter
+                      || this->_bucket_list[i].is_tree ();
+        std::size_t hash = hashed ? this->hash_key (it->first) : 0;
+        bucket *target_ptr = same_layout ? &this->_bucket_list[i]
+            : &this->_bucket_list[hash & (this->_capacity - 1)];
+        bucket_data &target = target_ptr->get_bucket ();
+        std::pair<KeyT, ValueT> *pair_ptr = hashed
+            ? this->find_in_bucket (it->first, target_ptr, hash)
+            : this->find_in_bucket (it->first, target_ptr);
+        if (pair_ptr == nullptr)
+        {
+          if (steal)
+          { target.splice (target.end (), source, it); }
+          else
+          { target.push_back (*it); }
+          this->link_last (target_ptr, hash);
+          ++this->_size;
+          this->digest_add (target.back ().first, target.back ().second);
+        }
+        else
+        {
+          this->digest_sub (pair_ptr->first, pair_ptr->second);
+          try
+          {
+            if (steal)
+            { resolve (pair_ptr->second, std::move (it->second)); }
+            else
+            { resolve (pair_ptr->second, it->second); }
+          }
+          catch (...)
+          {
+            this->digest_add (pair_ptr->first, pair_ptr->second);
+            throw;
+          }
+          this->digest_add (pair_ptr->first, pair_ptr->second);
+        }
+        it = next;
+      }
+    }
   }
 
  private:
@@ -432,10 +1686,73 @@ class HashMap
    * Each bucket has member variable from type bucket_data.
    */
   typedef std::list<std::pair<KeyT, ValueT>> bucket_data;
+
+  /**
+   * Entry of a bucket index: a list node and the hash of its key.
+   */
+  struct tree_node
+  {
+    std::size_t hash;
+    typename bucket_data::iterator node;
+  };
+
+  /**
+   * A key looked up in a bucket index.
+   */
+  struct tree_probe
+  {
+    std::size_t hash;
+    const KeyT *key;
+  };
+
+  /**
+   * Order of a bucket index: by hash, then by key if the keys have
+   * operator<, so keys whose whole hashes collide (plain std::hash is easy
+   * to flood) are still found in O(log n). Keys without operator< share a
+   * single run per hash, which is scanned.
+   */
+  struct tree_order
+  {
+    typedef void is_transparent;
+
+    bool operator() (const tree_node &lhs, const tree_node &rhs) const
+    { return less (lhs.hash, lhs.node->first, rhs.hash, rhs.node->first); }
+
+    bool operator() (const tree_node &lhs, const tree_probe &rhs) const
+    { return less (lhs.hash, lhs.node->first, rhs.hash, *rhs.key); }
+
+    bool operator() (const tree_probe &lhs, const tree_node &rhs) const
+    { return less (lhs.hash, *lhs.key, rhs.hash, rhs.node->first); }
+
+    static bool less (std::size_t lhs_hash, const KeyT &lhs_key,
+                      std::size_t rhs_hash, const KeyT &rhs_key)
+    {
+      if (lhs_hash != rhs_hash)
+      { return lhs_hash < rhs_hash; }
+      return key_less (lhs_key, rhs_key, 0);
+    }
+
+    template<typename K>
+    static auto key_less (const K &lhs, const K &rhs, int)
+    -> decltype ((void) (lhs < rhs), bool ())
+    { return lhs < rhs; }
+
+    template<typename K>
+    static bool key_less (const K &, const K &, long)
+    { return false; }
+  };
+
+  typedef std::multiset<tree_node, tree_order> bucket_tree;
   class bucket
   {
    private:
     bucket_data _bucket;
+    /**
+     * Index of the list nodes by hash and key (see tree_order), only for
+     * chains which passed TREEIFY_THRESHOLD, so even a flooded bucket is
+     * searched in O(log n).
+     */
+    std::unique_ptr<bucket_tree> _tree;
 
    public:
     /**
@@ -466,6 +1783,85 @@ class HashMap
       this->_bucket.push_back (std::make_pair (key, value));
     }
 
+    /**
+     * Check if the bucket is indexed by hash.
+     */
+    bool is_tree () const
+    { return this->_tree != nullptr; }
+
+    /**
+     * Find the node of the given key.
+     * @param key Generic type variable.
+     * @param hash Hash of the key, only used if the bucket is indexed.
+     * @return Iterator to the node, or the end of the list.
+     */
+    typename bucket_data::iterator find (const KeyT &key, std::size_t hash)
+    {
+      if (this->_tree)
+      {
+        auto range = this->_tree->equal_range (tree_probe {hash, &key});
+        for (auto it = range.first; it != range.second; ++it)
+        {
+          if (it->node->first == key)
+          { return it->node; }
+        }
+        return this->_bucket.end ();
+      }
+      for (auto it = this->_bucket.begin (); it != this->_bucket.end (); ++it)
+      {
+        if (it->first == key)
+        { return it; }
+      }
+      return this->_bucket.end ();
+    }
+
+    /**
+     * Index all the nodes by hash.
+     * @param hash_of Callable giving the hash of a key.
+     */
+    template<typename Hash>
+    void treeify (Hash hash_of)
+    {
+      std::unique_ptr<bucket_tree> tree (new bucket_tree ());
+      for (auto it = this->_bucket.begin (); it != this->_bucket.end (); ++it)
+      { tree->insert (tree_node {hash_of (it->first), it}); }
+      this->_tree = std::move (tree);
+    }
+
+    void untreeify ()
+    { this->_tree.reset (); }
+
+    /**
+     * Index the last node of the list.
+     */
+    void link_last (std::size_t hash)
+    { this->_tree->insert (tree_node {hash, std::prev (this->_bucket.end ())}); }
+
+    /**
+     * Drop a node from the index, before it leaves the list.
+     */
+    void unlink (typename bucket_data::iterator node, std::size_t hash)
+    {
+      auto range = this->_tree->equal_range (tree_probe {hash, &node->first});
+      for (auto it = range.first; it != range.second; ++it)
+      {
+        if (it->node == node)
+        {
+          this->_tree->erase (it);
+          return;
+        }
+      }
+    }
+
+    /**
+     * Remove all the nodes.
+     */
+    void clear ()
+    {
+      this->_bucket.clear ();
+      this->_tree.reset ();
+    }
+
     /**
      *
      * @param rhs
@@ -513,9 +1909,9 @@ class HashMap
   {
     friend class HashMap<KeyT, ValueT>;
    private:
-    const HashMap<KeyT, ValueT> &_map_container;
-    int _bucket_index;
-    int _pair_index;
+    const HashMap<KeyT, ValueT> *_map_container;
+    std::size_t _bucket_index;
+    std::size_t _pair_index;
 
    public:
     typedef std::forward_iterator_tag iterator_category;
@@ -524,25 +1920,25 @@ class HashMap
     typedef T *pointer;
     typedef std::ptrdiff_t difference_type;
 
-    explicit iterator_t (const HashMap<KeyT, ValueT> &map_container, int
-    bucket_index, int pair_index) :
-        _map_container (map_container),
+    explicit iterator_t (const HashMap<KeyT, ValueT> &map_container,
+                         std::size_t bucket_index, std::size_t pair_index) :
+        _map_container (&map_container),
         _bucket_index (bucket_index),
         _pair_index (pair_index)
     {
       bucket *cur_bucket = &this->_map_container
-          ._bucket_list[this->_bucket_index];
-      while (this->_bucket_index != this->_map_container.capacity() && cur_bucket->get_bucket ().empty ())
+          ->_bucket_list[this->_bucket_index];
+      while (this->_bucket_index != this->_map_container->capacity() && cur_bucket->get_bucket ().empty ())
       {
         ++this->_bucket_index;
-        cur_bucket = &this->_map_container._bucket_list[this->_bucket_index];
+        cur_bucket = &this->_map_container->_bucket_list[this->_bucket_index];
       }
     }
 
-    reference operator* ()
+    reference operator* () const
     {
       bucket *cur_bucket = &this->_map_container
-          ._bucket_list[this->_bucket_index];
+          ->_bucket_list[this->_bucket_index];
       auto cur_pair = cur_bucket->get_bucket ().begin ();
       std::advance (cur_pair, this->_pair_index);
 //      while (cur_pair.operator-> () == nullptr)
@@ -553,31 +1949,23 @@ class HashMap
       return *cur_pair;
     }
 
-    value_type operator* () const
-    {
-      const bucket &cur_bucket = this->_map_container[this->_bucket_index];
-      auto cur_pair = cur_bucket.get_bucket ().begin ();
-      std::advance (cur_pair, this->_pair_index);
-      return cur_pair.operator* ();
-    }
-
     iterator_t &operator++ ()
     {
-      if (this->_bucket_index < this->_map_container.capacity ())
+      if (this->_bucket_index < this->_map_container->capacity ())
       {
-        bucket *cur_bucket = &this->_map_container.
+        bucket *cur_bucket = &this->_map_container->
             _bucket_list[this->_bucket_index];
         ++this->_pair_index;
-        if (this->_pair_index >= (int) cur_bucket->get_bucket ().size ())
+        if (this->_pair_index >= cur_bucket->get_bucket ().size ())
         {
           this->_pair_index = 0;
           do
           {
             ++this->_bucket_index;
-            if (this->_bucket_index >= this->_map_container.capacity ())
+            if (this->_bucket_index >= this->_map_container->capacity ())
             { return *this; }
             cur_bucket = &this->_map_container
-                ._bucket_list[this->_bucket_index];
+                ->_bucket_list[this->_bucket_index];
           }
           while (cur_bucket->get_bucket ().empty ());
         }
@@ -592,15 +1980,12 @@ class HashMap
       return it;
     }
 
-    pointer operator-> ()
-    { return &(this->operator* ()); }
-
     pointer operator-> () const
     { return &(this->operator* ()); }
 
     bool operator== (const iterator_t &rhs) const
     {
-      return (&this->_map_container == &rhs._map_container)
+      return (this->_map_container == rhs._map_container)
              && (this->_bucket_index == rhs._bucket_index)
              && (this->_pair_index == rhs._pair_index);
     }
@@ -0,0 +1,842 @@
+#include "HashMap.hpp"
+#include <limits>
+#include <new>
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#include <immintrin.h>
+#define SIMD_X86 1
+#else
+#define SIMD_X86 0
+#endif
+
+#ifndef _INTEGRALHASHMAP_HPP_
+#define _INTEGRALHASHMAP_HPP_
+#define GROUP_BYTES 64
+#define INTEGRAL_TOP_THRESHOLD (7.0 / 8.0)
+
+/**
+ * Instruction sets the group scans can use, from the slowest to the
+ * fastest.
+ */
+enum simd_level
+{
+  SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512
+};
+
+/**
+ * The best instruction set of the running CPU, detected once.
+ * @return simd_level value.
+ */
+inline simd_level detected_simd_level ()
+{
+#if SIMD_X86
+  static const simd_level level = __builtin_cpu_supports ("avx512f")
+                                  ? SIMD_AVX512
+                                  : __builtin_cpu_supports ("avx2")
+                                    ? SIMD_AVX2
+                                    : __builtin_cpu_supports ("sse2")
+                                      ? SIMD_SSE2 : SIMD_SCALAR;
+  return level;
+#else
+  return SIMD_SCALAR;
+#endif
+}
+
+/**
+ * Compare the keys of a 64 byte group with key and with the empty key.
+ * Every kernel returns the slots equal to key in the low 32 bits, and the
+ * empty slots in the high 32 bits, bit i standing for slot i.
+ */
+template<typename T>
+inline std::uint64_t scan_group_scalar (const T *group, T key, T empty)
+{
+  std::uint32_t match = 0;
+  std::uint32_t free = 0;
+  for (std::size_t i = 0; i < GROUP_BYTES / sizeof (T); ++i)
+  {
+    match |= (std::uint32_t) (group[i] == key) << i;
+    free |= (std::uint32_t) (group[i] == empty) << i;
+  }
+  return match | (std::uint64_t) free << 32;
+}
+
+#if SIMD_X86
+__attribute__ ((target ("sse2")))
+inline std::uint64_t scan_group_sse2 (const std::uint32_t *group,
+                                      std::uint32_t key, std::uint32_t empty)
+{
+  __m128i keys = _mm_set1_epi32 ((int) key);
+  __m128i empties = _mm_set1_epi32 ((int) empty);
+  std::uint32_t match = 0;
+  std::uint32_t free = 0;
+  for (int i = 0; i < 4; ++i)
+  {
+    __m128i slots = _mm_load_si128 ((const __m128i *) group + i);
+    match |= (std::uint32_t) _mm_movemask_ps (
+        _mm_castsi128_ps (_mm_cmpeq_epi32 (slots, keys))) << (4 * i);
+    free |= (std::uint32_t) _mm_movemask_ps (
+        _mm_castsi128_ps (_mm_cmpeq_epi32 (slots, empties))) << (4 * i);
+  }
+  return match | (std::uint64_t) free << 32;
+}
+
+__attribute__ ((target ("sse2")))
+inline std::uint64_t scan_group_sse2 (const std::uint64_t *group,
+                                      std::uint64_t key, std::uint64_t empty)
+{
+  __m128i keys = _mm_set1_epi64x ((long long) key);
+  __m128i empties = _mm_set1_epi64x ((long long) empty);
+  std::uint32_t match = 0;
+  std::uint32_t free = 0;
+  for (int i = 0; i < 4; ++i)
+  {
+    __m128i slots = _mm_load_si128 ((const __m128i *) group + i);
+    // SSE2 has no 64 bit compare, both 32 bit halves have to match
+    __m128i same = _mm_cmpeq_epi32 (slots, keys);
+    same = _mm_and_si128 (same, _mm_shuffle_epi32 (same, 0xB1));
+    __m128i unused = _mm_cmpeq_epi32 (slots, empties);
+    unused = _mm_and_si128 (unused, _mm_shuffle_epi32 (unused, 0xB1));
+    match |= (std::uint32_t) _mm_movemask_pd (_mm_castsi128_pd (same))
+             << (2 * i);
+    free |= (std::uint32_t) _mm_movemask_pd (_mm_castsi128_pd (unused))
+            << (2 * i);
+  }
+  return match | (std::uint64_t) free << 32;
+}
+
+__attribute__ ((target ("avx2")))
+inline std::uint64_t scan_group_avx2 (const std::uint32_t *group,
+                                      std::uint32_t key, std::uint32_t empty)
+{
+  __m256i keys = _mm256_set1_epi32 ((int) key);
+  __m256i empties = _mm256_set1_epi32 ((int) empty);
+  std::uint32_t match = 0;
+  std::uint32_t free = 0;
+  for (int i = 0; i < 2; ++i)
+  {
+    __m256i slots = _mm256_load_si256 ((const __m256i *) group + i);
+    match |= (std::uint32_t) _mm256_movemask_ps (
+        _mm256_castsi256_ps (_mm256_cmpeq_epi32 (slots, keys))) << (8 * i);
+    free |= (std::uint32_t) _mm256_movemask_ps (
+        _mm256_castsi256_ps (_mm256_cmpeq_epi32 (slots, empties))) << (8 * i);
+  }
+  return match | (std::uint64_t) free << 32;
+}
+
+__attribute__ ((target ("avx2")))
+inline std::uint64_t scan_group_avx2 (const std::uint64_t *group,
+                                      std::uint64_t key, std::uint64_t empty)
+{
+  __m256i keys = _mm256_set1_epi64x ((long long) key);
+  __m256i empties = _mm256_set1_epi64x ((long long) empty);
+  std::uint32_t match = 0;
+  std::uint32_t free = 0;
+  for (int i = 0; i < 2; ++i)
+  {
+    __m256i slots = _mm256_load_si256 ((const __m256i *) group + i);
+    match |= (std::uint32_t) _mm256_movemask_pd (
+        _mm256_castsi256_pd (_mm256_cmpeq_epi64 (slots, keys))) << (4 * i);
+    free |= (std::uint32_t) _mm256_movemask_pd (
+        _mm256_castsi256_pd (_mm256_cmpeq_epi64 (slots, empties))) << (4 * i);
+  }
+  return match | (std::uint64_t) free << 32;
+}
+
+__attribute__ ((target ("avx512f")))
+inline std::uint64_t scan_group_avx512 (const std::uint32_t *group,
+                                        std::uint32_t key, std::uint32_t empty)
+{
+  __m512i slots = _mm512_load_si512 (group);
+  std::uint32_t match = _mm512_cmpeq_epi32_mask (
+      slots, _mm512_set1_epi32 ((int) key));
+  std::uint32_t free = _mm512_cmpeq_epi32_mask (
+      slots, _mm512_set1_epi32 ((int) empty));
+  return match | (std::uint64_t) free << 32;
+}
+
+__attribute__ ((target ("avx512f")))
+inline std::uint64_t scan_group_avx512 (const std::uint64_t *group,
+                                        std::uint64_t key, std::uint64_t empty)
+{
+  __m512i slots = _mm512_load_si512 (group);
+  std::uint32_t match = _mm512_cmpeq_epi64_mask (
+      slots, _mm512_set1_epi64 ((long long) key));
+  std::uint32_t free = _mm512_cmpeq_epi64_mask (
+      slots, _mm512_set1_epi64 ((long long) empty));
+  return match | (std::uint64_t) free << 32;
+}
+#endif
+
+/**
+ * Scan a group with the kernel of the given level, see scan_group_scalar.
+ * @param level Instruction set, at most detected_simd_level ().
+ * @param group Pointer to a 64 byte aligned group of keys.
+ * @param key Key to find.
+ * @param empty Key of the empty slots.
+ * @return Match and empty masks.
+ */
+template<typename T>
+inline std::uint64_t scan_group (simd_level level, const T *group, T key,
+                                 T empty)
+{
+#if SIMD_X86
+  switch (level)
+  {
+    case SIMD_AVX512:
+      return scan_group_avx512 (group, key, empty);
+    case SIMD_AVX2:
+      return scan_group_avx2 (group, key, empty);
+    case SIMD_SSE2:
+      return scan_group_sse2 (group, key, empty);
+    default:
+      break;
+  }
+#endif
+  return scan_group_scalar (group, key, empty);
+}
+
+/**
+ * Keys which IntegralHashMap can pack: 32 and 64 bit integers.
+ */
+template<typename KeyT>
+struct is_packable_key
+    : std::integral_constant<bool, std::is_integral<KeyT>::value
+                                   && !std::is_same<KeyT, bool>::value
+                                   && (sizeof (KeyT) == 4
+                                       || sizeof (KeyT) == 8)> {};
+
+/**
+ * Open addressing map for integral keys, scanning 64 bytes of keys (16
+ * 32 bit or 8 64 bit keys) per lookup step with SIMD compares.
+ * The keys are packed in their own array, split in 64 byte groups, and the
+ * values live in a parallel array. A key probes from the first slot of its
+ * home group onwards, one whole group at a time: a group holding the key
+ * is a hit, a group with an empty slot ends a miss. Empty slots hold a
+ * sentinel key (the minimum of signed types, the maximum of unsigned ones)
+ * rather than per-slot metadata; the sentinel itself is stored apart.
+ * Erase shifts the following keys of the cluster back (no tombstones).
+ * The kernel (SSE2, AVX2 or AVX-512) is picked at run time, see
+ * detected_simd_level ().
+ * Use FastHashMap to get this map for integral keys and HashMap otherwise.
+ */
+template<typename KeyT, typename ValueT>
+class IntegralHashMap
+{
+  static_assert (is_packable_key<KeyT>::value,
+                 "IntegralHashMap needs 32 or 64 bit integral keys.");
+
+  class iterator_t;
+  typedef typename std::conditional<sizeof (KeyT) == 4, std::uint32_t,
+                                    std::uint64_t>::type bits_type;
+
+ public:
+  typedef iterator_t const_iterator;
+
+  IntegralHashMap () : _block (nullptr), _keys (nullptr), _values (nullptr),
+                       _capacity (0), _size (0), _exponent (0),
+                       _simd (detected_simd_level ())
+  { this->allocate (min_exponent ()); }
+
+  IntegralHashMap (const std::vector<KeyT> &keys_vector,
+                   const std::vector<ValueT> &values_vector)
+      : IntegralHashMap ()
+  {
+    if (keys_vector.size () != values_vector.size ())
+    { throw std::length_error ("The size of the vectors is unmatched."); }
+    this->reserve (keys_vector.size ());
+    for (std::size_t i = 0; i < keys_vector.size (); ++i)
+    { this->insert_or_assign (keys_vector[i], values_vector[i]); }
+  }
+
+  /**
+   * Copy ctor.
+   * Clones the key array as is, every pair keeps its slot.
+   * @param other IntegralHashMap to copy.
+   */
+  IntegralHashMap (const IntegralHashMap<KeyT, ValueT> &other)
+      : _block (nullptr), _keys (nullptr), _values (nullptr), _capacity (0),
+        _size (0), _exponent (0), _simd (other._simd)
+  {
+    this->allocate (other._exponent);
+    try
+    {
+      for (std::size_t i = 0; i < other._capacity; ++i)
+      {
+        if (other._keys[i] != empty_bits ())
+        {
+          new (&this->_values[i]) ValueT (other._values[i]);
+          this->_keys[i] = other._keys[i];
+          ++this->_size;
+        }
+      }
+      if (other._empty_key_value)
+      {
+        this->_empty_key_value.reset (new ValueT (*other._empty_key_value));
+        ++this->_size;
+      }
+    }
+    catch (...)
+    {
+      this->clear ();
+      this->release ();
+      throw;
+    }
+  }
+
+  ~IntegralHashMap ()
+  {
+    this->clear ();
+    this->release ();
+  }
+
+  IntegralHashMap<KeyT, ValueT> &operator= (IntegralHashMap<KeyT, ValueT> rhs)
+  {
+    swap (*this, rhs);
+    return *this;
+  }
+
+  friend void swap (IntegralHashMap<KeyT, ValueT> &src,
+                    IntegralHashMap<KeyT, ValueT> &dst)
+  {
+    std::swap (src._block, dst._block);
+    std::swap (src._keys, dst._keys);
+    std::swap (src._values, dst._values);
+    std::swap (src._capacity, dst._capacity);
+    std::swap (src._size, dst._size);
+    std::swap (src._exponent, dst._exponent);
+    std::swap (src._simd, dst._simd);
+    std::swap (src._empty_key_value, dst._empty_key_value);
+  }
+
+  /**
+   * Size of elements inside the map.
+   * @return Size_t value.
+   */
+  std::size_t size () const
+  { return this->_size; }
+
+  /**
+   * Number of slots of the map.
+   * @return Size_t value.
+   */
+  std::size_t capacity () const
+  { return this->_capacity; }
+
+  /**
+   * Check if the map is empty.
+   * @return Boolean value.
+   */
+  bool empty () const
+  { return this->_size == 0; }
+
+  double get_load_factor () const
+  { return (double) this->_size / (double) this->_capacity; }
+
+  /**
+   * The instruction set the group scans use.
+   * @return simd_level value.
+   */
+  simd_level get_simd_level () const
+  { return this->_simd; }
+
+  /**
+   * Scan groups with the given instruction set, or the best one the CPU
+   * has if it lacks the given one. Meant to compare the kernels.
+   * @param level Instruction set.
+   */
+  void use_simd_level (simd_level level)
+  { this->_simd = std::min (level, detected_simd_level ()); }
+
+  /**
+   * Insert new pair<Key, Value> into the map.
+   * If key already exists, do nothing.
+   * @param key Integral key.
+   * @param value Generic type value.
+   * @return True if the pair was inserted.
+   */
+  bool insert (KeyT key, const ValueT &value)
+  {
+    if (this->lookup (key) != nullptr)
+    { return false; }
+    this->add_missing (key, value);
+    return true;
+  }
+
+  /**
+   * Insert new pair<Key, Value> into the map, or overwrite the value of an
+   * existing key.
+   * @param key Integral key.
+   * @param value Generic type value.
+   * @return True if a new pair was inserted, false if a value was replaced.
+   */
+  bool insert_or_assign (KeyT key, const ValueT &value)
+  {
+    ValueT *found = this->lookup (key);
+    if (found == nullptr)
+    {
+      this->add_missing (key, value);
+      return true;
+    }
+    *found = value;
+    return false;
+  }
+
+  /**
+   * Grow the capacity once, so that count pairs fit without any more
+   * re-hashing. Never shrinks.
+   * @param count Size_t type variable.
+   */
+  void reserve (std::size_t count)
+  {
+    int exponent = this->_exponent;
+    while ((double) count / (double) ((std::size_t) 1 << exponent)
+           > INTEGRAL_TOP_THRESHOLD)
+    { ++exponent; }
+    if (exponent != this->_exponent)
+    { this->re_hashing_to (exponent); }
+  }
+
+  /**
+   * Check if given key is already in the map.
+   * @param key Integral key.
+   * @return Boolean Value.
+   */
+  bool contains_key (KeyT key) const
+  { return this->lookup (key) != nullptr; }
+
+  /**
+   * Given reference to value by key.
+   * If key doesnt exists throw error.
+   * @param key Integral key.
+   * @return Reference to generic type variable named value.
+   */
+  const ValueT &at (KeyT key) const
+  {
+    const ValueT *found = this->lookup (key);
+    if (found == nullptr)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return *found;
+  }
+
+  /**
+   * Given reference to value by key.
+   * If key doesnt exists throw error.
+   * @param key Integral key.
+   * @return Reference to generic type variable named value.
+   */
+  ValueT &at (KeyT key)
+  {
+    ValueT *found = this->lookup (key);
+    if (found == nullptr)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return *found;
+  }
+
+  ValueT &operator[] (KeyT key)
+  {
+    ValueT *found = this->lookup (key);
+    if (found == nullptr)
+    { found = this->add_missing (key, ValueT ()); }
+    return *found;
+  }
+
+  ValueT operator[] (KeyT key) const
+  { return this->at (key); }
+
+  /**
+   * Remove the pair of the given key, shifting the rest of its cluster
+   * back. Shrinks the capacity if the load factor drops below
+   * LOW_THRESHOLD.
+   * @param key Integral key.
+   * @return True if the key was found and removed.
+   */
+  bool erase (KeyT key)
+  {
+    bits_type bits = (bits_type) key;
+    if (bits == empty_bits ())
+    {
+      if (!this->_empty_key_value)
+      { return false; }
+      this->_empty_key_value.reset ();
+      --this->_size;
+    }
+    else
+    {
+      std::size_t slot = this->find_slot (bits);
+      if (slot == NOT_FOUND)
+      { return false; }
+      this->remove_slot (slot);
+    }
+    this->shrink_to_fit ();
+    return true;
+  }
+
+  /**
+   * Shrink the capacity with a single re-hashing, to the largest capacity
+   * whose load factor isn't below LOW_THRESHOLD.
+   */
+  void shrink_to_fit ()
+  {
+    int exponent = this->_exponent;
+    while (exponent > min_exponent ()
+           && (double) this->_size / (double) ((std::size_t) 1 << exponent)
+              < LOW_THRESHOLD)
+    { --exponent; }
+    if (exponent != this->_exponent)
+    { this->re_hashing_to (exponent); }
+  }
+
+  /**
+   * Remove all the pairs, the capacity stays the same.
+   */
+  void clear ()
+  {
+    for (std::size_t i = 0; i < this->_capacity; ++i)
+    {
+      if (this->_keys[i] != empty_bits ())
+      {
+        this->_values[i].~ValueT ();
+        this->_keys[i] = empty_bits ();
+      }
+    }
+    this->_empty_key_value.reset ();
+    this->_size = 0;
+  }
+
+  const_iterator begin () const
+  { return this->cbegin (); }
+
+  const_iterator cbegin () const
+  { return const_iterator (*this, 0); }
+
+  const_iterator end () const
+  { return this->cend (); }
+
+  const_iterator cend () const
+  { return const_iterator (*this, this->_capacity + 1); }
+
+  bool operator== (const IntegralHashMap<KeyT, ValueT> &rhs) const
+  {
+    if (this->_size != rhs._size)
+    { return false; }
+    for (const auto &pair: rhs)
+    {
+      const ValueT *found = this->lookup (pair.first);
+      if (found == nullptr || !(*found == pair.second))
+      { return false; }
+    }
+    return true;
+  }
+
+  bool operator!= (const IntegralHashMap<KeyT, ValueT> &rhs) const
+  { return !this->operator== (rhs); }
+
+ private:
+  static const std::size_t NOT_FOUND = (std::size_t) -1;
+  static const std::size_t GROUP_SLOTS = GROUP_BYTES / sizeof (KeyT);
+
+  /**
+   * Raw allocation of the key array, which starts at the first 64 byte
+   * boundary in it, so every group is a single cache line.
+   */
+  void *_block;
+  bits_type *_keys;
+  ValueT *_values;
+  std::size_t _capacity;
+  std::size_t _size;
+  int _exponent;
+  simd_level _simd;
+  std::unique_ptr<ValueT> _empty_key_value;
+
+  static bits_type empty_bits ()
+  {
+    return (bits_type) (std::is_signed<KeyT>::value
+                        ? std::numeric_limits<KeyT>::min ()
+                        : std::numeric_limits<KeyT>::max ());
+  }
+
+  /**
+   * Exponent of the smallest capacity, at least a whole group.
+   */
+  static int min_exponent ()
+  { return std::max (START_EXPONENT, sizeof (KeyT) == 4 ? 4 : 3); }
+
+  static int lowest_bit (std::uint32_t mask)
+  {
+#ifdef __GNUC__
+    return __builtin_ctz (mask);
+#else
+    int bit = 0;
+    while ((mask & 1) == 0)
+    {
+      mask >>= 1;
+      ++bit;
+    }
+    return bit;
+#endif
+  }
+
+  /**
+   * First slot of the home group of the key. The bits are mixed, integral
+   * keys often only differ in their high bits.
+   */
+  std::size_t home_of (bits_type bits) const
+  {
+    std::uint64_t hash = bits;
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    hash ^= hash >> 31;
+    return (std::size_t) hash & (this->_capacity - 1) & ~(GROUP_SLOTS - 1);
+  }
+
+  /**
+   * Allocate empty arrays of 2^exponent slots.
+   * @param exponent Int type variable.
+   */
+  void allocate (int exponent)
+  {
+    std::size_t capacity = (std::size_t) 1 << exponent;
+    void *block = ::operator new (sizeof (bits_type) * capacity + GROUP_BYTES);
+    try
+    {
+      this->_values = static_cast<ValueT *> (
+          ::operator new (sizeof (ValueT) * capacity));
+    }
+    catch (...)
+    {
+      ::operator delete (block);
+      throw;
+    }
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t> (block);
+    address = (address + GROUP_BYTES - 1) & ~(std::uintptr_t) (GROUP_BYTES - 1);
+    this->_block = block;
+    this->_keys = reinterpret_cast<bits_type *> (address);
+    std::fill (this->_keys, this->_keys + capacity, empty_bits ());
+    this->_capacity = capacity;
+    this->_exponent = exponent;
+  }
+
+  /**
+   * Free the arrays, the slots must be empty (or moved from and destroyed).
+   */
+  void release ()
+  {
+    ::operator delete (this->_block);
+    ::operator delete (this->_values);
+    this->_block = nullptr;
+    this->_keys = nullptr;
+    this->_values = nullptr;
+  }
+
+  /**
+   * Value of the given key.
+   * @return Pointer to the value, or nullptr if the key is missing.
+   */
+  ValueT *lookup (KeyT key) const
+  {
+    bits_type bits = (bits_type) key;
+    if (bits == empty_bits ())
+    { return this->_empty_key_value.get (); }
+    std::size_t slot = this->find_slot (bits);
+    return slot == NOT_FOUND ? nullptr : &this->_values[slot];
+  }
+
+  /**
+   * Find the slot of the given key, scanning whole groups from its home
+   * group until a group holds it or has an empty slot.
+   * @return Slot index, or NOT_FOUND.
+   */
+  std::size_t find_slot (bits_type bits) const
+  {
+    std::size_t slot = this->home_of (bits);
+    while (true)
+    {
+      std::uint64_t masks = scan_group (this->_simd, &this->_keys[slot], bits,
+                                        empty_bits ());
+      if ((std::uint32_t) masks != 0)
+      { return slot + lowest_bit ((std::uint32_t) masks); }
+      if ((masks >> 32) != 0)
+      { return NOT_FOUND; }
+      slot = (slot + GROUP_SLOTS) & (this->_capacity - 1);
+    }
+  }
+
+  /**
+   * First empty slot from the home group of the key onwards.
+   * @return Slot index.
+   */
+  std::size_t free_slot (bits_type bits) const
+  {
+    std::size_t slot = this->home_of (bits);
+    while (true)
+    {
+      std::uint32_t free = (std::uint32_t) (
+          scan_group (this->_simd, &this->_keys[slot], empty_bits (),
+                      empty_bits ()) >> 32);
+      if (free != 0)
+      { return slot + lowest_bit (free); }
+      slot = (slot + GROUP_SLOTS) & (this->_capacity - 1);
+    }
+  }
+
+  /**
+   * Add a pair whose key is known to be missing, growing if needed.
+   * @return Pointer to the new value.
+   */
+  ValueT *add_missing (KeyT key, const ValueT &value)
+  {
+    bits_type bits = (bits_type) key;
+    if (bits == empty_bits ())
+    {
+      this->_empty_key_value.reset (new ValueT (value));
+      ++this->_size;
+      return this->_empty_key_value.get ();
+    }
+    if ((double) (this->_size + 1) / this->_capacity > INTEGRAL_TOP_THRESHOLD)
+    { this->re_hashing_to (this->_exponent + 1); }
+    std::size_t slot = this->free_slot (bits);
+    new (&this->_values[slot]) ValueT (value);
+    this->_keys[slot] = bits;
+    ++this->_size;
+    return &this->_values[slot];
+  }
+
+  /**
+   * Destroy the pair of the given slot, and move back every following pair
+   * of the cluster whose home group doesn't lie between the hole and its
+   * slot, so no key is ever behind an empty slot of its probe sequence.
+   * @param slot Slot index.
+   */
+  void remove_slot (std::size_t slot)
+  {
+    std::size_t mask = this->_capacity - 1;
+    std::size_t hole = slot;
+    this->_values[hole].~ValueT ();
+    for (std::size_t next = (hole + 1) & mask;
+         this->_keys[next] != empty_bits (); next = (next + 1) & mask)
+    {
+      std::size_t home = this->home_of (this->_keys[next]);
+      if (((next - home) & mask) < ((next - hole) & mask))
+      { continue; }
+      this->_keys[hole] = this->_keys[next];
+      new (&this->_values[hole]) ValueT (std::move (this->_values[next]));
+      this->_values[next].~ValueT ();
+      hole = next;
+    }
+    this->_keys[hole] = empty_bits ();
+    --this->_size;
+  }
+
+  /**
+   * Change the capacity to 2^exponent slots, and place every pair again.
+   * @param exponent Int type variable.
+   */
+  void re_hashing_to (int exponent)
+  {
+    void *old_block = this->_block;
+    bits_type *old_keys = this->_keys;
+    ValueT *old_values = this->_values;
+    std::size_t old_capacity = this->_capacity;
+    this->allocate (exponent);
+    for (std::size_t i = 0; i < old_capacity; ++i)
+    {
+      if (old_keys[i] != empty_bits ())
+      {
+        std::size_t slot = this->free_slot (old_keys[i]);
+        new (&this->_values[slot]) ValueT (std::move (old_values[i]));
+        this->_keys[slot] = old_keys[i];
+        old_values[i].~ValueT ();
+      }
+    }
+    ::operator delete (old_block);
+    ::operator delete (old_values);
+  }
+
+  class iterator_t
+  {
+   private:
+    const IntegralHashMap<KeyT, ValueT> *_map_container;
+    std::size_t _position;
+
+    /**
+     * Positions below the capacity are slots, the capacity itself stands
+     * for the sentinel key, and the capacity plus one is the end.
+     */
+    void skip_empty ()
+    {
+      const IntegralHashMap<KeyT, ValueT> *map = this->_map_container;
+      while (this->_position < map->_capacity
+             && map->_keys[this->_position] == empty_bits ())
+      { ++this->_position; }
+      if (this->_position == map->_capacity && !map->_empty_key_value)
+      { ++this->_position; }
+    }
+
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef const std::pair<KeyT, ValueT> value_type;
+    typedef value_type reference;
+    typedef std::ptrdiff_t difference_type;
+
+    /**
+     * The pairs are built on the fly, -> keeps one alive for the call.
+     */
+    struct pointer
+    {
+      value_type pair;
+
+      const std::pair<KeyT, ValueT> *operator-> () const
+      { return &this->pair; }
+    };
+
+    iterator_t (const IntegralHashMap<KeyT, ValueT> &map_container,
+                std::size_t position)
+        : _map_container (&map_container), _position (position)
+    { this->skip_empty (); }
+
+    reference operator* () const
+    {
+      const IntegralHashMap<KeyT, ValueT> *map = this->_map_container;
+      if (this->_position == map->_capacity)
+      { return value_type ((KeyT) empty_bits (), *map->_empty_key_value); }
+      return value_type ((KeyT) map->_keys[this->_position],
+                         map->_values[this->_position]);
+    }
+
+    pointer operator-> () const
+    { return pointer {this->operator* ()}; }
+
+    iterator_t &operator++ ()
+    {
+      ++this->_position;
+      if (this->_position <= this->_map_container->_capacity)
+      { this->skip_empty (); }
+      return *this;
+    }
+
+    iterator_t operator++ (int)
+    {
+      iterator_t it (*this);
+      this->operator++ ();
+      return it;
+    }
+
+    bool operator== (const iterator_t &rhs) const
+    {
+      return this->_map_container == rhs._map_container
+             && this->_position == rhs._position;
+    }
+
+    bool operator!= (const iterator_t &rhs) const
+    { return !this->operator== (rhs); }
+  };
+};
+
+/**
+ * IntegralHashMap for 32 and 64 bit integral keys, HashMap for the rest.
+ */
+template<typename KeyT, typename ValueT>
+using FastHashMap = typename std::conditional<
+    is_packable_key<KeyT>::value, IntegralHashMap<KeyT, ValueT>,
+    HashMap<KeyT, ValueT>>::type;
+
+#endif //_INTEGRALHASHMAP_HPP_
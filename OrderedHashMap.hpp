@@ -0,0 +1,632 @@
+#include "HashMap.hpp"
+#include <new>
+
+#ifndef _ORDEREDHASHMAP_HPP_
+#define _ORDEREDHASHMAP_HPP_
+
+/**
+ * Insertion ordered map with a compact layout: the pairs live in a dense
+ * array of entries, in insertion order, and a sparse table of small
+ * integers indexes them by hash. Index slots are 1, 2, 4 or 8 bytes wide,
+ * the narrowest width which can address every entry, so the sparse part
+ * costs a few bytes per pair, and iteration is a linear scan of the
+ * entries whatever the capacity.
+ * The index keeps at most 2/3 of its slots in use and probes linearly.
+ * Erase leaves a hole in the entries (and a tombstone in the index), so the
+ * order of the other pairs is kept. Holes are compacted away when the map
+ * grows or shrinks, or by compact ().
+ */
+template<typename KeyT, typename ValueT>
+class OrderedHashMap
+{
+  class iterator_t;
+
+ public:
+  typedef iterator_t const_iterator;
+
+  OrderedHashMap () : _index (nullptr), _entries (nullptr), _width (0),
+                      _exponent (0), _used (0), _size (0)
+  { this->allocate (START_EXPONENT); }
+
+  OrderedHashMap (const std::vector<KeyT> &keys_vector,
+                  const std::vector<ValueT> &values_vector)
+      : OrderedHashMap ()
+  {
+    if (keys_vector.size () != values_vector.size ())
+    { throw std::length_error ("The size of the vectors is unmatched."); }
+    this->reserve (keys_vector.size ());
+    for (std::size_t i = 0; i < keys_vector.size (); ++i)
+    { this->insert_or_assign (keys_vector[i], values_vector[i]); }
+  }
+
+  /**
+   * Copy ctor.
+   * Copies the pairs in order, the copy has no holes.
+   * @param other OrderedHashMap to copy.
+   */
+  OrderedHashMap (const OrderedHashMap<KeyT, ValueT> &other)
+      : _index (nullptr), _entries (nullptr), _width (0), _exponent (0),
+        _used (0), _size (0)
+  {
+    this->allocate (exponent_for (other._size));
+    try
+    {
+      for (std::size_t i = 0; i < other._used; ++i)
+      {
+        if (other._entries[i].hash != HOLE_HASH)
+        { this->append (other._entries[i].hash, other._entries[i].pair); }
+      }
+    }
+    catch (...)
+    {
+      this->clear ();
+      this->release ();
+      throw;
+    }
+  }
+
+  ~OrderedHashMap ()
+  {
+    this->clear ();
+    this->release ();
+  }
+
+  OrderedHashMap<KeyT, ValueT> &operator= (OrderedHashMap<KeyT, ValueT> rhs)
+  {
+    swap (*this, rhs);
+    return *this;
+  }
+
+  friend void swap (OrderedHashMap<KeyT, ValueT> &src,
+                    OrderedHashMap<KeyT, ValueT> &dst)
+  {
+    std::swap (src._index, dst._index);
+    std::swap (src._entries, dst._entries);
+    std::swap (src._width, dst._width);
+    std::swap (src._exponent, dst._exponent);
+    std::swap (src._used, dst._used);
+    std::swap (src._size, dst._size);
+  }
+
+  /**
+   * Size of elements inside the map.
+   * @return Size_t value.
+   */
+  std::size_t size () const
+  { return this->_size; }
+
+  /**
+   * Number of pairs the map holds before growing, holes included.
+   * @return Size_t value.
+   */
+  std::size_t capacity () const
+  { return entries_for (this->_exponent); }
+
+  /**
+   * Check if the map is empty.
+   * @return Boolean value.
+   */
+  bool empty () const
+  { return this->_size == 0; }
+
+  double get_load_factor () const
+  { return (double) this->_size / (double) this->capacity (); }
+
+  /**
+   * Number of erased entries not compacted yet.
+   * @return Size_t value.
+   */
+  std::size_t holes () const
+  { return this->_used - this->_size; }
+
+  /**
+   * Width in bytes of an index slot, 1, 2, 4 or 8.
+   * @return Size_t value.
+   */
+  std::size_t index_width () const
+  { return this->_width; }
+
+  /**
+   * Insert new pair<Key, Value> at the end of the map.
+   * If key already exists, do nothing.
+   * @param key Generic type value.
+   * @param value Generic type value.
+   * @return True if the pair was inserted.
+   */
+  bool insert (const KeyT &key, const ValueT &value)
+  {
+    std::size_t hash = hash_of (key);
+    if (this->find_entry (key, hash) != NOT_FOUND)
+    { return false; }
+    this->add_missing (hash, key, value);
+    return true;
+  }
+
+  /**
+   * Insert new pair<Key, Value> at the end of the map, or overwrite the
+   * value of an existing key, which keeps its place.
+   * @param key Generic type value.
+   * @param value Generic type value.
+   * @return True if a new pair was inserted, false if a value was replaced.
+   */
+  bool insert_or_assign (const KeyT &key, const ValueT &value)
+  {
+    std::size_t hash = hash_of (key);
+    std::size_t entry = this->find_entry (key, hash);
+    if (entry == NOT_FOUND)
+    {
+      this->add_missing (hash, key, value);
+      return true;
+    }
+    this->_entries[entry].pair.second = value;
+    return false;
+  }
+
+  /**
+   * Grow the capacity once, so that count pairs fit without any more
+   * re-hashing. Never shrinks.
+   * @param count Size_t type variable.
+   */
+  void reserve (std::size_t count)
+  {
+    if (count > this->capacity ())
+    { this->rebuild (exponent_for (count)); }
+  }
+
+  /**
+   * Check if given key is already in the map.
+   * @param key Generic type value.
+   * @return Boolean Value.
+   */
+  bool contains_key (const KeyT &key) const
+  { return this->find_entry (key, hash_of (key)) != NOT_FOUND; }
+
+  /**
+   * Given reference to value by key.
+   * If key doesnt exists throw error.
+   * @param key Generic type value.
+   * @return Reference to generic type variable named value.
+   */
+  const ValueT &at (const KeyT &key) const
+  {
+    std::size_t entry = this->find_entry (key, hash_of (key));
+    if (entry == NOT_FOUND)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return this->_entries[entry].pair.second;
+  }
+
+  /**
+   * Given reference to value by key.
+   * If key doesnt exists throw error.
+   * @param key Generic type value.
+   * @return Reference to generic type variable named value.
+   */
+  ValueT &at (const KeyT &key)
+  {
+    std::size_t entry = this->find_entry (key, hash_of (key));
+    if (entry == NOT_FOUND)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return this->_entries[entry].pair.second;
+  }
+
+  ValueT &operator[] (const KeyT &key)
+  {
+    std::size_t hash = hash_of (key);
+    std::size_t entry = this->find_entry (key, hash);
+    if (entry == NOT_FOUND)
+    { entry = this->add_missing (hash, key, ValueT ()); }
+    return this->_entries[entry].pair.second;
+  }
+
+  ValueT operator[] (const KeyT &key) const
+  { return this->at (key); }
+
+  /**
+   * Remove the pair of the given key, leaving a hole in its place.
+   * Shrinks (and compacts) if the load factor drops below LOW_THRESHOLD.
+   * @param key Generic type value.
+   * @return True if the key was found and removed.
+   */
+  bool erase (const KeyT &key)
+  {
+    std::size_t hash = hash_of (key);
+    std::size_t slot = this->find_slot (key, hash);
+    if (slot == NOT_FOUND)
+    { return false; }
+    entry_type &entry = this->_entries[this->index_at (slot) - FIRST_ENTRY];
+    entry.pair.~pair ();
+    entry.hash = HOLE_HASH;
+    this->set_index (slot, DUMMY_INDEX);
+    --this->_size;
+    this->shrink_to_fit ();
+    return true;
+  }
+
+  /**
+   * Shrink the capacity with a single re-hashing, to the largest capacity
+   * whose load factor isn't below LOW_THRESHOLD.
+   */
+  void shrink_to_fit ()
+  {
+    int exponent = this->_exponent;
+    while (exponent > START_EXPONENT
+           && (double) this->_size / (double) entries_for (exponent)
+              < LOW_THRESHOLD)
+    { --exponent; }
+    if (exponent != this->_exponent)
+    { this->rebuild (exponent); }
+  }
+
+  /**
+   * Close the holes left by erase, keeping the order of the pairs and the
+   * capacity.
+   */
+  void compact ()
+  {
+    if (this->_used != this->_size)
+    { this->rebuild (this->_exponent); }
+  }
+
+  /**
+   * Remove all the pairs, the capacity stays the same.
+   */
+  void clear ()
+  {
+    for (std::size_t i = 0; i < this->_used; ++i)
+    {
+      if (this->_entries[i].hash != HOLE_HASH)
+      { this->_entries[i].pair.~pair (); }
+    }
+    std::memset (this->_index, 0, this->_width << this->_exponent);
+    this->_used = 0;
+    this->_size = 0;
+  }
+
+  const_iterator begin () const
+  { return this->cbegin (); }
+
+  const_iterator cbegin () const
+  { return const_iterator (*this, 0); }
+
+  const_iterator end () const
+  { return this->cend (); }
+
+  const_iterator cend () const
+  { return const_iterator (*this, this->_used); }
+
+  /**
+   * Two maps are equal if they hold the same (key, value) pairs, in any
+   * order.
+   */
+  bool operator== (const OrderedHashMap<KeyT, ValueT> &rhs) const
+  {
+    if (this->_size != rhs._size)
+    { return false; }
+    for (std::size_t i = 0; i < rhs._used; ++i)
+    {
+      const entry_type &entry = rhs._entries[i];
+      if (entry.hash == HOLE_HASH)
+      { continue; }
+      std::size_t found = this->find_entry (entry.pair.first, entry.hash);
+      if (found == NOT_FOUND
+          || !(this->_entries[found].pair.second == entry.pair.second))
+      { return false; }
+    }
+    return true;
+  }
+
+  bool operator!= (const OrderedHashMap<KeyT, ValueT> &rhs) const
+  { return !this->operator== (rhs); }
+
+ private:
+  static const std::size_t NOT_FOUND = (std::size_t) -1;
+  /**
+   * Hash of erased entries. Keys which really hash to it are given the
+   * next hash down instead.
+   */
+  static const std::size_t HOLE_HASH = (std::size_t) -1;
+  /**
+   * Index slot values: EMPTY_INDEX ends a probe, DUMMY_INDEX is the
+   * tombstone of an erased entry, and entry i is stored as i + FIRST_ENTRY,
+   * so a zeroed table is empty.
+   */
+  static const std::size_t EMPTY_INDEX = 0;
+  static const std::size_t DUMMY_INDEX = 1;
+  static const std::size_t FIRST_ENTRY = 2;
+
+  struct entry_type
+  {
+    std::size_t hash;
+    std::pair<KeyT, ValueT> pair;
+  };
+
+  /**
+   * 2^exponent slots of _width bytes.
+   */
+  unsigned char *_index;
+  /**
+   * capacity () entries, the first _used of them filled in (pairs or
+   * holes).
+   */
+  entry_type *_entries;
+  std::size_t _width;
+  int _exponent;
+  std::size_t _used;
+  std::size_t _size;
+
+  /**
+   * Hash of a key, never HOLE_HASH. std::hash is the identity for
+   * integers, so it is mixed before the index slot is taken from the low
+   * bits, or sequential keys would probe as one cluster.
+   */
+  static std::size_t hash_of (const KeyT &key)
+  {
+    std::uint64_t word = std::hash<KeyT>{} (key);
+    word ^= word >> 33;
+    word *= 0xFF51AFD7ED558CCDULL;
+    word ^= word >> 33;
+    std::size_t hash = (std::size_t) word;
+    return hash == HOLE_HASH ? hash - 1 : hash;
+  }
+
+  /**
+   * Number of entries of an index of 2^exponent slots, 2/3 of the slots.
+   */
+  static std::size_t entries_for (int exponent)
+  { return ((std::size_t) 2 << exponent) / 3; }
+
+  /**
+   * The smallest exponent, at least START_EXPONENT, whose entries hold
+   * count pairs.
+   */
+  static int exponent_for (std::size_t count)
+  {
+    int exponent = START_EXPONENT;
+    while (entries_for (exponent) < count)
+    { ++exponent; }
+    return exponent;
+  }
+
+  /**
+   * Narrowest slot width which can store every entry of an index of
+   * 2^exponent slots, next to EMPTY_INDEX and DUMMY_INDEX.
+   */
+  static std::size_t width_for (int exponent)
+  {
+    std::size_t largest = entries_for (exponent) - 1 + FIRST_ENTRY;
+    if (largest <= UINT8_MAX)
+    { return 1; }
+    if (largest <= UINT16_MAX)
+    { return 2; }
+    if (largest <= UINT32_MAX)
+    { return 4; }
+    return 8;
+  }
+
+  std::size_t index_at (std::size_t slot) const
+  {
+    switch (this->_width)
+    {
+      case 1:
+        return this->_index[slot];
+      case 2:
+        return reinterpret_cast<const std::uint16_t *> (this->_index)[slot];
+      case 4:
+        return reinterpret_cast<const std::uint32_t *> (this->_index)[slot];
+      default:
+        return (std::size_t)
+            reinterpret_cast<const std::uint64_t *> (this->_index)[slot];
+    }
+  }
+
+  void set_index (std::size_t slot, std::size_t value)
+  {
+    switch (this->_width)
+    {
+      case 1:
+        this->_index[slot] = (std::uint8_t) value;
+        break;
+      case 2:
+        reinterpret_cast<std::uint16_t *> (this->_index)[slot] =
+            (std::uint16_t) value;
+        break;
+      case 4:
+        reinterpret_cast<std::uint32_t *> (this->_index)[slot] =
+            (std::uint32_t) value;
+        break;
+      default:
+        reinterpret_cast<std::uint64_t *> (this->_index)[slot] = value;
+    }
+  }
+
+  /**
+   * Allocate an empty index of 2^exponent slots, and room for its entries.
+   * @param exponent Int type variable.
+   */
+  void allocate (int exponent)
+  {
+    std::size_t width = width_for (exponent);
+    // Zeroed, and aligned for any slot width
+    auto *index = static_cast<unsigned char *> (
+        ::operator new (width << exponent));
+    std::memset (index, 0, width << exponent);
+    try
+    {
+      this->_entries = static_cast<entry_type *> (
+          ::operator new (sizeof (entry_type) * entries_for (exponent)));
+    }
+    catch (...)
+    {
+      ::operator delete (index);
+      throw;
+    }
+    this->_index = index;
+    this->_width = width;
+    this->_exponent = exponent;
+    this->_used = 0;
+  }
+
+  /**
+   * Free the index and the entries, the pairs must be destroyed.
+   */
+  void release ()
+  {
+    ::operator delete (this->_index);
+    ::operator delete (this->_entries);
+    this->_index = nullptr;
+    this->_entries = nullptr;
+  }
+
+  /**
+   * Find the index slot of the given key, skipping tombstones.
+   * @return Slot index, or NOT_FOUND.
+   */
+  std::size_t find_slot (const KeyT &key, std::size_t hash) const
+  {
+    std::size_t mask = ((std::size_t) 1 << this->_exponent) - 1;
+    for (std::size_t slot = hash & mask;; slot = (slot + 1) & mask)
+    {
+      std::size_t value = this->index_at (slot);
+      if (value == EMPTY_INDEX)
+      { return NOT_FOUND; }
+      if (value == DUMMY_INDEX)
+      { continue; }
+      const entry_type &entry = this->_entries[value - FIRST_ENTRY];
+      if (entry.hash == hash && entry.pair.first == key)
+      { return slot; }
+    }
+  }
+
+  /**
+   * Find the entry of the given key.
+   * @return Entry index, or NOT_FOUND.
+   */
+  std::size_t find_entry (const KeyT &key, std::size_t hash) const
+  {
+    std::size_t slot = this->find_slot (key, hash);
+    return slot == NOT_FOUND ? NOT_FOUND
+                             : this->index_at (slot) - FIRST_ENTRY;
+  }
+
+  /**
+   * Append a pair whose key is known to be missing, into a free entry.
+   * The new entry goes to the first empty index slot of its probe; erased
+   * entries keep their tombstones until the next rebuild, so every
+   * tombstone matches a hole and the index stays within its 2/3 load.
+   * @return Entry index.
+   */
+  template<typename PairT>
+  std::size_t append (std::size_t hash, PairT &&pair)
+  {
+    entry_type *entry = &this->_entries[this->_used];
+    new (&entry->pair) std::pair<KeyT, ValueT> (std::forward<PairT> (pair));
+    entry->hash = hash;
+    std::size_t mask = ((std::size_t) 1 << this->_exponent) - 1;
+    std::size_t slot = hash & mask;
+    while (this->index_at (slot) != EMPTY_INDEX)
+    { slot = (slot + 1) & mask; }
+    this->set_index (slot, this->_used + FIRST_ENTRY);
+    ++this->_size;
+    return this->_used++;
+  }
+
+  /**
+   * Add a pair whose key is known to be missing, at the end. If the
+   * entries are full, compacts the holes first, and grows if they were
+   * fewer than the live pairs.
+   * @return Entry index.
+   */
+  std::size_t add_missing (std::size_t hash, const KeyT &key,
+                           const ValueT &value)
+  {
+    if (this->_used == this->capacity ())
+    {
+      this->rebuild (this->holes () >= this->_size / 2 ? this->_exponent
+                                                       : this->_exponent + 1);
+    }
+    return this->append (hash, std::pair<KeyT, ValueT> (key, value));
+  }
+
+  /**
+   * Move the pairs, in order and without holes, to a new index of
+   * 2^exponent slots and its entries.
+   * @param exponent Int type variable.
+   */
+  void rebuild (int exponent)
+  {
+    unsigned char *old_index = this->_index;
+    entry_type *old_entries = this->_entries;
+    std::size_t old_used = this->_used;
+    this->allocate (exponent);
+    this->_size = 0;
+    for (std::size_t i = 0; i < old_used; ++i)
+    {
+      entry_type &entry = old_entries[i];
+      if (entry.hash == HOLE_HASH)
+      { continue; }
+      this->append (entry.hash, std::move (entry.pair));
+      entry.pair.~pair ();
+    }
+    ::operator delete (old_index);
+    ::operator delete (old_entries);
+  }
+
+  class iterator_t
+  {
+    friend class OrderedHashMap<KeyT, ValueT>;
+   private:
+    const OrderedHashMap<KeyT, ValueT> *_map_container;
+    std::size_t _position;
+
+    void skip_holes ()
+    {
+      while (this->_position < this->_map_container->_used
+             && this->_map_container->_entries[this->_position].hash
+                == HOLE_HASH)
+      { ++this->_position; }
+    }
+
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef const std::pair<KeyT, ValueT> value_type;
+    typedef value_type &reference;
+    typedef value_type *pointer;
+    typedef std::ptrdiff_t difference_type;
+
+    iterator_t (const OrderedHashMap<KeyT, ValueT> &map_container,
+                std::size_t position)
+        : _map_container (&map_container), _position (position)
+    { this->skip_holes (); }
+
+    reference operator* () const
+    { return this->_map_container->_entries[this->_position].pair; }
+
+    pointer operator-> () const
+    { return &(this->operator* ()); }
+
+    iterator_t &operator++ ()
+    {
+      ++this->_position;
+      this->skip_holes ();
+      return *this;
+    }
+
+    iterator_t operator++ (int)
+    {
+      iterator_t it (*this);
+      this->operator++ ();
+      return it;
+    }
+
+    bool operator== (const iterator_t &rhs) const
+    {
+      return this->_map_container == rhs._map_container
+             && this->_position == rhs._position;
+    }
+
+    bool operator!= (const iterator_t &rhs) const
+    { return !this->operator== (rhs); }
+  };
+};
+
+#endif //_ORDEREDHASHMAP_HPP_
@@ -0,0 +1,137 @@
+#include "HashMap.hpp"
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#ifndef _PARALLELHASHMAP_HPP_
+#define _PARALLELHASHMAP_HPP_
+#define RANGES_PER_THREAD 8
+
+/**
+ * Number of worker threads to use when the caller doesn't ask for one.
+ * @return Int value.
+ */
+inline int default_thread_count ()
+{
+  unsigned int threads = std::thread::hardware_concurrency ();
+  return threads == 0 ? 1 : (int) threads;
+}
+
+/**
+ * Run task (range_index) for every range of the map, on the given number of
+ * threads (the calling thread included).
+ * The map is split into RANGES_PER_THREAD ranges per thread, balanced by
+ * occupancy, and each thread takes the next unclaimed range when it is done
+ * with its current one, so a slow range doesn't hold the other threads.
+ * The first exception thrown by a task is rethrown once all threads joined.
+ * @param ranges Number of ranges, see HashMap::split_ranges.
+ * @param threads Int type variable.
+ * @param task Callable taking the index of a range.
+ */
+template<typename Task>
+void run_on_ranges (std::size_t ranges, int threads, Task task)
+{
+  std::atomic<std::size_t> next (0);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto worker = [&] ()
+  {
+    for (std::size_t i = next++; i < ranges; i = next++)
+    {
+      try
+      { task (i); }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock (error_mutex);
+        if (!error)
+        { error = std::current_exception (); }
+        next = ranges;
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  int workers = std::min (threads, (int) ranges);
+  for (int i = 1; i < workers; ++i)
+  { pool.emplace_back (worker); }
+  worker ();
+  for (auto &thread: pool)
+  { thread.join (); }
+  if (error)
+  { std::rethrow_exception (error); }
+}
+
+/**
+ * Call f on every pair of the map, in parallel.
+ * The map must not be modified meanwhile.
+ * @param map HashMap to scan.
+ * @param f Callable taking a const pair<Key, Value> &.
+ * @param threads Int type variable.
+ */
+template<typename KeyT, typename ValueT, typename Function>
+void parallel_for_each (const HashMap<KeyT, ValueT> &map, Function f,
+                        int threads = default_thread_count ())
+{
+  auto ranges = map.split_ranges (threads * RANGES_PER_THREAD);
+  run_on_ranges (ranges.size (), threads, [&] (std::size_t i)
+  {
+    for (const auto &pair: ranges[i])
+    { f (pair); }
+  });
+}
+
+/**
+ * Reduce transform (pair) over all the pairs of the map, in parallel.
+ * reduce must be associative, the partial results of the ranges are reduced
+ * into init in iteration order.
+ * @param map HashMap to scan.
+ * @param init Initial value.
+ * @param reduce Callable of (T, T) returning T.
+ * @param transform Callable taking a const pair<Key, Value> &, returning T.
+ * @param threads Int type variable.
+ * @return Reduced value.
+ */
+template<typename KeyT, typename ValueT, typename T, typename Reduce,
+    typename Transform>
+T parallel_transform_reduce (const HashMap<KeyT, ValueT> &map, T init,
+                             Reduce reduce, Transform transform,
+                             int threads = default_thread_count ())
+{
+  auto ranges = map.split_ranges (threads * RANGES_PER_THREAD);
+  std::vector<T> partials (ranges.size (), init);
+  run_on_ranges (ranges.size (), threads, [&] (std::size_t i)
+  {
+    auto it = ranges[i].begin ();
+    T partial = transform (*it);
+    for (++it; it != ranges[i].end (); ++it)
+    { partial = reduce (partial, transform (*it)); }
+    partials[i] = partial;
+  });
+  for (const auto &partial: partials)
+  { init = reduce (init, partial); }
+  return init;
+}
+
+/**
+ * Count the pairs of the map the predicate holds for, in parallel.
+ * @param map HashMap to scan.
+ * @param predicate Callable taking a const pair<Key, Value> &.
+ * @param threads Int type variable.
+ * @return Number of matching pairs.
+ */
+template<typename KeyT, typename ValueT, typename Predicate>
+std::size_t parallel_count_if (const HashMap<KeyT, ValueT> &map,
+                               Predicate predicate,
+                               int threads = default_thread_count ())
+{
+  return parallel_transform_reduce (
+      map, (std::size_t) 0,
+      [] (std::size_t a, std::size_t b)
+      { return a + b; },
+      [&] (const std::pair<KeyT, ValueT> &pair)
+      { return predicate (pair) ? (std::size_t) 1 : (std::size_t) 0; },
+      threads);
+}
+
+#endif //_PARALLELHASHMAP_HPP_
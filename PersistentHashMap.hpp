@@ -0,0 +1,557 @@
+#include "Dictionary.hpp"
+#include <memory>
+
+#ifndef _PERSISTENTHASHMAP_HPP_
+#define _PERSISTENTHASHMAP_HPP_
+#define HAMT_BITS 5
+#define HAMT_MASK ((1u << HAMT_BITS) - 1)
+#define HAMT_HASH_BITS ((int) sizeof (std::size_t) * 8)
+
+/**
+ * Persistent variant of HashMap, a hash array mapped trie (in the CHAMP
+ * layout).
+ * Every node covers HAMT_BITS bits of the hash, and keeps two bitmaps of
+ * its 32 slots: the ones holding a pair inline, and the ones holding a sub
+ * node. Pairs whose hash is fully consumed share a plain collision node.
+ * Nodes are reference counted and shared between copies, so copying the
+ * map (snapshot ()) is O(1). A write copies only the nodes on the path to
+ * its key which are shared with another copy, nodes owned by a single map
+ * are updated in place, so a map without snapshots pays no copies at all.
+ * Like HashMap, a map may hash with a seed (see reseed). Keys which still
+ * collide on the whole hash share a collision node, which is scanned.
+ */
+template<typename KeyT, typename ValueT>
+class PersistentHashMap
+{
+  struct node;
+  typedef std::shared_ptr<node> node_ptr;
+  class iterator_t;
+
+ public:
+  typedef iterator_t const_iterator;
+
+  PersistentHashMap () : _root (nullptr), _size (0), _seed (0)
+  {}
+
+  PersistentHashMap (const std::vector<KeyT> &keys_vector,
+                     const std::vector<ValueT> &values_vector)
+      : PersistentHashMap ()
+  {
+    if (keys_vector.size () != values_vector.size ())
+    { throw std::length_error ("The size of the vectors is unmatched."); }
+    for (std::size_t i = 0; i < keys_vector.size (); ++i)
+    { this->insert_or_assign (keys_vector[i], values_vector[i]); }
+  }
+
+  virtual ~PersistentHashMap () = default;
+
+  friend void swap (PersistentHashMap<KeyT, ValueT> &src,
+                    PersistentHashMap<KeyT, ValueT> &dst)
+  {
+    std::swap (src._root, dst._root);
+    std::swap (src._size, dst._size);
+    std::swap (src._seed, dst._seed);
+  }
+
+  /**
+   * Size of elements inside the map.
+   * @return Size_t value.
+   */
+  std::size_t size () const
+  { return this->_size; }
+
+  /**
+   * Check if the map is empty.
+   * @return True if empty, false otherwise.
+   */
+  bool empty () const
+  { return this->_size == 0; }
+
+  /**
+   * An immutable view of the map as it is now, in O(1).
+   * Later writes to either map don't affect the other one.
+   * The snapshot can be read (and dropped) on another thread while this
+   * map keeps being written, since shared nodes are never written and
+   * their reference counts are atomic. Each map, the snapshot included,
+   * must still be written by one thread at a time.
+   * @return PersistentHashMap sharing all the nodes of this map.
+   */
+  PersistentHashMap<KeyT, ValueT> snapshot () const
+  { return *this; }
+
+  /**
+   * Hash the keys with the given seed from now on, rebuilding the trie.
+   * A seed of 0 means plain std::hash, other seeds make the path of a key
+   * unpredictable to whoever doesn't know the seed, see HashMap::reseed.
+   * Snapshots taken before keep their seed.
+   * @param seed Seed value.
+   */
+  void reseed (std::size_t seed)
+  {
+    PersistentHashMap<KeyT, ValueT> rebuilt;
+    rebuilt._seed = seed;
+    for (const auto &pair: *this)
+    { rebuilt.upsert (pair.first, pair.second); }
+    swap (*this, rebuilt);
+  }
+
+  /**
+   * Insert key and value to the map, if the key doesn't exist in it.
+   * @param key Generic type variable.
+   * @param value Generic type variable.
+   * @return True if the pair was inserted, false otherwise.
+   */
+  bool insert (const KeyT &key, const ValueT &value)
+  {
+    if (this->contains_key (key))
+    { return false; }
+    this->upsert (key, value);
+    return true;
+  }
+
+  /**
+   * Insert key and value to the map, or overwrite the value of the key if it
+   * already exists.
+   * @param key Generic type variable.
+   * @param value Generic type variable.
+   * @return True if the pair was inserted, false if it was assigned.
+   */
+  bool insert_or_assign (const KeyT &key, const ValueT &value)
+  {
+    std::size_t size = this->_size;
+    *this->upsert (key, value) = value;
+    return this->_size != size;
+  }
+
+  /**
+   * Check if the key exists in the map.
+   * @param key Generic type variable.
+   * @return True if exist, false otherwise.
+   */
+  bool contains_key (const KeyT &key) const
+  { return this->find_pair (key) != nullptr; }
+
+  /**
+   * Find the value of the given key, throw exception if the key doesn't exist.
+   * Only the const version exists, writes go through insert_or_assign or
+   * operator[], which copy the shared nodes first.
+   * @param key Generic type variable.
+   * @return Value of the key.
+   */
+  const ValueT &at (const KeyT &key) const
+  {
+    const std::pair<KeyT, ValueT> *pair_ptr = this->find_pair (key);
+    if (pair_ptr == nullptr)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return pair_ptr->second;
+  }
+
+  /**
+   * Value of the key, inserting a default value if the key doesn't exist.
+   * Copies the nodes on the path to the key which are shared with a
+   * snapshot, so the reference can't be seen through any other map.
+   * @param key Generic type variable.
+   * @return Reference to the value of the key.
+   */
+  ValueT &operator[] (const KeyT &key)
+  {
+    const std::pair<KeyT, ValueT> *pair_ptr = this->find_pair (key);
+    if (pair_ptr != nullptr && this->_root.use_count () == 1
+        && this->owns_path (key))
+    { return const_cast<ValueT &> (pair_ptr->second); }
+    return *this->upsert (key, ValueT ());
+  }
+
+  /**
+   * Remove the key and its value from the map.
+   * @param key Generic type variable.
+   * @return True if removed, false otherwise.
+   */
+  virtual bool erase (const KeyT &key)
+  {
+    if (!this->contains_key (key))
+    { return false; }
+    remove (this->_root, key, this->hash_key (key), 0);
+    if (--this->_size == 0)
+    { this->_root.reset (); }
+    return true;
+  }
+
+  /**
+   * Remove all the elements of the map. Snapshots keep theirs.
+   */
+  void clear ()
+  {
+    this->_root.reset ();
+    this->_size = 0;
+  }
+
+  const_iterator begin () const
+  { return const_iterator (this->_root.get ()); }
+
+  const_iterator cbegin () const
+  { return const_iterator (this->_root.get ()); }
+
+  const_iterator end () const
+  { return const_iterator (nullptr); }
+
+  const_iterator cend () const
+  { return const_iterator (nullptr); }
+
+  /**
+   * Check if both maps hold the same pairs.
+   * Maps sharing their root (a snapshot and its untouched source) are equal
+   * without looking at the pairs.
+   * @param rhs PersistentHashMap object.
+   * @return True if equal, false otherwise.
+   */
+  bool operator== (const PersistentHashMap<KeyT, ValueT> &rhs) const
+  {
+    if (this->_size != rhs._size)
+    { return false; }
+    if (this->_root == rhs._root)
+    { return true; }
+    for (const auto &pair: rhs)
+    {
+      const std::pair<KeyT, ValueT> *pair_ptr = this->find_pair (pair.first);
+      if (pair_ptr == nullptr || !(pair_ptr->second == pair.second))
+      { return false; }
+    }
+    return true;
+  }
+
+  bool operator!= (const PersistentHashMap<KeyT, ValueT> &rhs) const
+  { return !this->operator== (rhs); }
+
+ private:
+  /**
+   * A trie node. entries and children are ordered by their slot, so the
+   * index of a slot is the number of lower bits set in its bitmap.
+   * Collision nodes (below the last level) use neither bitmap and keep
+   * their pairs unordered.
+   */
+  struct node
+  {
+    std::uint32_t datamap = 0;
+    std::uint32_t nodemap = 0;
+    std::vector<std::pair<KeyT, ValueT>> entries;
+    std::vector<node_ptr> children;
+  };
+
+  node_ptr _root;
+  std::size_t _size;
+  std::size_t _seed;
+
+  /**
+   * Gives access to the seeded hash of HashMap.
+   */
+  struct key_hasher : HashMap<KeyT, ValueT>
+  {
+    using HashMap<KeyT, ValueT>::seeded_hash;
+  };
+
+  std::size_t hash_key (const KeyT &key) const
+  {
+    if (this->_seed != 0)
+    { return key_hasher::seeded_hash (key, this->_seed); }
+    std::uint64_t word = std::hash<KeyT>{} (key);
+    word ^= word >> 33;
+    word *= 0xFF51AFD7ED558CCDULL;
+    word ^= word >> 33;
+    return (std::size_t) word;
+  }
+
+  static std::uint32_t slot_bit (std::size_t hash, int shift)
+  { return 1u << ((hash >> shift) & HAMT_MASK); }
+
+  static int slot_index (std::uint32_t bitmap, std::uint32_t bit)
+  { return __builtin_popcount (bitmap & (bit - 1)); }
+
+  /**
+   * Make the node of the given slot owned by this map only, copying it if
+   * it is shared.
+   * @param slot Reference to the pointer holding the node.
+   * @return Pointer to the owned node.
+   */
+  static node *own (node_ptr &slot)
+  {
+    if (!slot)
+    { slot = std::make_shared<node> (); }
+    else if (slot.use_count () != 1)
+    { slot = std::make_shared<node> (*slot); }
+    return slot.get ();
+  }
+
+  const std::pair<KeyT, ValueT> *find_pair (const KeyT &key) const
+  {
+    std::size_t hash = this->hash_key (key);
+    const node *cur = this->_root.get ();
+    for (int shift = 0; cur != nullptr; shift += HAMT_BITS)
+    {
+      if (shift >= HAMT_HASH_BITS)
+      {
+        for (const auto &entry: cur->entries)
+        {
+          if (entry.first == key)
+          { return &entry; }
+        }
+        return nullptr;
+      }
+      std::uint32_t bit = slot_bit (hash, shift);
+      if (cur->datamap & bit)
+      {
+        const auto &entry = cur->entries[slot_index (cur->datamap, bit)];
+        return entry.first == key ? &entry : nullptr;
+      }
+      if (!(cur->nodemap & bit))
+      { return nullptr; }
+      cur = cur->children[slot_index (cur->nodemap, bit)].get ();
+    }
+    return nullptr;
+  }
+
+  /**
+   * Check if no node on the path to the key is shared with another map.
+   */
+  bool owns_path (const KeyT &key) const
+  {
+    std::size_t hash = this->hash_key (key);
+    const node *cur = this->_root.get ();
+    for (int shift = 0; shift < HAMT_HASH_BITS; shift += HAMT_BITS)
+    {
+      std::uint32_t bit = slot_bit (hash, shift);
+      if (!(cur->nodemap & bit))
+      { return true; }
+      const node_ptr &child = cur->children[slot_index (cur->nodemap, bit)];
+      if (child.use_count () != 1)
+      { return false; }
+      cur = child.get ();
+    }
+    return true;
+  }
+
+  /**
+   * Value of the key, inserting the given value if the key doesn't exist.
+   * Owns every node on the path first.
+   * @return Pointer to the value inside the map.
+   */
+  ValueT *upsert (const KeyT &key, const ValueT &value)
+  {
+    bool added = false;
+    ValueT *value_ptr =
+        this->put (this->_root, std::make_pair (key, value),
+                   this->hash_key (key), 0, added);
+    if (added)
+    { ++this->_size; }
+    return value_ptr;
+  }
+
+  ValueT *put (node_ptr &slot, std::pair<KeyT, ValueT> &&pair,
+               std::size_t hash, int shift, bool &added)
+  {
+    node *cur = own (slot);
+    if (shift >= HAMT_HASH_BITS)
+    {
+      for (auto &entry: cur->entries)
+      {
+        if (entry.first == pair.first)
+        { return &entry.second; }
+      }
+      cur->entries.push_back (std::move (pair));
+      added = true;
+      return &cur->entries.back ().second;
+    }
+    std::uint32_t bit = slot_bit (hash, shift);
+    if (cur->nodemap & bit)
+    {
+      return this->put (cur->children[slot_index (cur->nodemap, bit)],
+                        std::move (pair), hash, shift + HAMT_BITS, added);
+    }
+    int index = slot_index (cur->datamap, bit);
+    if (!(cur->datamap & bit))
+    {
+      cur->entries.insert (cur->entries.begin () + index, std::move (pair));
+      cur->datamap |= bit;
+      added = true;
+      return &cur->entries[index].second;
+    }
+    if (cur->entries[index].first == pair.first)
+    { return &cur->entries[index].second; }
+
+    // Push the pair already in the slot one level down, next to the new one
+    node_ptr child;
+    std::size_t other_hash = this->hash_key (cur->entries[index].first);
+    bool moved = false;
+    this->put (child, std::move (cur->entries[index]), other_hash,
+               shift + HAMT_BITS, moved);
+    cur->entries.erase (cur->entries.begin () + index);
+    cur->datamap ^= bit;
+    int child_index = slot_index (cur->nodemap, bit);
+    cur->children.insert (cur->children.begin () + child_index,
+                          std::move (child));
+    cur->nodemap |= bit;
+    return this->put (cur->children[child_index], std::move (pair), hash,
+                      shift + HAMT_BITS, added);
+  }
+
+  /**
+   * Remove a key which exists in the trie below the given slot.
+   * A sub node left with a single pair and no sub nodes is folded back into
+   * its parent, so the trie stays as shallow as its keys allow.
+   */
+  static void remove (node_ptr &slot, const KeyT &key, std::size_t hash,
+                      int shift)
+  {
+    node *cur = own (slot);
+    if (shift >= HAMT_HASH_BITS)
+    {
+      for (auto it = cur->entries.begin (); it != cur->entries.end (); ++it)
+      {
+        if (it->first == key)
+        {
+          cur->entries.erase (it);
+          return;
+        }
+      }
+      return;
+    }
+    std::uint32_t bit = slot_bit (hash, shift);
+    if (cur->datamap & bit)
+    {
+      cur->entries.erase (cur->entries.begin ()
+                          + slot_index (cur->datamap, bit));
+      cur->datamap ^= bit;
+      return;
+    }
+    int child_index = slot_index (cur->nodemap, bit);
+    node_ptr &child = cur->children[child_index];
+    remove (child, key, hash, shift + HAMT_BITS);
+    if (child->nodemap == 0 && child->entries.size () == 1)
+    {
+      std::pair<KeyT, ValueT> pair = std::move (child->entries.front ());
+      cur->children.erase (cur->children.begin () + child_index);
+      cur->nodemap ^= bit;
+      cur->entries.insert (cur->entries.begin ()
+                           + slot_index (cur->datamap, bit), std::move (pair));
+      cur->datamap |= bit;
+    }
+  }
+
+  /**
+   * Depth first iterator over the pairs of the trie.
+   * Writes to the map may update its nodes in place, iterate a snapshot ()
+   * to read while writing.
+   */
+  class iterator_t
+  {
+   private:
+    std::vector<const node *> _pending;
+    const node *_node;
+    std::size_t _entry;
+
+    void next_node ()
+    {
+      this->_node = nullptr;
+      while (!this->_pending.empty ())
+      {
+        const node *cur = this->_pending.back ();
+        this->_pending.pop_back ();
+        for (auto it = cur->children.rbegin (); it != cur->children.rend ();
+             ++it)
+        { this->_pending.push_back (it->get ()); }
+        if (!cur->entries.empty ())
+        {
+          this->_node = cur;
+          this->_entry = 0;
+          return;
+        }
+      }
+    }
+
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef const std::pair<KeyT, ValueT> value_type;
+    typedef value_type &reference;
+    typedef value_type *pointer;
+    typedef std::ptrdiff_t difference_type;
+
+    explicit iterator_t (const node *root) : _node (nullptr), _entry (0)
+    {
+      if (root != nullptr)
+      {
+        this->_pending.push_back (root);
+        this->next_node ();
+      }
+    }
+
+    reference operator* () const
+    { return this->_node->entries[this->_entry]; }
+
+    pointer operator-> () const
+    { return &(this->operator* ()); }
+
+    iterator_t &operator++ ()
+    {
+      if (++this->_entry == this->_node->entries.size ())
+      { this->next_node (); }
+      return *this;
+    }
+
+    iterator_t operator++ (int)
+    {
+      iterator_t it (*this);
+      this->operator++ ();
+      return it;
+    }
+
+    bool operator== (const iterator_t &rhs) const
+    {
+      return this->_node == rhs._node
+             && (this->_node == nullptr || this->_entry == rhs._entry);
+    }
+
+    bool operator!= (const iterator_t &rhs) const
+    { return !this->operator== (rhs); }
+  };
+};
+
+/**
+ * Dictionary on top of PersistentHashMap, for readers which need a
+ * consistent view of a dictionary that keeps being written.
+ */
+class PersistentDictionary : public PersistentHashMap<std::string, std::string>
+{
+ public:
+  /**
+   * Dictionary keys usually come from outside, so every instance hashes with
+   * its own random seed, like Dictionary.
+   */
+  PersistentDictionary ()
+  { this->reseed (HashMap<std::string, std::string>::random_seed ()); }
+
+  PersistentDictionary (const std::vector<std::string> &keys_vector,
+                        const std::vector<std::string> &values_vector)
+      : PersistentDictionary ()
+  {
+    if (keys_vector.size () != values_vector.size ())
+    { throw std::length_error ("The size of the vectors is unmatched."); }
+    for (std::size_t i = 0; i < keys_vector.size (); ++i)
+    { this->insert_or_assign (keys_vector[i], values_vector[i]); }
+  }
+
+  bool erase (const std::string &key) override
+  {
+    if (!this->contains_key (key))
+    { throw InvalidKey ("Key doesn't exists."); }
+    return PersistentHashMap<std::string, std::string>::erase (key);
+  }
+
+  /**
+   * An immutable view of the dictionary as it is now, in O(1).
+   * @return PersistentDictionary sharing all the nodes of this one.
+   */
+  PersistentDictionary snapshot () const
+  { return *this; }
+};
+
+#endif //_PERSISTENTHASHMAP_HPP_
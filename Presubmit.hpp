@@ -3,6 +3,23 @@
 #include "HashMap.hpp"
 #include "Helpers.h"
 #include "Dictionary.hpp"
+#include "ParallelHashMap.hpp"
+#include "RobinHoodMap.hpp"
+#include "CuckooMap.hpp"
+#include "PersistentHashMap.hpp"
+#include "DurableDictionary.hpp"
+#include "CacheMap.hpp"
+#include "ExpiringMap.hpp"
+#include "Combiner.hpp"
+#include "SetAlgebra.hpp"
+#include "IntegralHashMap.hpp"
+#include "ColumnHashMap.hpp"
+#include "SmallHashMap.hpp"
+#include "OrderedHashMap.hpp"
+#include "SpillHashMap.hpp"
+#include "SharedDictionary.hpp"
+#include <dirent.h>
+#include <sys/wait.h>
 #include <map>
 #include <iostream>
 
@@ -513,7 +530,8 @@ int __presubmit_testClearAndOperatorEquals ()
 int __presubmit_testBucketSize ()
 {
   // Setup a nice map (a bullet-proof one :) that'll map the key to the right bucket index + size).
-  auto wordsToBuckets = std::map<std::string, std::pair<int, int>> ();
+  auto wordsToBuckets =
+      std::map<std::string, std::pair<std::size_t, std::size_t>> ();
   wordsToBuckets["Hello"] = std::make_pair (21, 1);
   wordsToBuckets["hello"] = std::make_pair (8, 2);
   wordsToBuckets["World"] = std::make_pair (9, 2);
@@ -709,6 +727,1246 @@ int __presubmit_testDictionaryErase ()
   return 1;
 }
 
+int __presubmit_testDigest ()
+{
+  HashMap<int, int> map1;
+  HashMap<int, int> map2;
+  map1.enable_digest ();
+  map2.enable_digest ();
+
+  // Same pairs, inserted in a different order
+  for (int i = 0; i < 100; ++i)
+  {
+    map1.insert (i, i);
+    map2.insert (99 - i, 99 - i);
+  }
+  ASSERT_TRUE(map1.digest () == map2.digest ());
+  ASSERT_TRUE(map1 == map2);
+
+  // A tracked value write
+  map2.insert_or_assign (7, 8);
+  ASSERT_TRUE(map1.digest () != map2.digest ());
+  ASSERT_TRUE(map1 != map2);
+
+  // An untracked write through a reference
+  map2.at (7) = 7;
+  ASSERT_TRUE(map1 == map2);
+
+  // Copies keep the digest
+  auto copy = map1;
+  copy.erase (3);
+  ASSERT_TRUE(copy != map1);
+  copy.insert (3, 3);
+  RETURN_ASSERT_TRUE(copy == map1 && copy.digest () == map1.digest ());
+}
+
+int __presubmit_testMerge ()
+{
+  Dictionary base;
+  base["a"] = "1";
+  base["b"] = "2";
+
+  Dictionary overlay;
+  overlay["b"] = "20";
+  overlay["c"] = "30";
+
+  // Overwrite (default)
+  Dictionary merged = base;
+  merged.merge (overlay);
+  ASSERT_TRUE(merged.size () == 3);
+  ASSERT_TRUE(merged.at ("b") == "20" && merged.at ("c") == "30");
+  ASSERT_TRUE(overlay.size () == 2);
+
+  // Keep
+  merged = base;
+  merged.merge (overlay, Dictionary::KEEP);
+  ASSERT_TRUE(merged.size () == 3 && merged.at ("b") == "2");
+
+  // Combine
+  merged = base;
+  merged.merge (overlay, [] (const std::string &existing,
+                             const std::string &incoming)
+  { return existing + incoming; });
+  ASSERT_TRUE(merged.size () == 3 && merged.at ("b") == "220");
+
+  // Move: the nodes of the overlay are stolen
+  merged = base;
+  merged.merge (std::move (overlay));
+  ASSERT_TRUE(merged.size () == 3 && merged.at ("b") == "20");
+  ASSERT_TRUE(overlay.empty ());
+
+  // Counting through a combine function, with a range
+  HashMap<int, int> counts;
+  std::vector<std::pair<int, int>> ones;
+  for (int i = 0; i < 100; ++i)
+  {
+    ones.push_back (std::make_pair (i % 10, 1));
+  }
+  counts.merge (ones.begin (), ones.end (), [] (int a, int b)
+  { return a + b; });
+  ASSERT_TRUE(counts.size () == 10);
+  for (int i = 0; i < 10; ++i)
+  {
+    ASSERT_TRUE(counts.at (i) == 10);
+  }
+
+  // Merging a large map grows the capacity once, to the final size
+  HashMap<int, int> big;
+  for (int i = 0; i < 1000; ++i)
+  {
+    big.insert (i, i);
+  }
+  HashMap<int, int> target;
+  target.merge (big);
+  ASSERT_TRUE(target == big && target.capacity () == big.capacity ());
+
+  // A combine throwing half way through a move leaves both maps usable,
+  // here with a bucket of colliding keys indexed as a tree
+  HashMap<int, int> colliding;
+  for (int i = 0; i < 12; ++i)
+  {
+    colliding.insert (i * 1024, i);
+  }
+  HashMap<int, int> partial;
+  partial.enable_digest ();
+  partial.insert (5 * 1024, -1);
+  bool thrown = false;
+  try
+  {
+    partial.merge (std::move (colliding), [] (int, int) -> int
+    { throw std::runtime_error ("combine"); });
+  }
+  catch (const std::runtime_error &)
+  {
+    thrown = true;
+  }
+  ASSERT_TRUE(thrown && colliding.empty () && !colliding.erase (0));
+  HashMap<int, int> expected;
+  for (int i = 0; i < 6; ++i)
+  {
+    expected.insert (i * 1024, i == 5 ? -1 : i);
+  }
+  ASSERT_TRUE(partial == expected && partial.contains_key (0));
+
+  // Merging keys this map already holds gives the reservation back
+  HashMap<int, int> held, same;
+  for (int i = 0; i < 3000; ++i)
+  {
+    held.insert (i, i);
+    same.insert (i, -i);
+  }
+  std::size_t capacity = held.capacity ();
+  held.merge (same);
+  ASSERT_TRUE(held.capacity () == capacity && held.at (7) == -7);
+  held.merge (HashMap<int, int> (same), HashMap<int, int>::KEEP);
+  std::vector<std::pair<int, int>> pairs (same.cbegin (), same.cend ());
+  held.merge (pairs.begin (), pairs.end ());
+  RETURN_ASSERT_TRUE(held.capacity () == capacity && held.size () == 3000);
+}
+
+int __presubmit_testEraseIf ()
+{
+  HashMap<int, int> map;
+  for (int i = 0; i < 1000; ++i)
+  {
+    map.insert (i, i);
+  }
+  ASSERT_MAP_PROPERTIES(map, 1000.0 / 2048, 2048, 1000);
+
+  // Erase by iterator while scanning, the capacity doesn't change
+  for (auto it = map.cbegin (); it != map.cend ();)
+  {
+    if (it->first % 2 == 0)
+    {
+      it = map.erase (it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+  ASSERT_MAP_PROPERTIES(map, 500.0 / 2048, 2048, 500);
+  for (int i = 0; i < 1000; ++i)
+  {
+    ASSERT_TRUE(map.contains_key (i) == (i % 2 == 1));
+  }
+
+  // Erase most of the rest, and shrink once at the end
+  int removed = map.erase_if ([] (const std::pair<int, int> &pair)
+                              { return pair.first > 10; });
+  ASSERT_TRUE(removed == 495);
+  ASSERT_MAP_PROPERTIES(map, 5.0 / 16, 16, 5);
+  for (int i = 1; i < 10; i += 2)
+  {
+    ASSERT_TRUE(map.at (i) == i);
+  }
+  return 1;
+}
+
+int __presubmit_testParallelRanges ()
+{
+  HashMap<int, int> map;
+  for (int i = 0; i < 10000; ++i)
+  {
+    map.insert (i, i);
+  }
+
+  // The ranges cover every pair exactly once, in iteration order
+  auto ranges = map.split_ranges (7);
+  ASSERT_TRUE(!ranges.empty () && ranges.size () <= 7);
+  int count = 0;
+  auto expected = map.cbegin ();
+  for (const auto &range: ranges)
+  {
+    ASSERT_TRUE(range.begin () == expected);
+    for (auto it = range.begin (); it != range.end (); ++it)
+    {
+      ++count;
+      ++expected;
+    }
+  }
+  ASSERT_TRUE(count == 10000 && expected == map.cend ());
+
+  long sum = parallel_transform_reduce (
+      map, 0L, [] (long a, long b)
+      { return a + b; },
+      [] (const std::pair<int, int> &pair)
+      { return (long) pair.second; }, 4);
+  ASSERT_TRUE(sum == 49995000L);
+  ASSERT_TRUE(parallel_count_if (map, [] (const std::pair<int, int> &pair)
+  { return pair.first % 3 == 0; }, 4) == 3334);
+
+  std::atomic<int> visited (0);
+  parallel_for_each (map, [&] (const std::pair<int, int> &)
+  { ++visited; }, 3);
+  RETURN_ASSERT_TRUE(visited == 10000);
+}
+
+/**
+ * Value whose copy throws once copies_left reaches 0, never if negative.
+ */
+struct copy_bomb
+{
+  static int copies_left;
+
+  copy_bomb () = default;
+
+  copy_bomb (const copy_bomb &)
+  {
+    if (copies_left >= 0 && copies_left-- == 0)
+    { throw std::runtime_error ("Copy bomb."); }
+  }
+
+  copy_bomb &operator= (const copy_bomb &) = default;
+
+  bool operator== (const copy_bomb &) const
+  { return true; }
+};
+
+int copy_bomb::copies_left = -1;
+
+int __presubmit_testRobinHood ()
+{
+  RobinHoodMap<int, int> map;
+  ASSERT_MAP_PROPERTIES(map, 0, 16, 0);
+  for (int i = 0; i < 100; i++)
+  {
+    map.insert (i, i);
+  }
+  ASSERT_MAP_PROPERTIES(map, 0.390625, 256, 100);
+
+  // Erase heavy churn, without tombstones the misses stay cheap
+  for (int round = 0; round < 50; ++round)
+  {
+    for (int i = 0; i < 100; i += 2)
+    {
+      ASSERT_TRUE(map.erase (i));
+    }
+    for (int i = 0; i < 100; i += 2)
+    {
+      ASSERT_TRUE(map.insert (i, round));
+    }
+  }
+  ASSERT_TRUE(map.size () == 100);
+  for (int i = 0; i < 100; ++i)
+  {
+    ASSERT_TRUE(map.at (i) == (i % 2 == 0 ? 49 : i));
+  }
+  for (int i = 100; i < 200; ++i)
+  {
+    ASSERT_TRUE(!map.contains_key (i));
+  }
+
+  // The hash is mixed, so strided keys don't pile up behind one home slot
+  RobinHoodMap<int, int> strided;
+  for (int i = 0; i < 1000; ++i)
+  {
+    strided.insert (i << 16, i);
+  }
+  for (int i = 0; i < 1000; ++i)
+  {
+    ASSERT_TRUE(strided.at (i << 16) == i
+                && strided.bucket_size (i << 16) < 8);
+  }
+
+  // A copy which throws half way frees the pairs it already made
+  RobinHoodMap<std::string, copy_bomb> bombs;
+  for (int i = 0; i < 100; ++i)
+  {
+    bombs.insert (std::string (32, 'a' + i % 26) + std::to_string (i),
+                  copy_bomb ());
+  }
+  copy_bomb::copies_left = 50;
+  ASSERT_THROWING(RobinHoodMap<std::string, copy_bomb> copy (bombs););
+  copy_bomb::copies_left = -1;
+  RobinHoodMap<std::string, copy_bomb> copy (bombs);
+  RETURN_ASSERT_TRUE(copy == bombs && copy.size () == 100);
+}
+
+int __presubmit_testCuckoo ()
+{
+  CuckooMap<int, int> map;
+  ASSERT_TRUE(map.capacity () == 16 && map.empty ());
+
+  // Fill up to the maximal load factor without growing
+  for (int i = 0; i < 15; ++i)
+  {
+    ASSERT_TRUE(map.insert (i, i));
+  }
+  ASSERT_TRUE(map.capacity () == 16);
+  ASSERT_TRUE(!map.insert (3, 4));
+
+  for (int i = 15; i < 10000; ++i)
+  {
+    map[i] = i;
+  }
+  ASSERT_TRUE(map.size () == 10000 && map.get_load_factor () > 0.5);
+  for (int i = 0; i < 10000; i += 2)
+  {
+    ASSERT_TRUE(map.erase (i));
+  }
+  for (int i = 0; i < 10000; ++i)
+  {
+    ASSERT_TRUE(map.contains_key (i) == (i % 2 == 1));
+  }
+  ASSERT_THROWING(map.at (2););
+
+  int count = 0;
+  for (const auto &pair: map)
+  {
+    ASSERT_TRUE(pair.first == pair.second);
+    ++count;
+  }
+  RETURN_ASSERT_TRUE(count == 5000);
+}
+
+/**
+ * Key whose std::hash is constant, counting its equality tests.
+ */
+struct flood_key
+{
+  int id;
+  static int comparisons;
+
+  bool operator== (const flood_key &rhs) const
+  {
+    ++comparisons;
+    return this->id == rhs.id;
+  }
+
+  bool operator< (const flood_key &rhs) const
+  { return this->id < rhs.id; }
+};
+
+int flood_key::comparisons = 0;
+
+namespace std
+{
+template<>
+struct hash<flood_key>
+{
+  std::size_t operator() (const flood_key &) const
+  { return 42; }
+};
+}
+
+int __presubmit_testCollisions ()
+{
+  // std::hash<int> is the identity, so these keys all land in bucket 0
+  HashMap<int, int> map;
+  for (int i = 0; i < 1000; ++i)
+  {
+    ASSERT_TRUE(map.insert (i << 20, i));
+  }
+  ASSERT_TRUE(map.bucket_size (0) == 1000);
+  for (int i = 0; i < 1000; ++i)
+  {
+    ASSERT_TRUE(map.at (i << 20) == i);
+  }
+  for (int i = 0; i < 1000; i += 2)
+  {
+    ASSERT_TRUE(map.erase (i << 20));
+  }
+  ASSERT_TRUE(map.size () == 500 && !map.contains_key (2 << 20));
+  HashMap<int, int> copy (map);
+  ASSERT_TRUE(copy == map && copy.at (3 << 20) == 3);
+
+  // A seed spreads them again
+  map.reseed (HashMap<int, int>::random_seed ());
+  ASSERT_TRUE(map.bucket_size (1 << 20) < 500 && map == copy);
+  for (int i = 1; i < 1000; i += 2)
+  {
+    ASSERT_TRUE(map.at (i << 20) == i);
+  }
+
+  // Every dictionary has its own seed, they still compare by content
+  Dictionary first, second;
+  for (int i = 0; i < 100; ++i)
+  {
+    first.insert (std::to_string (i), "v");
+    second.insert (std::to_string (99 - i), "v");
+  }
+  ASSERT_TRUE(first == second && second.at ("42") == "v");
+
+  // Keys with equal hashes are ordered by operator< in the index, so a
+  // lookup compares a couple of keys, not the whole chain
+  HashMap<flood_key, int> flooded;
+  for (int i = 0; i < 1000; ++i)
+  {
+    flooded.insert (flood_key {i}, i);
+  }
+  flood_key::comparisons = 0;
+  ASSERT_TRUE(flooded.at (flood_key {777}) == 777);
+  ASSERT_TRUE(!flooded.contains_key (flood_key {1000}));
+  ASSERT_TRUE(flooded.erase (flood_key {777}) && flooded.size () == 999);
+  ASSERT_TRUE(flood_key::comparisons <= 4
+              && !flooded.contains_key (flood_key {777}));
+
+  // No seed splits keys with equal hashes, so a cuckoo map holds two
+  // buckets and a stash of them, then refuses more instead of growing
+  CuckooMap<flood_key, int> cuckoo;
+  for (int i = 0; i < 2 * CUCKOO_SLOTS + CUCKOO_STASH_SIZE; ++i)
+  {
+    ASSERT_TRUE(cuckoo.insert (flood_key {i}, i));
+  }
+  ASSERT_THROWING(cuckoo.insert (flood_key {-1}, -1););
+  ASSERT_TRUE(cuckoo.size () == 12 && !cuckoo.contains_key (flood_key {-1}));
+  for (int i = 0; i < 12; ++i)
+  {
+    ASSERT_TRUE(cuckoo.at (flood_key {i}) == i);
+  }
+  RETURN_ASSERT_TRUE(cuckoo.erase (flood_key {0})
+                     && cuckoo.insert (flood_key {-1}, -1)
+                     && cuckoo.size () == 12);
+}
+
+int __presubmit_testPersistent ()
+{
+  PersistentHashMap<int, int> map;
+  for (int i = 0; i < 5000; ++i)
+  {
+    ASSERT_TRUE(map.insert (i, i));
+  }
+  ASSERT_TRUE(!map.insert (7, 8) && map.size () == 5000);
+
+  // Writes after a snapshot don't show in it, and the other way around
+  PersistentHashMap<int, int> snapshot = map.snapshot ();
+  ASSERT_TRUE(snapshot == map);
+  for (int i = 0; i < 5000; i += 2)
+  {
+    ASSERT_TRUE(map.erase (i));
+  }
+  map[1] = -1;
+  map.insert_or_assign (3, -3);
+  ASSERT_TRUE(map.size () == 2500 && map.at (1) == -1 && map.at (3) == -3);
+  ASSERT_THROWING(map.at (2););
+  ASSERT_TRUE(snapshot.size () == 5000 && snapshot.at (1) == 1);
+  for (int i = 0; i < 5000; ++i)
+  {
+    ASSERT_TRUE(snapshot.at (i) == i);
+    ASSERT_TRUE(map.contains_key (i) == (i % 2 == 1));
+  }
+  ASSERT_TRUE(snapshot != map);
+
+  int count = 0;
+  for (const auto &pair: map)
+  {
+    ASSERT_TRUE(pair.second == (pair.first < 4 ? -pair.first : pair.first));
+    ++count;
+  }
+  ASSERT_TRUE(count == 2500);
+
+  PersistentDictionary dictionary;
+  dictionary.insert ("a", "1");
+  PersistentDictionary view = dictionary.snapshot ();
+  dictionary["a"] = "2";
+  ASSERT_THROWING(dictionary.erase ("b"););
+  ASSERT_TRUE(view.at ("a") == "1" && dictionary.at ("a") == "2");
+
+  // Every dictionary has its own seed, they still compare by content, and
+  // reseeding keeps the pairs
+  PersistentDictionary first ({"a", "b"}, {"2", "3"});
+  PersistentDictionary second;
+  second.insert ("b", "3");
+  second.insert ("a", "2");
+  ASSERT_TRUE(first == second);
+  PersistentHashMap<int, int> seeded;
+  for (int i = 0; i < 1000; ++i)
+  {
+    seeded.insert (i, i);
+  }
+  seeded.reseed (HashMap<int, int>::random_seed ());
+  RETURN_ASSERT_TRUE(seeded.size () == 1000 && seeded.at (777) == 777
+                     && !seeded.contains_key (1000));
+}
+
+int __presubmit_testDurable ()
+{
+  char directory[] = "/tmp/presubmit_wal_XXXXXX";
+  ASSERT_TRUE(mkdtemp (directory) != nullptr);
+  {
+    DurableDictionary dictionary (directory, 8);
+    for (int i = 0; i < 100; ++i)
+    {
+      dictionary.insert (std::to_string (i), "v" + std::to_string (i));
+    }
+    dictionary["1"] = "one";
+    ASSERT_TRUE(dictionary.erase ("2"));
+    ASSERT_THROWING(dictionary.erase ("2"););
+    dictionary.compact ();
+    dictionary.insert_or_assign ("3", "three");
+    dictionary.erase ("4");
+    ASSERT_TRUE(dictionary.dictionary ().at ("3") == "three");
+    dictionary.close ();
+    ASSERT_THROWING(dictionary.insert ("5", "five"););
+  }
+  {
+    DurableDictionary dictionary (directory);
+    ASSERT_TRUE(dictionary.size () == 98);
+    ASSERT_TRUE(dictionary.at ("1") == "one" && dictionary.at ("3") == "three");
+    ASSERT_TRUE(!dictionary.contains_key ("2") && !dictionary.contains_key ("4"));
+    ASSERT_TRUE((const std::string &) dictionary["50"] == "v50");
+    dictionary.insert ("torn", "tail");
+  }
+
+  // A torn record at the end of a log is dropped, the records before stay
+  std::string log = std::string (directory) + "/log.3";
+  FILE *file = fopen (log.c_str (), "ab");
+  ASSERT_TRUE(file != nullptr);
+  fputs ("\x01garbage", file);
+  fclose (file);
+  {
+    DurableDictionary dictionary (directory);
+    ASSERT_TRUE(dictionary.size () == 99 && dictionary.at ("torn") == "tail");
+    dictionary.compact ();
+    dictionary.wait_compaction ();
+  }
+  bool recovered;
+  {
+    DurableDictionary dictionary (directory);
+    recovered = dictionary.size () == 99 && dictionary.at ("99") == "v99";
+  }
+  DIR *entries = opendir (directory);
+  for (dirent *entry = readdir (entries); entry != nullptr;
+       entry = readdir (entries))
+  {
+    unlink ((std::string (directory) + "/" + entry->d_name).c_str ());
+  }
+  closedir (entries);
+  rmdir (directory);
+  RETURN_ASSERT_TRUE(recovered);
+}
+
+int __presubmit_testCache ()
+{
+  CacheMap<int, int> lru (3);
+  lru.put (1, 1);
+  lru.put (2, 2);
+  lru.put (3, 3);
+  ASSERT_TRUE(*lru.get (1) == 1);
+  lru.put (4, 4);
+  ASSERT_TRUE(lru.size () == 3 && !lru.contains_key (2));
+  ASSERT_TRUE(lru.get (2) == nullptr && lru.hits () == 1 && lru.misses () == 1);
+
+  // SIEVE spares the hit entry and evicts the newer, unused one
+  CacheMap<int, int> sieve (3, SIEVE);
+  sieve.put (1, 1);
+  sieve.put (2, 2);
+  sieve.put (3, 3);
+  sieve.get (1);
+  sieve.put (4, 4);
+  ASSERT_TRUE(sieve.contains_key (1) && !sieve.contains_key (2));
+  sieve.put (5, 5);
+  ASSERT_TRUE(sieve.contains_key (1) && !sieve.contains_key (3));
+
+  CacheMap<int, int> clock (100, CLOCK);
+  for (int i = 0; i < 1000; ++i)
+  {
+    clock.put (i, i);
+    clock.get (i / 2);
+  }
+  ASSERT_TRUE(clock.size () == 100 && clock.used () == 100);
+  ASSERT_TRUE(clock.erase (999) && !clock.erase (999));
+
+  // Short strings live in the string object, only long ones weigh heap
+  ASSERT_TRUE(heap_bytes (std::string ("short")) == 0
+              && heap_bytes (std::string (100, 'x')) == 101);
+  CacheMap<std::string, std::string> bytes (4096, LRU, BYTES);
+  for (int i = 0; i < 100; ++i)
+  {
+    bytes.put (std::to_string (i), std::string (100, 'x'));
+  }
+  ASSERT_TRUE(bytes.used () <= 4096 && bytes.size () < 100);
+  ASSERT_TRUE(!bytes.put ("huge", std::string (5000, 'x')));
+  bytes.clear ();
+  RETURN_ASSERT_TRUE(bytes.empty () && bytes.used () == 0);
+}
+
+struct __presubmit_clock
+{
+  typedef std::chrono::milliseconds duration;
+  typedef duration::rep rep;
+  typedef duration::period period;
+  typedef std::chrono::time_point<__presubmit_clock> time_point;
+  static const bool is_steady = true;
+
+  static long long &current ()
+  {
+    static long long milliseconds = 0;
+    return milliseconds;
+  }
+
+  static time_point now ()
+  { return time_point (duration (current ())); }
+};
+
+int __presubmit_testExpiring ()
+{
+  ExpiringMap<int, int, __presubmit_clock> map;
+  for (int i = 0; i < 1000; ++i)
+  {
+    ASSERT_TRUE(map.insert_with_ttl (i, i, std::chrono::milliseconds (i + 1)));
+  }
+  map.insert (-1, -1);
+  ASSERT_TRUE(!map.insert_with_ttl (5, 0, std::chrono::milliseconds (1)));
+
+  // Due entries are hidden right away and removed by the next write
+  __presubmit_clock::current () = 500;
+  ASSERT_TRUE(!map.contains_key (10) && map.contains_key (500));
+  ASSERT_TRUE(map.size () == 1001);
+  ASSERT_THROWING(map.at (499););
+  ASSERT_TRUE(map.expire_after (-1, std::chrono::milliseconds (100000)));
+  ASSERT_TRUE(map.size () == 501 && map.scheduled () == 501);
+  ASSERT_TRUE(map.insert_with_ttl (10, 10, std::chrono::milliseconds (5)));
+
+  __presubmit_clock::current () = 100000;
+  ASSERT_TRUE(map.expire () == 501 && map.size () == 1);
+  ASSERT_TRUE(map.at (-1) == -1 && map.erase (-1));
+  __presubmit_clock::current () = 100500;
+  ASSERT_TRUE(map.expire () == 0 && map.empty ());
+
+  ExpiringDictionary dictionary;
+  dictionary.insert_with_ttl ("token", "a", std::chrono::hours (1));
+  ASSERT_THROWING(dictionary.erase ("missing"););
+  RETURN_ASSERT_TRUE(dictionary.at ("token") == "a");
+}
+
+int __presubmit_testCombiner ()
+{
+  Combiner<std::string, long> combiner (4);
+  std::vector<std::thread> threads;
+  for (int worker = 0; worker < 4; ++worker)
+  {
+    threads.emplace_back ([&combiner, worker] ()
+    {
+      HashMap<std::string, long> &local = combiner.local (worker);
+      for (int i = 0; i < 20000; ++i)
+      {
+        // Key k is counted k + 1 times in total, whatever the worker
+        int key = (i * 4 + worker) % 1000;
+        local[std::to_string (key)] += 1;
+      }
+    });
+  }
+  for (auto &thread: threads)
+  {
+    thread.join ();
+  }
+
+  HashMap<std::string, long> counts = combiner.combine (4);
+  ASSERT_TRUE(counts.size () == 1000 && combiner.local (0).empty ());
+  long total = 0;
+  for (const auto &pair: counts)
+  {
+    ASSERT_TRUE(pair.second == 80);
+    total += pair.second;
+  }
+  ASSERT_TRUE(total == 80000);
+
+  HashMap<int, int> values;
+  for (int i = 0; i < 1000; ++i)
+  {
+    values.insert (i, (i * 37) % 1000);
+  }
+
+  // Partition merges would race on a filter, so they refuse one
+  partitioned_map<int, int> filtered;
+  filtered.enable_filter ();
+  auto sum = [] (int existing, int incoming) { return existing + incoming; };
+  ASSERT_THROWING(filtered.merge_partition (values, 0, 1, sum););
+
+  auto best = top_k (values, 3, 4);
+  ASSERT_TRUE(best.size () == 3 && top_k (values, 0).empty ());
+  RETURN_ASSERT_TRUE(best[0].second == 999 && best[1].second == 998
+                     && best[2].second == 997);
+}
+
+int __presubmit_testLargeSizes ()
+{
+  // Sizes past INT_MAX are only checked on the capacity arithmetic: every
+  // bucket is constructed when the table is allocated, so even an empty
+  // table of 2^31 buckets takes tens of GB, whatever the key type
+  typedef HashMap<int, int> int_map;
+  ASSERT_TRUE((std::is_same<decltype (int_map ().size ()),
+                            std::size_t>::value));
+  ASSERT_TRUE((std::is_same<decltype (int_map ().capacity ()),
+                            std::size_t>::value));
+  ASSERT_TRUE(int_map::capacity_for (0) == START_CAPACITY);
+  ASSERT_TRUE(int_map::capacity_for (12) == 16);
+  ASSERT_TRUE(int_map::capacity_for (13) == 32);
+  ASSERT_TRUE(int_map::capacity_for (3000000000ULL)
+              == (std::size_t) 1 << 32);
+  ASSERT_TRUE(int_map::capacity_for ((std::size_t) 1 << 31)
+              == (std::size_t) 1 << 32);
+  ASSERT_TRUE(int_map::capacity_for ((std::size_t) 3 << 31)
+              == (std::size_t) 1 << 33);
+
+  int_map map;
+  map.reserve (100000);
+  ASSERT_TRUE(map.capacity () == int_map::capacity_for (100000));
+  for (int i = 0; i < 100000; ++i)
+  {
+    map.insert (i, i);
+  }
+  RETURN_ASSERT_TRUE(map.size () == 100000
+                     && map.capacity () == (std::size_t) 1 << 18);
+}
+
+int __presubmit_testTablePolicy ()
+{
+  // Huge pages and NUMA placement are hints, this only checks the mapped
+  // tables behave like heap ones, whatever the machine grants
+  table_policy policy;
+  policy.pages = TRANSPARENT_HUGE_PAGES;
+  policy.numa = NUMA_INTERLEAVE;
+  HashMap<int, int> map;
+  map.set_table_policy (policy);
+  ASSERT_TRUE(map.get_table_policy ().pages == TRANSPARENT_HUGE_PAGES);
+  for (int i = 0; i < 200000; ++i)
+  {
+    map.insert (i, i * 2);
+  }
+  ASSERT_TRUE(map.capacity () * sizeof (std::list<int>) >= HUGE_PAGE_SIZE);
+
+  HashMap<int, int> copy = map;
+  policy.pages = EXPLICIT_HUGE_PAGES;
+  policy.numa = NUMA_BIND;
+  copy.set_table_policy (policy);
+  ASSERT_TRUE(copy == map && copy.at (199999) == 399998);
+
+  HashMap<int, int> other;
+  swap (other, copy);
+  ASSERT_TRUE(other.get_table_policy ().pages == EXPLICIT_HUGE_PAGES
+              && copy.get_table_policy ().pages == SMALL_PAGES);
+  for (int i = 0; i < 199990; ++i)
+  {
+    other.erase (i);
+  }
+  RETURN_ASSERT_TRUE(other.size () == 10 && other.at (199995) == 399990
+                     && other.capacity () < 64);
+}
+
+int __presubmit_testFilter ()
+{
+  blocked_bloom_filter filter (10000, 0.01);
+  for (std::size_t i = 0; i < 10000; ++i)
+  {
+    filter.add (std::hash<std::string> {} (std::to_string (i)));
+  }
+  int false_positives = 0;
+  for (int i = 10000; i < 110000; ++i)
+  {
+    false_positives += filter.may_contain (
+        std::hash<std::string> {} (std::to_string (i)));
+  }
+  ASSERT_TRUE(false_positives < 1000);
+
+  Dictionary dict;
+  dict.enable_filter (0.05);
+  for (int i = 0; i < 5000; ++i)
+  {
+    dict.insert ("word" + std::to_string (i), "value");
+  }
+  for (int i = 0; i < 5000; i += 2)
+  {
+    dict.erase ("word" + std::to_string (i));
+  }
+  Dictionary copy = dict;
+  for (int i = 0; i < 5000; ++i)
+  {
+    bool odd = i % 2 == 1;
+    ASSERT_TRUE(dict.contains_key ("word" + std::to_string (i)) == odd);
+    ASSERT_TRUE(copy.contains_key ("word" + std::to_string (i)) == odd);
+    ASSERT_TRUE(!dict.contains_key ("other" + std::to_string (i)));
+  }
+  dict.clear ();
+  ASSERT_TRUE(!dict.contains_key ("word1") && dict.filter_enabled ());
+  dict.insert ("word1", "value");
+  dict.disable_filter ();
+  RETURN_ASSERT_TRUE(dict.contains_key ("word1") && !dict.filter_enabled ());
+}
+
+int __presubmit_testSetAlgebra ()
+{
+  // a holds the multiples of 2, b the multiples of 3, c is b re-seeded
+  HashMap<int, int> a, b, c;
+  for (int i = 0; i < 60000; i += 2)
+  {
+    a.insert (i, 1);
+  }
+  for (int i = 0; i < 60000; i += 3)
+  {
+    b.insert (i, 2);
+    c.insert (i, 2);
+  }
+  c.reseed (HashMap<int, int>::random_seed ());
+  for (const HashMap<int, int> *other: {&b, &c})
+  {
+    HashMap<int, int> both = intersect (a, *other, 4);
+    HashMap<int, int> either = union_with (*other, a, 4);
+    HashMap<int, int> only = difference (a, *other, 4);
+    ASSERT_TRUE(both.size () == 10000 && either.size () == 40000);
+    ASSERT_TRUE(only.size () == 20000 && only.at (2) == 1);
+    ASSERT_TRUE(both.at (6) == 1 && either.at (6) == 2 && either.at (4) == 1);
+    ASSERT_TRUE(!only.contains_key (6) && !both.contains_key (4));
+    ASSERT_TRUE(intersect (*other, a, 1).at (6) == 2);
+  }
+
+  HashMap<int, int> few;
+  few.insert (0, 0);
+  few.insert (1, 0);
+  ASSERT_TRUE(difference (a, few).size () == 29999);
+  ASSERT_TRUE(difference (few, a).size () == 1);
+
+  HashMap<int, std::string> names;
+  for (int i = 0; i < 10; ++i)
+  {
+    names.insert (i, std::to_string (i));
+  }
+  auto joined = hash_join (b, names);
+  ASSERT_TRUE(joined.size () == 4 && joined.at (9).first == 2);
+  RETURN_ASSERT_TRUE(joined.at (9).second == "9"
+                     && hash_join (names, b).at (3).first == "3");
+}
+
+int __presubmit_testIntegralMap ()
+{
+  alignas (GROUP_BYTES) std::uint32_t narrow[16];
+  alignas (GROUP_BYTES) std::uint64_t wide[8];
+  for (int i = 0; i < 16; ++i)
+  {
+    narrow[i] = i % 3 == 0 ? UINT32_MAX : (std::uint32_t) i % 5;
+    wide[i / 2] = i % 3 == 0 ? UINT64_MAX : (std::uint64_t) i % 5 << 33;
+  }
+  for (int level = SIMD_SSE2; level <= detected_simd_level (); ++level)
+  {
+    for (std::uint64_t key = 0; key < 5; ++key)
+    {
+      ASSERT_TRUE(scan_group ((simd_level) level, narrow, (std::uint32_t) key,
+                              UINT32_MAX)
+                  == scan_group_scalar (narrow, (std::uint32_t) key,
+                                        UINT32_MAX));
+      ASSERT_TRUE(scan_group ((simd_level) level, wide, key << 33, UINT64_MAX)
+                  == scan_group_scalar (wide, key << 33, UINT64_MAX));
+    }
+  }
+
+  ASSERT_TRUE((std::is_same<FastHashMap<int, int>,
+                            IntegralHashMap<int, int>>::value));
+  ASSERT_TRUE((std::is_same<FastHashMap<std::string, int>,
+                            HashMap<std::string, int>>::value));
+  IntegralHashMap<long, std::string> map;
+  for (long i = -20000; i < 20000; ++i)
+  {
+    map.insert (i * 7919, std::to_string (i));
+  }
+  const long sentinel = std::numeric_limits<long>::min ();
+  map[sentinel] = "min";
+  ASSERT_TRUE(map.size () == 40001 && map.at (-7919) == "-1");
+  ASSERT_TRUE(map.at (sentinel) == "min" && !map.contains_key (1));
+  IntegralHashMap<long, std::string> copy = map;
+  for (long i = -20000; i < 20000; i += 2)
+  {
+    ASSERT_TRUE(map.erase (i * 7919));
+  }
+  ASSERT_TRUE(map.size () == 20001 && !map.erase (0));
+  std::size_t visited = 0;
+  for (const auto &pair: map)
+  {
+    ASSERT_TRUE(pair.first == sentinel || pair.first / 7919 % 2 != 0);
+    ++visited;
+  }
+  ASSERT_TRUE(visited == 20001 && copy.size () == 40001 && copy != map);
+
+  IntegralHashMap<unsigned, int> scalar;
+  scalar.use_simd_level (SIMD_SCALAR);
+  for (unsigned i = 0; i < 1000; ++i)
+  {
+    scalar.insert (i, (int) i);
+  }
+  for (unsigned i = 0; i < 990; ++i)
+  {
+    scalar.erase (i);
+  }
+  RETURN_ASSERT_TRUE(scalar.size () == 10 && scalar.at (995) == 995
+                     && scalar.capacity () < 64
+                     && scalar.get_simd_level () == SIMD_SCALAR);
+}
+
+int __presubmit_testColumnMap ()
+{
+  ColumnHashMap<std::string, std::string> map;
+  for (int i = 0; i < 3000; ++i)
+  {
+    map.insert ("key" + std::to_string (i), std::string (100, 'a' + i % 26));
+  }
+  ASSERT_TRUE(map.size () == 3000 && map.contains_key ("key2999"));
+  ASSERT_TRUE(!map.contains_key ("key3000") && map.at ("key27")[0] == 'b');
+  ColumnHashMap<std::string, std::string> copy = map;
+  for (int i = 0; i < 3000; i += 3)
+  {
+    ASSERT_TRUE(map.erase ("key" + std::to_string (i)));
+  }
+  ASSERT_TRUE(map.size () == 2000 && copy != map && copy.size () == 3000);
+  map["key0"] = "back";
+  std::size_t keys = 0;
+  for (const std::string &key: map.keys ())
+  {
+    ASSERT_TRUE(map.contains_key (key));
+    ++keys;
+  }
+  std::size_t pairs = 0;
+  for (const auto &pair: map)
+  {
+    ASSERT_TRUE(map.at (pair.first) == pair.second);
+    ++pairs;
+  }
+  ASSERT_TRUE(keys == 2001 && pairs == 2001);
+  ASSERT_TRUE(map.begin ()->second == map.at (map.begin ()->first));
+  for (int i = 1; i < 3000; ++i)
+  {
+    map.erase ("key" + std::to_string (i));
+  }
+  RETURN_ASSERT_TRUE(map.size () == 1 && map.at ("key0") == "back"
+                     && map.capacity () == START_CAPACITY);
+}
+
+int __presubmit_testSmallMaps ()
+{
+  // Maps which never allocated still behave as empty maps of START_CAPACITY
+  HashMap<std::string, int> lazy;
+  HashMap<std::string, int> lazy_copy = lazy;
+  ASSERT_TRUE(lazy.capacity () == START_CAPACITY && !lazy.contains_key ("a"));
+  ASSERT_TRUE(lazy.begin () == lazy.end () && lazy == lazy_copy);
+  lazy.clear ();
+  lazy.erase ("a");
+  lazy.merge (lazy_copy);
+  lazy.shrink_to_fit ();
+  lazy.erase_if ([] (const std::pair<std::string, int> &) { return true; });
+  ASSERT_TRUE(lazy.capacity () == START_CAPACITY);
+  ASSERT_TRUE(intersect (lazy, lazy_copy).empty ());
+  ASSERT_TRUE(intersect (lazy, lazy_copy).capacity () == START_CAPACITY);
+  lazy["a"] = 1;
+  ASSERT_TRUE(lazy.at ("a") == 1 && lazy_copy.empty () && lazy != lazy_copy);
+
+  SmallHashMap<std::string, int, 4> small;
+  for (int i = 0; i < 4; ++i)
+  {
+    small.insert (std::to_string (i), i);
+  }
+  ASSERT_TRUE(small.is_inline () && small.size () == 4);
+  ASSERT_TRUE(!small.insert ("0", 5) && small.at ("3") == 3);
+  small["4"] = 4;
+  ASSERT_TRUE(!small.is_inline () && small.size () == 5 && small.at ("4") == 4);
+  SmallHashMap<std::string, int, 4> copy = small;
+  ASSERT_TRUE(copy == small && small.erase ("0") && small.erase ("1"));
+  ASSERT_TRUE(!small.is_inline () && small.erase ("2") && small.is_inline ());
+  ASSERT_TRUE(small.size () == 2 && !small.contains_key ("2"));
+  int sum = 0;
+  for (const auto &pair: small)
+  {
+    sum += pair.second;
+  }
+  ASSERT_TRUE(sum == 7 && small.erase ("3") && small.at ("4") == 4);
+
+  // Inline pairs keep their insertion order through an erase
+  SmallHashMap<int, int, 4> ordered;
+  for (int i = 1; i <= 4; ++i)
+  {
+    ordered[i] = i;
+  }
+  ordered.erase (2);
+  std::vector<int> order;
+  for (const auto &pair: ordered)
+  {
+    order.push_back (pair.first);
+  }
+  ASSERT_TRUE((order == std::vector<int> {1, 3, 4}));
+  swap (small, copy);
+  RETURN_ASSERT_TRUE(small.size () == 5 && copy.size () == 1
+                     && copy.is_inline () && copy.begin ()->first == "4");
+}
+
+int __presubmit_testOrderedMap ()
+{
+  OrderedHashMap<int, std::string> map;
+  for (int i = 99; i >= -1; --i)
+  {
+    map.insert (i, std::to_string (i));
+  }
+  ASSERT_TRUE(map.size () == 101 && map.index_width () == 1);
+  ASSERT_TRUE(map.at (-1) == "-1" && map.begin ()->first == 99);
+  for (int i = 0; i < 100; i += 2)
+  {
+    map.erase (i);
+  }
+  ASSERT_TRUE(map.size () == 51 && map.holes () == 50);
+  map.insert_or_assign (99, "first");
+  map[1000] = "last";
+  int previous = 100;
+  for (const auto &pair: map)
+  {
+    // Pairs keep their insertion order, assigned keys keep their place
+    ASSERT_TRUE(pair.first == 1000 || (pair.first < previous
+                                       && (pair.first % 2 != 0)));
+    previous = pair.first == 1000 ? previous : pair.first;
+  }
+  ASSERT_TRUE(map.begin ()->second == "first" && previous == -1);
+  OrderedHashMap<int, std::string> copy = map;
+  map.compact ();
+  ASSERT_TRUE(map.holes () == 0 && copy.holes () == 0 && copy == map);
+  ASSERT_TRUE(map.begin ()->first == 99 && map.at (1) == "1");
+
+  OrderedHashMap<int, int> wide;
+  for (int i = 0; i < 100000; ++i)
+  {
+    wide.insert (i, i);
+  }
+  ASSERT_TRUE(wide.index_width () == 4 && wide.at (77777) == 77777);
+  for (int i = 0; i < 99990; ++i)
+  {
+    wide.erase (i);
+  }
+  RETURN_ASSERT_TRUE(wide.size () == 10 && wide.index_width () == 1
+                     && wide.begin ()->first == 99990);
+}
+
+int __presubmit_testLookups ()
+{
+  HashMap<std::string, int> map;
+  for (int i = 0; i < 100; ++i)
+  {
+    map.insert (std::to_string (i), i);
+  }
+  const HashMap<std::string, int> &view = map;
+  ASSERT_TRUE(view.find ("42") != view.end () && view.find ("42")->second == 42);
+  ASSERT_TRUE(view.find ("100") == view.end () && view.try_get ("100") == nullptr);
+  ASSERT_TRUE(*view.try_get ("7") == 7 && view.get_or ("x", -1) == -1);
+  ASSERT_TRUE(view.get_or ("8", -1) == 8);
+  *map.try_get ("8") = 80;
+  ASSERT_TRUE(map.at ("8") == 80 && map.bucket_index ("8") < map.capacity ());
+  ASSERT_TRUE(map.bucket_size ("8") >= 1);
+  auto it = map.find ("9");
+  it = map.erase (it);
+  ASSERT_TRUE(!map.contains_key ("9") && map.size () == 99);
+  bool thrown = false;
+  try
+  {
+    view.at ("9");
+  }
+  catch (const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  ASSERT_TRUE(thrown && map["9"] == 0 && map.size () == 100);
+
+  Dictionary dict;
+  dict.insert ("a", "b");
+  ASSERT_TRUE(!dict.try_erase ("c") && dict.try_erase ("a"));
+  thrown = false;
+  try
+  {
+    dict.erase ("a");
+  }
+  catch (const InvalidKey &)
+  {
+    thrown = true;
+  }
+  RETURN_ASSERT_TRUE(thrown && dict.empty ());
+}
+
+int __presubmit_testSpillMap ()
+{
+  char directory[] = "/tmp/presubmit_spill_XXXXXX";
+  ASSERT_TRUE(mkdtemp (directory) != nullptr);
+  bool spilled;
+  {
+    // Room for a few hundred pairs out of 2000, spread over 16 segments
+    SpillHashMap<int, std::string> map (directory, 20000, 4);
+    for (int i = 0; i < 2000; ++i)
+    {
+      map.insert_or_assign (i, "value number " + std::to_string (i));
+    }
+    for (int i = 0; i < 2000; i += 2)
+    {
+      map.insert_or_assign (i, std::to_string (i));
+    }
+    ASSERT_TRUE(map.resident_bytes () <= 20000 && map.segment_spills () != 0);
+    ASSERT_TRUE(map.size () == 2000 && map.resident_bytes () <= 20000);
+    ASSERT_TRUE(map.at (10) == "10" && map.get_or (11, "") == "value number 11");
+    ASSERT_TRUE(map.erase (10) && !map.erase (10) && !map.contains_key (10));
+    ASSERT_THROWING(map.at (-1););
+
+    std::vector<int> keys;
+    for (int i = -100; i < 2000; i += 3)
+    {
+      keys.push_back (i);
+    }
+    std::size_t loads = map.segment_loads ();
+    std::size_t found = 0;
+    bool values_match = true;
+    map.bulk_lookup (keys, [&] (std::size_t i, const std::string *value)
+    {
+      if (value != nullptr)
+      {
+        ++found;
+        int key = keys[i];
+        values_match = values_match && *value == (key % 2 == 0
+            ? std::to_string (key) : "value number " + std::to_string (key));
+      }
+    });
+    std::size_t pairs = 0;
+    map.for_each ([&] (int, const std::string &) { ++pairs; });
+    spilled = found == 666 && values_match && pairs == 1999
+              && map.segment_loads () > loads;
+  }
+  DIR *entries = opendir (directory);
+  std::size_t files = 0;
+  for (dirent *entry = readdir (entries); entry != nullptr;
+       entry = readdir (entries))
+  {
+    files += entry->d_name[0] != '.';
+  }
+  closedir (entries);
+  rmdir (directory);
+  RETURN_ASSERT_TRUE(spilled && files == 0);
+}
+
+int __presubmit_testSharedDictionary ()
+{
+  std::string name = "/presubmit_shared_" + std::to_string (getpid ());
+  SharedDictionary writer (name, 1 << 20);
+  for (int i = 0; i < 500; ++i)
+  {
+    writer.insert (std::to_string (i), "a");
+  }
+  ASSERT_TRUE(!writer.insert ("1", "b") && writer.at ("1") == "a");
+  ASSERT_TRUE(writer.size () == 500 && writer.get_load_factor () <= 0.75);
+
+  // A reader process sees every key with one of its two values while the
+  // writer keeps rewriting them
+  pid_t child = fork ();
+  if (child == 0)
+  {
+    SharedDictionary reader (name);
+    bool consistent = true;
+    std::string value;
+    for (int round = 0; round < 20000; ++round)
+    {
+      int key = round % 500;
+      consistent = consistent && reader.try_get (std::to_string (key), value)
+                   && (value == "a" || value == std::string (key % 97, 'b'));
+    }
+    try
+    {
+      reader.insert ("new", "pair");
+      consistent = false;
+    }
+    catch (const std::logic_error &)
+    {}
+    // The instance inherited from the writer is read only here too
+    try
+    {
+      writer.clear ();
+      consistent = false;
+    }
+    catch (const std::logic_error &)
+    {}
+    _exit (consistent ? 0 : 1);
+  }
+  for (int round = 0; round < 20; ++round)
+  {
+    for (int i = 0; i < 500; ++i)
+    {
+      writer.insert_or_assign (std::to_string (i), round % 2 == 0
+                                                   ? std::string (i % 97, 'b')
+                                                   : "a");
+    }
+  }
+  int status;
+  ASSERT_TRUE(waitpid (child, &status, 0) == child);
+  ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  ASSERT_TRUE(writer.try_erase ("7") && !writer.contains_key ("7"));
+  ASSERT_THROWING(writer.erase ("7"););
+  writer.clear ();
+  SharedDictionary::remove (name);
+  RETURN_ASSERT_TRUE(writer.empty () && writer.insert ("7", "a"));
+}
+
+int __presubmit_testInsertBulk ()
+{
+  std::vector<long> keys;
+  std::vector<int> values;
+  for (int i = 0; i < 1000; ++i)
+  {
+    keys.push_back (i % 700);
+    values.push_back (i);
+  }
+  HashMap<long, int> looped;
+  looped.insert (5, -1);
+  HashMap<long, int> bulk (looped);
+  for (std::size_t i = 0; i < keys.size (); ++i)
+  {
+    looped.insert (keys[i], values[i]);
+  }
+  ASSERT_TRUE(bulk.insert_bulk (keys, values) == 699 && bulk == looped);
+  ASSERT_TRUE(bulk.at (5) == -1 && bulk.at (6) == 6 && bulk.size () == 700);
+  ASSERT_TRUE(bulk.insert_bulk (keys.data (), values.data (), 0) == 0);
+  ASSERT_THROWING(bulk.insert_bulk (keys, std::vector<int> (1)););
+  std::size_t capacity = bulk.capacity ();
+  ASSERT_TRUE(bulk.insert_bulk (keys, values) == 0 && bulk.capacity () == capacity);
+  HashMap<long, int> repeated;
+  ASSERT_TRUE(repeated.insert_bulk (std::vector<long> (100000, 7),
+                                    std::vector<int> (100000, 1)) == 1);
+  ASSERT_TRUE(repeated.size () == 1 && repeated.capacity () == (HashMap<long, int> ().capacity ()));
+
+  Dictionary dictionary;
+  std::vector<std::string> words = {"a", "b", "a", "c"};
+  std::vector<std::string> meanings = {"1", "2", "3", "4"};
+  RETURN_ASSERT_TRUE(dictionary.insert_bulk (words, meanings) == 3
+                     && dictionary.at ("a") == "1");
+}
+
 //-------------------------------------------------------
 //  The main entry point
 //-------------------------------------------------------
@@ -735,6 +1993,30 @@ int runPreSubmissionChecks ()
   PRESUBMISSION_ASSERT(__presubmit_testBucketSize);
   PRESUBMISSION_ASSERT(__presubmit_testDictionaryUpdate);
   PRESUBMISSION_ASSERT(__presubmit_testDictionaryErase);
+  PRESUBMISSION_ASSERT(__presubmit_testDigest);
+  PRESUBMISSION_ASSERT(__presubmit_testMerge);
+  PRESUBMISSION_ASSERT(__presubmit_testEraseIf);
+  PRESUBMISSION_ASSERT(__presubmit_testParallelRanges);
+  PRESUBMISSION_ASSERT(__presubmit_testRobinHood);
+  PRESUBMISSION_ASSERT(__presubmit_testCuckoo);
+  PRESUBMISSION_ASSERT(__presubmit_testCollisions);
+  PRESUBMISSION_ASSERT(__presubmit_testPersistent);
+  PRESUBMISSION_ASSERT(__presubmit_testDurable);
+  PRESUBMISSION_ASSERT(__presubmit_testCache);
+  PRESUBMISSION_ASSERT(__presubmit_testExpiring);
+  PRESUBMISSION_ASSERT(__presubmit_testCombiner);
+  PRESUBMISSION_ASSERT(__presubmit_testLargeSizes);
+  PRESUBMISSION_ASSERT(__presubmit_testTablePolicy);
+  PRESUBMISSION_ASSERT(__presubmit_testFilter);
+  PRESUBMISSION_ASSERT(__presubmit_testSetAlgebra);
+  PRESUBMISSION_ASSERT(__presubmit_testIntegralMap);
+  PRESUBMISSION_ASSERT(__presubmit_testColumnMap);
+  PRESUBMISSION_ASSERT(__presubmit_testSmallMaps);
+  PRESUBMISSION_ASSERT(__presubmit_testOrderedMap);
+  PRESUBMISSION_ASSERT(__presubmit_testLookups);
+  PRESUBMISSION_ASSERT(__presubmit_testSpillMap);
+  PRESUBMISSION_ASSERT(__presubmit_testSharedDictionary);
+  PRESUBMISSION_ASSERT(__presubmit_testInsertBulk);
   return 1;
 }
 
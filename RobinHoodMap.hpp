@@ -0,0 +1,626 @@
+#include "HashMap.hpp"
+#include <new>
+
+#ifndef _ROBINHOODMAP_HPP_
+#define _ROBINHOODMAP_HPP_
+
+/**
+ * Open addressing variant of HashMap, using Robin Hood hashing.
+ * Each pair is stored in a single array of slots, starting at its home slot
+ * (hash & (capacity - 1)) and probing forward. On insertion a pair takes the
+ * slot of any pair which is closer to its own home (the "rich" pair), so
+ * the probe distances stay low and even, and a miss can stop as soon as it
+ * meets a pair closer to home than the probe itself.
+ * Erase shifts the following pairs of the cluster one slot back instead of
+ * leaving tombstones, so erase heavy workloads don't degrade.
+ * Capacity, growth and shrink follow HashMap (START_CAPACITY,
+ * TOP_THRESHOLD and LOW_THRESHOLD).
+ */
+template<typename KeyT, typename ValueT>
+class RobinHoodMap
+{
+  class iterator_t;
+
+ public:
+  typedef iterator_t const_iterator;
+
+  RobinHoodMap () : _distances (nullptr), _slots (nullptr), _capacity (0),
+                    _size (0), _exponent (0)
+  { this->allocate (4); }
+
+  RobinHoodMap (const std::vector<KeyT> &keys_vector,
+                const std::vector<ValueT> &values_vector) : RobinHoodMap ()
+  {
+    if (keys_vector.size () != values_vector.size ())
+    { throw std::length_error ("The size of the vectors is unmatched."); }
+    for (std::size_t i = 0; i < keys_vector.size (); ++i)
+    { this->insert_or_assign (keys_vector[i], values_vector[i]); }
+  }
+
+  /**
+   * Copy ctor.
+   * Clones the slot array as is, every pair keeps its slot.
+   * @param other RobinHoodMap to copy.
+   */
+  RobinHoodMap (const RobinHoodMap<KeyT, ValueT> &other)
+      : _distances (nullptr), _slots (nullptr), _capacity (0), _size (0),
+        _exponent (0)
+  {
+    this->allocate (other._exponent);
+    try
+    {
+      for (std::size_t i = 0; i < other._capacity; ++i)
+      {
+        if (other._distances[i] != EMPTY_SLOT)
+        {
+          new (&this->_slots[i]) std::pair<KeyT, ValueT> (other._slots[i]);
+          this->_distances[i] = other._distances[i];
+          ++this->_size;
+        }
+      }
+    }
+    catch (...)
+    {
+      this->clear ();
+      this->release ();
+      throw;
+    }
+  }
+
+  ~RobinHoodMap ()
+  {
+    this->clear ();
+    this->release ();
+  }
+
+  RobinHoodMap<KeyT, ValueT> &operator= (RobinHoodMap<KeyT, ValueT> rhs)
+  {
+    swap (*this, rhs);
+    return *this;
+  }
+
+  friend void swap (RobinHoodMap<KeyT, ValueT> &src,
+                    RobinHoodMap<KeyT, ValueT> &dst)
+  {
+    std::swap (src._distances, dst._distances);
+    std::swap (src._slots, dst._slots);
+    std::swap (src._capacity, dst._capacity);
+    std::swap (src._size, dst._size);
+    std::swap (src._exponent, dst._exponent);
+  }
+
+  /**
+   * Size of elements inside the map.
+   * @return Size_t value.
+   */
+  std::size_t size () const
+  { return this->_size; }
+
+  /**
+   * Number of slots of the map.
+   * @return Size_t value.
+   */
+  std::size_t capacity () const
+  { return this->_capacity; }
+
+  /**
+   * Check if the map is empty.
+   * @return Boolean value.
+   */
+  bool empty () const
+  { return this->_size == 0; }
+
+  double get_load_factor () const
+  { return (double) this->_size / (double) this->_capacity; }
+
+  /**
+   * Insert new pair<Key, Value> into the map.
+   * If key already exists, do nothing.
+   * @param key Generic type value.
+   * @param value Generic type value.
+   * @return True if the pair was inserted.
+   */
+  bool insert (const KeyT &key, const ValueT &value)
+  {
+    std::size_t hash = hash_of (key);
+    if (this->find_slot (key, hash) != NOT_FOUND)
+    { return false; }
+    this->add_missing (hash, key, value);
+    return true;
+  }
+
+  /**
+   * Insert new pair<Key, Value> into the map, or overwrite the value of an
+   * existing key.
+   * @param key Generic type value.
+   * @param value Generic type value.
+   * @return True if a new pair was inserted, false if a value was replaced.
+   */
+  bool insert_or_assign (const KeyT &key, const ValueT &value)
+  {
+    std::size_t hash = hash_of (key);
+    std::size_t slot = this->find_slot (key, hash);
+    if (slot == NOT_FOUND)
+    {
+      this->add_missing (hash, key, value);
+      return true;
+    }
+    this->_slots[slot].second = value;
+    return false;
+  }
+
+  /**
+   * Grow the capacity once, so that count pairs fit without any more
+   * re-hashing. Never shrinks.
+   * @param count Size_t type variable.
+   */
+  void reserve (std::size_t count)
+  {
+    int exponent = this->_exponent;
+    while ((double) count / (double) ((std::size_t) 1 << exponent)
+           > TOP_THRESHOLD)
+    { ++exponent; }
+    if (exponent != this->_exponent)
+    { this->re_hashing_to (exponent); }
+  }
+
+  /**
+   * Check if given key is already in the map.
+   * @param key Generic value.
+   * @return Boolean Value.
+   */
+  bool contains_key (const KeyT &key) const
+  { return this->find_slot (key, hash_of (key)) != NOT_FOUND; }
+
+  /**
+   * Given reference to value by key.
+   * If key doesnt exists throw error.
+   * @param key Generic type.
+   * @return Reference to generic type variable named value.
+   */
+  const ValueT &at (const KeyT &key) const
+  {
+    std::size_t slot = this->find_slot (key, hash_of (key));
+    if (slot == NOT_FOUND)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return this->_slots[slot].second;
+  }
+
+  /**
+   * Given reference to value by key.
+   * If key doesnt exists throw error.
+   * @param key Generic type.
+   * @return Reference to generic type variable named value.
+   */
+  ValueT &at (const KeyT &key)
+  {
+    std::size_t slot = this->find_slot (key, hash_of (key));
+    if (slot == NOT_FOUND)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return this->_slots[slot].second;
+  }
+
+  ValueT &operator[] (const KeyT &key)
+  {
+    std::size_t hash = hash_of (key);
+    std::size_t slot = this->find_slot (key, hash);
+    if (slot == NOT_FOUND)
+    { slot = this->add_missing (hash, key, ValueT ()); }
+    return this->_slots[slot].second;
+  }
+
+  ValueT operator[] (const KeyT &key) const
+  { return this->at (key); }
+
+  /**
+   * Remove the pair of the given key, shifting the rest of its cluster one
+   * slot back. Shrinks the capacity if the load factor drops below
+   * LOW_THRESHOLD.
+   * @param key Generic type variable.
+   * @return True if the key was found and removed.
+   */
+  bool erase (const KeyT &key)
+  {
+    std::size_t slot = this->find_slot (key, hash_of (key));
+    if (slot == NOT_FOUND)
+    { return false; }
+    this->remove_slot (slot);
+    this->shrink_to_fit ();
+    return true;
+  }
+
+  /**
+   * Remove the pair the given iterator points to.
+   * Never shrinks, so the other iterators stay valid while erasing during a
+   * scan. Call shrink_to_fit () once done.
+   * @param pos Iterator to a pair of this map.
+   * @return Iterator to the pair after the removed one.
+   */
+  const_iterator erase (const_iterator pos)
+  {
+    this->remove_slot (pos.slot ());
+    // The next pair of the cluster (if any) was shifted into this slot.
+    return const_iterator (*this, pos._start, pos._position);
+  }
+
+  /**
+   * Remove every pair the predicate holds for, in a single pass.
+   * The shrink decision is taken once, after all the removals.
+   * @param predicate Callable taking a const pair<Key, Value> &.
+   * @return Number of removed pairs.
+   */
+  template<typename Predicate>
+  std::size_t erase_if (Predicate predicate)
+  {
+    std::size_t removed = 0;
+    for (auto it = this->cbegin (); it != this->cend ();)
+    {
+      if (predicate (*it))
+      {
+        it = this->erase (it);
+        ++removed;
+      }
+      else
+      { ++it; }
+    }
+    this->shrink_to_fit ();
+    return removed;
+  }
+
+  /**
+   * Shrink the capacity with a single re-hashing, to the largest capacity
+   * whose load factor isn't below LOW_THRESHOLD.
+   */
+  void shrink_to_fit ()
+  {
+    int exponent = this->_exponent;
+    while (exponent > 0
+           && (double) this->_size / (double) ((std::size_t) 1 << exponent)
+              < LOW_THRESHOLD)
+    { --exponent; }
+    if (exponent != this->_exponent)
+    { this->re_hashing_to (exponent); }
+  }
+
+  /**
+   * Number of pairs whose home slot is the home slot of the given key.
+   * These pairs are stored next to each other.
+   * If key doesnt exists throw error.
+   * @param key Generic type variable.
+   * @return Size_t value.
+   */
+  std::size_t bucket_size (const KeyT &key) const
+  {
+    std::size_t hash = hash_of (key);
+    if (this->find_slot (key, hash) == NOT_FOUND)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    std::size_t slot = hash & (this->_capacity - 1);
+    std::uint32_t distance = 1;
+    std::size_t count = 0;
+    while (this->_distances[slot] != EMPTY_SLOT
+           && this->_distances[slot] >= distance)
+    {
+      if (this->_distances[slot] == distance)
+      { ++count; }
+      slot = (slot + 1) & (this->_capacity - 1);
+      ++distance;
+    }
+    return count;
+  }
+
+  /**
+   * Home slot of the given key.
+   * If key doesnt exists throw error.
+   * @param key Generic type variable.
+   * @return Size_t value.
+   */
+  std::size_t bucket_index (const KeyT &key) const
+  {
+    std::size_t hash = hash_of (key);
+    if (this->find_slot (key, hash) == NOT_FOUND)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return (hash & (this->_capacity - 1));
+  }
+
+  /**
+   * Remove all the pairs, the capacity stays the same.
+   */
+  void clear ()
+  {
+    for (std::size_t i = 0; i < this->_capacity; ++i)
+    {
+      if (this->_distances[i] != EMPTY_SLOT)
+      {
+        this->_slots[i].~pair ();
+        this->_distances[i] = EMPTY_SLOT;
+      }
+    }
+    this->_size = 0;
+  }
+
+  const_iterator begin () const
+  { return this->cbegin (); }
+
+  const_iterator cbegin () const
+  { return const_iterator (*this, this->iteration_start (), 0); }
+
+  const_iterator end () const
+  { return this->cend (); }
+
+  const_iterator cend () const
+  { return const_iterator (*this, 0, this->_capacity); }
+
+  bool operator== (const RobinHoodMap<KeyT, ValueT> &rhs) const
+  {
+    if (this->_size != rhs._size)
+    { return false; }
+    for (std::size_t i = 0; i < rhs._capacity; ++i)
+    {
+      if (rhs._distances[i] == EMPTY_SLOT)
+      { continue; }
+      const std::pair<KeyT, ValueT> &pair = rhs._slots[i];
+      std::size_t slot = this->find_slot (pair.first, hash_of (pair.first));
+      if (slot == NOT_FOUND || !(this->_slots[slot].second == pair.second))
+      { return false; }
+    }
+    return true;
+  }
+
+  bool operator!= (const RobinHoodMap<KeyT, ValueT> &rhs) const
+  { return !this->operator== (rhs); }
+
+ private:
+  static const std::uint32_t EMPTY_SLOT = 0;
+  static const std::size_t NOT_FOUND = (std::size_t) -1;
+
+  /**
+   * Probe distance of every slot plus one, EMPTY_SLOT for empty slots.
+   * Kept apart from the pairs, so probing touches only this array until a
+   * candidate is found.
+   */
+  std::uint32_t *_distances;
+  std::pair<KeyT, ValueT> *_slots;
+  std::size_t _capacity;
+  std::size_t _size;
+  int _exponent;
+
+  /**
+   * Hash of a key. std::hash is the identity for integers, so it is mixed
+   * before the home slot is taken from the low bits, or sequential and
+   * strided keys would form long clusters.
+   */
+  static std::size_t hash_of (const KeyT &key)
+  {
+    std::uint64_t word = std::hash<KeyT>{} (key);
+    word ^= word >> 33;
+    word *= 0xFF51AFD7ED558CCDULL;
+    word ^= word >> 33;
+    return (std::size_t) word;
+  }
+
+  /**
+   * Allocate empty arrays of 2^exponent slots.
+   * @param exponent Int type variable.
+   */
+  void allocate (int exponent)
+  {
+    std::size_t capacity = (std::size_t) 1 << exponent;
+    auto *distances = new std::uint32_t[capacity] ();
+    try
+    {
+      this->_slots = static_cast<std::pair<KeyT, ValueT> *> (
+          ::operator new (sizeof (std::pair<KeyT, ValueT>) * capacity));
+    }
+    catch (...)
+    {
+      delete[] distances;
+      throw;
+    }
+    this->_distances = distances;
+    this->_capacity = capacity;
+    this->_exponent = exponent;
+  }
+
+  /**
+   * Free the arrays, the slots must be empty (or moved from and destroyed).
+   */
+  void release ()
+  {
+    delete[] this->_distances;
+    ::operator delete (this->_slots);
+    this->_distances = nullptr;
+    this->_slots = nullptr;
+  }
+
+  /**
+   * Find the slot of the given key.
+   * Stops at an empty slot, or at a pair which is closer to its home than
+   * the key would be, as the key would have taken that slot.
+   * @return Slot index, or NOT_FOUND.
+   */
+  std::size_t find_slot (const KeyT &key, std::size_t hash) const
+  {
+    std::size_t slot = hash & (this->_capacity - 1);
+    for (std::uint32_t distance = 1;; ++distance)
+    {
+      std::uint32_t slot_distance = this->_distances[slot];
+      if (slot_distance == EMPTY_SLOT || slot_distance < distance)
+      { return NOT_FOUND; }
+      if (slot_distance == distance && this->_slots[slot].first == key)
+      { return slot; }
+      slot = (slot + 1) & (this->_capacity - 1);
+    }
+  }
+
+  /**
+   * Add a pair whose key is known to be missing, growing if needed.
+   * @return Slot of the new pair.
+   */
+  std::size_t add_missing (std::size_t hash, const KeyT &key,
+                           const ValueT &value)
+  {
+    if ((double) (this->_size + 1) / this->_capacity > TOP_THRESHOLD)
+    { this->re_hashing_to (this->_exponent + 1); }
+    std::size_t slot = this->place (hash, std::pair<KeyT, ValueT> (key, value));
+    ++this->_size;
+    return slot;
+  }
+
+  /**
+   * Robin Hood insertion of a pair whose key is known to be missing.
+   * Walks from the home slot, and swaps the carried pair with any pair which
+   * is closer to its home, then carries on with the displaced pair.
+   * @return Slot the given pair ended up in.
+   */
+  std::size_t place (std::size_t hash, std::pair<KeyT, ValueT> &&pair)
+  {
+    std::size_t slot = hash & (this->_capacity - 1);
+    std::uint32_t distance = 1;
+    std::size_t placed = NOT_FOUND;
+    std::pair<KeyT, ValueT> carried (std::move (pair));
+    while (true)
+    {
+      std::uint32_t &slot_distance = this->_distances[slot];
+      if (slot_distance == EMPTY_SLOT)
+      {
+        new (&this->_slots[slot]) std::pair<KeyT, ValueT> (std::move (carried));
+        slot_distance = distance;
+        return placed == NOT_FOUND ? slot : placed;
+      }
+      if (slot_distance < distance)
+      {
+        std::swap (carried, this->_slots[slot]);
+        std::swap (distance, slot_distance);
+        if (placed == NOT_FOUND)
+        { placed = slot; }
+      }
+      slot = (slot + 1) & (this->_capacity - 1);
+      ++distance;
+    }
+  }
+
+  /**
+   * Destroy the pair of the given slot, and shift the following pairs of the
+   * cluster one slot back, until an empty slot or a pair at its home.
+   * @param slot Slot index.
+   */
+  void remove_slot (std::size_t slot)
+  {
+    std::size_t hole = (std::size_t) slot;
+    std::size_t next = (hole + 1) & (this->_capacity - 1);
+    while (this->_distances[next] > 1)
+    {
+      this->_slots[hole] = std::move (this->_slots[next]);
+      this->_distances[hole] = this->_distances[next] - 1;
+      hole = next;
+      next = (next + 1) & (this->_capacity - 1);
+    }
+    this->_slots[hole].~pair ();
+    this->_distances[hole] = EMPTY_SLOT;
+    --this->_size;
+  }
+
+  /**
+   * Change the capacity to 2^exponent slots, and place every pair again.
+   * @param exponent Int type variable.
+   */
+  void re_hashing_to (int exponent)
+  {
+    std::uint32_t *old_distances = this->_distances;
+    std::pair<KeyT, ValueT> *old_slots = this->_slots;
+    std::size_t old_capacity = this->_capacity;
+    this->allocate (exponent);
+    for (std::size_t i = 0; i < old_capacity; ++i)
+    {
+      if (old_distances[i] != EMPTY_SLOT)
+      {
+        this->place (hash_of (old_slots[i].first),
+                     std::move (old_slots[i]));
+        old_slots[i].~pair ();
+      }
+    }
+    delete[] old_distances;
+    ::operator delete (old_slots);
+  }
+
+  /**
+   * Iteration starts right after an empty slot. Erasing shifts pairs one
+   * slot back but never across an empty slot, so erasing while iterating
+   * never moves a pair from ahead of the iterator to behind it.
+   * @return Slot index.
+   */
+  std::size_t iteration_start () const
+  {
+    for (std::size_t i = 0; i < this->_capacity; ++i)
+    {
+      if (this->_distances[i] == EMPTY_SLOT)
+      { return (i + 1) & (this->_capacity - 1); }
+    }
+    return 0;
+  }
+
+  class iterator_t
+  {
+    friend class RobinHoodMap<KeyT, ValueT>;
+   private:
+    const RobinHoodMap<KeyT, ValueT> *_map_container;
+    std::size_t _start;
+    std::size_t _position;
+
+    std::size_t slot () const
+    { return (this->_start + this->_position) & (this->_map_container->_capacity - 1); }
+
+    void skip_empty ()
+    {
+      while (this->_position < this->_map_container->_capacity
+             && this->_map_container->_distances[this->slot ()] == EMPTY_SLOT)
+      { ++this->_position; }
+    }
+
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef const std::pair<KeyT, ValueT> value_type;
+    typedef value_type &reference;
+    typedef value_type *pointer;
+    typedef std::ptrdiff_t difference_type;
+
+    iterator_t (const RobinHoodMap<KeyT, ValueT> &map_container,
+                std::size_t start, std::size_t position)
+        : _map_container (&map_container), _start (start),
+          _position (position)
+    { this->skip_empty (); }
+
+    reference operator* () const
+    { return this->_map_container->_slots[this->slot ()]; }
+
+    pointer operator-> () const
+    { return &(this->operator* ()); }
+
+    iterator_t &operator++ ()
+    {
+      ++this->_position;
+      this->skip_empty ();
+      return *this;
+    }
+
+    iterator_t operator++ (int)
+    {
+      iterator_t it (*this);
+      this->operator++ ();
+      return it;
+    }
+
+    bool operator== (const iterator_t &rhs) const
+    {
+      return this->_map_container == rhs._map_container
+             && this->_position == rhs._position
+             && (this->_start == rhs._start
+                 || this->_position == this->_map_container->_capacity);
+    }
+
+    bool operator!= (const iterator_t &rhs) const
+    { return !this->operator== (rhs); }
+  };
+};
+
+#endif //_ROBINHOODMAP_HPP_
@@ -0,0 +1,206 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef _SERIALIZATION_HPP_
+#define _SERIALIZATION_HPP_
+
+/**
+ * Binary encoding of keys and values, and the file helpers shared by the
+ * maps which keep their pairs on disk.
+ * Numbers are stored in the byte order of the machine, the files are not
+ * meant to move between machines.
+ */
+
+/**
+ * Append a trivially copyable value to the buffer, as its raw bytes.
+ * @param buffer String used as a byte buffer.
+ * @param value Generic type variable.
+ */
+template<typename T>
+typename std::enable_if<std::is_trivially_copyable<T>::value>::type
+put_value (std::string &buffer, const T &value)
+{ buffer.append (reinterpret_cast<const char *> (&value), sizeof (T)); }
+
+/**
+ * Append a string to the buffer, as its 32 bit length and its bytes.
+ * @param buffer String used as a byte buffer.
+ * @param value String to append.
+ */
+inline void put_value (std::string &buffer, const std::string &value)
+{
+  put_value (buffer, (std::uint32_t) value.size ());
+  buffer.append (value);
+}
+
+/**
+ * Read a trivially copyable value written by put_value, and move pos past it.
+ * @param pos Reference to the read position.
+ * @param end End of the readable bytes.
+ * @param value Generic type variable to fill.
+ * @return False if there are not enough bytes left, true otherwise.
+ */
+template<typename T>
+typename std::enable_if<std::is_trivially_copyable<T>::value, bool>::type
+get_value (const char *&pos, const char *end, T &value)
+{
+  if (end - pos < (std::ptrdiff_t) sizeof (T))
+  { return false; }
+  std::memcpy (&value, pos, sizeof (T));
+  pos += sizeof (T);
+  return true;
+}
+
+/**
+ * Read a string written by put_value, and move pos past it.
+ * @param pos Reference to the read position.
+ * @param end End of the readable bytes.
+ * @param value String to fill.
+ * @return False if there are not enough bytes left, true otherwise.
+ */
+inline bool get_value (const char *&pos, const char *end, std::string &value)
+{
+  std::uint32_t length;
+  const char *start = pos;
+  if (!get_value (pos, end, length) || end - pos < (std::ptrdiff_t) length)
+  {
+    pos = start;
+    return false;
+  }
+  value.assign (pos, length);
+  pos += length;
+  return true;
+}
+
+/**
+ * CRC-32 (IEEE) of the given bytes, used to find torn and corrupted
+ * records.
+ * @param data Pointer to the bytes.
+ * @param length Number of bytes.
+ * @param crc CRC of the preceding bytes, to checksum in pieces.
+ * @return CRC value.
+ */
+inline std::uint32_t crc32 (const char *data, std::size_t length,
+                            std::uint32_t crc = 0)
+{
+  struct table_t
+  {
+    std::uint32_t entries[256];
+    table_t ()
+    {
+      for (std::uint32_t i = 0; i < 256; ++i)
+      {
+        std::uint32_t entry = i;
+        for (int bit = 0; bit < 8; ++bit)
+        { entry = (entry >> 1) ^ ((entry & 1) ? 0xEDB88320u : 0); }
+        this->entries[i] = entry;
+      }
+    }
+  };
+  static const table_t table;
+  crc = ~crc;
+  for (std::size_t i = 0; i < length; ++i)
+  { crc = table.entries[(crc ^ (unsigned char) data[i]) & 0xFF] ^ (crc >> 8); }
+  return ~crc;
+}
+
+/**
+ * Throw the error of the last failed system call.
+ * @param what Description of the failed operation.
+ */
+inline void throw_errno (const std::string &what)
+{ throw std::system_error (errno, std::generic_category (), what); }
+
+/**
+ * Write all the bytes to the file descriptor, retrying short writes.
+ * @param fd File descriptor.
+ * @param data Pointer to the bytes.
+ * @param length Number of bytes.
+ */
+inline void write_all (int fd, const char *data, std::size_t length)
+{
+  while (length > 0)
+  {
+    ssize_t written = ::write (fd, data, length);
+    if (written < 0)
+    {
+      if (errno == EINTR)
+      { continue; }
+      throw_errno ("write");
+    }
+    data += written;
+    length -= (std::size_t) written;
+  }
+}
+
+/**
+ * Read a whole file into the buffer, with a single allocation.
+ * @param path Path of the file.
+ * @param buffer String to fill.
+ * @return False if the file doesn't exist, true otherwise.
+ */
+inline bool read_file (const std::string &path, std::string &buffer)
+{
+  int fd = ::open (path.c_str (), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    if (errno == ENOENT)
+    { return false; }
+    throw_errno ("open " + path);
+  }
+  struct stat info;
+  if (::fstat (fd, &info) != 0)
+  {
+    int error = errno;
+    ::close (fd);
+    errno = error;
+    throw_errno ("stat " + path);
+  }
+  buffer.resize ((std::size_t) info.st_size);
+  std::size_t done = 0;
+  while (done < buffer.size ())
+  {
+    ssize_t count = ::read (fd, &buffer[done], buffer.size () - done);
+    if (count < 0 && errno == EINTR)
+    { continue; }
+    if (count < 0)
+    {
+      int error = errno;
+      ::close (fd);
+      errno = error;
+      throw_errno ("read " + path);
+    }
+    if (count == 0)
+    {
+      buffer.resize (done);
+      break;
+    }
+    done += (std::size_t) count;
+  }
+  ::close (fd);
+  return true;
+}
+
+/**
+ * Flush the entries of a directory, so files created or renamed in it
+ * survive a crash.
+ * @param directory Path of the directory.
+ */
+inline void sync_directory (const std::string &directory)
+{
+  int fd = ::open (directory.c_str (), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+  { throw_errno ("open " + directory); }
+  int result = ::fsync (fd);
+  ::close (fd);
+  if (result != 0)
+  { throw_errno ("fsync " + directory); }
+}
+
+#endif //_SERIALIZATION_HPP_
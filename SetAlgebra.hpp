@@ -0,0 +1,342 @@
+#include "ParallelHashMap.hpp"
+
+#ifndef _SETALGEBRA_HPP_
+#define _SETALGEBRA_HPP_
+#define SET_PROBE_BATCH 16
+#define SET_PARALLEL_MIN 16384
+#if defined (__GNUC__) || defined (__clang__)
+#define PREFETCH(address) __builtin_prefetch (address)
+#else
+#define PREFETCH(address) ((void) (address))
+#endif
+
+/**
+ * Kernels of the set operations on HashMaps, see intersect, union_with,
+ * difference and hash_join below.
+ * The smaller map is iterated and the larger one probed, in parallel over
+ * partitions of the buckets, see probe_into. When both maps share their
+ * layout (capacity and seed), the pairs of a bucket are only looked up in
+ * the matching bucket, with no hashing; otherwise probes run in batches of
+ * SET_PROBE_BATCH, prefetching the buckets and then their first nodes
+ * before any key is compared.
+ */
+class set_algebra
+{
+ public:
+  template<typename KeyT, typename ValueT>
+  static HashMap<KeyT, ValueT>
+  intersect (const HashMap<KeyT, ValueT> &a, const HashMap<KeyT, ValueT> &b,
+             int threads)
+  {
+    typedef std::pair<KeyT, ValueT> pair_type;
+    const HashMap<KeyT, ValueT> &probe = a._size <= b._size ? a : b;
+    const HashMap<KeyT, ValueT> &other = a._size <= b._size ? b : a;
+    bool from_probe = &probe == &a;
+    return probe_into<ValueT> (
+        probe, other, threads,
+        [] (const pair_type *match)
+        { return match != nullptr; },
+        [from_probe] (const pair_type &pair, const pair_type *match)
+        { return from_probe ? pair : *match; });
+  }
+
+  template<typename KeyT, typename ValueT>
+  static HashMap<KeyT, ValueT>
+  difference (const HashMap<KeyT, ValueT> &a, const HashMap<KeyT, ValueT> &b,
+              int threads)
+  {
+    typedef std::pair<KeyT, ValueT> pair_type;
+    if (b._size * 4 < a._size)
+    {
+      // Few keys to drop, removing them from a copy probes the small side
+      HashMap<KeyT, ValueT> result (a);
+      for (const auto &pair: b)
+      { result.remove (pair.first); }
+      result.shrink_to_fit ();
+      return result;
+    }
+    return probe_into<ValueT> (
+        a, b, threads,
+        [] (const pair_type *match)
+        { return match == nullptr; },
+        [] (const pair_type &pair, const pair_type *)
+        { return pair; });
+  }
+
+  template<typename KeyT, typename ValueT>
+  static HashMap<KeyT, ValueT>
+  union_with (const HashMap<KeyT, ValueT> &a, const HashMap<KeyT, ValueT> &b,
+              int threads)
+  {
+    bool a_larger = a._size >= b._size;
+    const HashMap<KeyT, ValueT> &larger = a_larger ? a : b;
+    const HashMap<KeyT, ValueT> &smaller = a_larger ? b : a;
+    HashMap<KeyT, ValueT> result;
+    result._seed = larger._seed;
+    result.reserve (a._size + b._size);
+    if (larger._size + smaller._size < SET_PARALLEL_MIN)
+    { threads = 1; }
+    // Keys of both maps keep the value of a
+    auto value_of_a = [a_larger] (const ValueT &existing,
+                                  const ValueT &incoming)
+    { return a_larger ? existing : incoming; };
+    bool aligned = smaller._seed == result._seed;
+    std::size_t partitions = 1;
+    while (partitions < (std::size_t) threads * RANGES_PER_THREAD
+           && partitions < result._capacity)
+    { partitions *= 2; }
+
+    // result is new and has no filter, so the partitions only write their
+    // own buckets
+    std::vector<std::size_t> added (partitions, 0);
+    run_on_ranges (partitions, threads, [&] (std::size_t i)
+    {
+      added[i] += result.merge_partition (larger, i, partitions, value_of_a);
+      if (aligned)
+      {
+        added[i] += result.merge_partition (smaller, i, partitions,
+                                            value_of_a);
+      }
+    });
+    for (std::size_t count: added)
+    { result._size += count; }
+    if (!aligned)
+    {
+      result.merge (smaller, a_larger ? HashMap<KeyT, ValueT>::KEEP
+                                      : HashMap<KeyT, ValueT>::OVERWRITE);
+    }
+    result.shrink_to_fit ();
+    return result;
+  }
+
+  template<typename KeyT, typename ValueT, typename OtherT>
+  static HashMap<KeyT, std::pair<ValueT, OtherT>>
+  hash_join (const HashMap<KeyT, ValueT> &a, const HashMap<KeyT, OtherT> &b,
+             int threads)
+  {
+    typedef std::pair<KeyT, ValueT> a_pair;
+    typedef std::pair<KeyT, OtherT> b_pair;
+    typedef std::pair<KeyT, std::pair<ValueT, OtherT>> joined_pair;
+    if (a._size <= b._size)
+    {
+      return probe_into<std::pair<ValueT, OtherT>> (
+          a, b, threads,
+          [] (const b_pair *match)
+          { return match != nullptr; },
+          [] (const a_pair &pair, const b_pair *match)
+          {
+            return joined_pair (pair.first,
+                                std::make_pair (pair.second, match->second));
+          });
+    }
+    return probe_into<std::pair<ValueT, OtherT>> (
+        b, a, threads,
+        [] (const a_pair *match)
+        { return match != nullptr; },
+        [] (const b_pair &pair, const a_pair *match)
+        {
+          return joined_pair (pair.first,
+                              std::make_pair (match->second, pair.second));
+        });
+  }
+
+ private:
+  /**
+   * A pair of probe kept for the result, with the index of its bucket.
+   */
+  template<typename PairT, typename MatchT>
+  struct kept
+  {
+    std::size_t index;
+    const PairT *pair;
+    const MatchT *match;
+  };
+
+  /**
+   * Look every pair of probe up in other, and build the map of
+   * make (pair, match) for the pairs where keep (match) holds, match being
+   * nullptr for a missing key.
+   * A first pass collects the kept pairs, so the result is sized once for
+   * them, with the seed of probe: its capacity is at most the one of probe,
+   * so the bucket of a kept pair is its bucket index in probe masked, with
+   * no hashing. The first pass scans ranges of buckets and sorts the kept
+   * pairs by the low bits of their bucket index, so the partitions of the
+   * second pass fill disjoint buckets of the result.
+   */
+  template<typename ResultT, typename KeyT, typename ValueT, typename OtherT,
+      typename Keep, typename Make>
+  static HashMap<KeyT, ResultT>
+  probe_into (const HashMap<KeyT, ValueT> &probe,
+              const HashMap<KeyT, OtherT> &other, int threads, Keep keep,
+              Make make)
+  {
+    typedef typename HashMap<KeyT, OtherT>::bucket other_bucket;
+    typedef std::pair<KeyT, ValueT> pair_type;
+    typedef std::pair<KeyT, OtherT> match_type;
+    struct pending
+    {
+      std::size_t index;
+      const pair_type *pair;
+      std::size_t hash;
+      other_bucket *bucket_ptr;
+    };
+
+    if (probe._size < SET_PARALLEL_MIN)
+    { threads = 1; }
+    std::size_t partitions = 1;
+    while (partitions < (std::size_t) threads * RANGES_PER_THREAD
+           && partitions < probe._capacity)
+    { partitions *= 2; }
+    std::size_t ranges = partitions;
+    bool aligned = other.shares_layout (probe._capacity, probe._seed);
+    // found[range * partitions + partition]
+    std::vector<std::vector<kept<pair_type, match_type>>> found (
+        ranges * partitions);
+    run_on_ranges (ranges, threads, [&] (std::size_t range)
+    {
+      std::size_t first = probe._capacity * range / ranges;
+      std::size_t last = probe._capacity * (range + 1) / ranges;
+      auto visit = [&] (std::size_t index, const pair_type &pair,
+                        const match_type *match)
+      {
+        if (keep (match))
+        {
+          found[range * partitions + (index & (partitions - 1))].push_back (
+              {index, &pair, match});
+        }
+      };
+
+      if (aligned)
+      {
+        for (std::size_t i = first; i < last; ++i)
+        {
+          other_bucket *bucket_ptr = &other._bucket_list[i];
+          for (const auto &pair: probe._bucket_list[i].get_bucket ())
+          { visit (i, pair, other.find_in_bucket (pair.first, bucket_ptr)); }
+        }
+        return;
+      }
+
+      pending batch[SET_PROBE_BATCH];
+      int count = 0;
+      auto flush = [&] ()
+      {
+        for (int j = 0; j < count; ++j)
+        {
+          if (!batch[j].bucket_ptr->get_bucket ().empty ())
+          { PREFETCH (&batch[j].bucket_ptr->get_bucket ().front ()); }
+        }
+        for (int j = 0; j < count; ++j)
+        {
+          other_bucket *bucket_ptr = batch[j].bucket_ptr;
+          auto it = bucket_ptr->find (batch[j].pair->first, batch[j].hash);
+          visit (batch[j].index, *batch[j].pair,
+                 it == bucket_ptr->get_bucket ().end () ? nullptr : &*it);
+        }
+        count = 0;
+      };
+      for (std::size_t i = first; i < last; ++i)
+      {
+        for (const auto &pair: probe._bucket_list[i].get_bucket ())
+        {
+          std::size_t hash = other.hash_key (pair.first);
+          other_bucket *bucket_ptr =
+              &other._bucket_list[hash & (other._capacity - 1)];
+          PREFETCH (bucket_ptr);
+          batch[count++] = pending {i, &pair, hash, bucket_ptr};
+          if (count == SET_PROBE_BATCH)
+          { flush (); }
+        }
+      }
+      flush ();
+    });
+
+    std::size_t total = 0;
+    for (const auto &pairs: found)
+    { total += pairs.size (); }
+    HashMap<KeyT, ResultT> result;
+    result._seed = probe._seed;
+    // An empty result keeps sharing the empty table, like a new map
+    if (total == 0)
+    { return result; }
+    int exponent = std::min (result.exponent_for (total, 0), probe._exponent);
+    if (exponent != result._exponent)
+    { result.re_hashing_to (exponent); }
+    result.own_table ();
+    if (result._capacity < partitions)
+    { threads = 1; }
+    // result is new and has no filter, so link_last only writes the bucket
+    // of its partition
+    std::size_t mask = result._capacity - 1;
+    run_on_ranges (partitions, threads, [&] (std::size_t partition)
+    {
+      for (std::size_t range = 0; range < ranges; ++range)
+      {
+        for (const auto &item: found[range * partitions + partition])
+        {
+          auto *bucket_ptr = &result._bucket_list[item.index & mask];
+          std::pair<KeyT, ResultT> made = make (*item.pair, item.match);
+          bucket_ptr->update_bucket (made.first, made.second);
+          result.link_last (bucket_ptr);
+        }
+      }
+    });
+    result._size = total;
+    return result;
+  }
+};
+
+/**
+ * The pairs of a whose key is in b too.
+ * @param a HashMap whose values are kept.
+ * @param b HashMap of the keys to keep.
+ * @param threads Int type variable.
+ * @return New HashMap.
+ */
+template<typename KeyT, typename ValueT>
+HashMap<KeyT, ValueT> intersect (const HashMap<KeyT, ValueT> &a,
+                                 const HashMap<KeyT, ValueT> &b,
+                                 int threads = default_thread_count ())
+{ return set_algebra::intersect (a, b, threads); }
+
+/**
+ * The pairs of both maps, with the value of a for keys in both.
+ * @param a HashMap whose values win.
+ * @param b HashMap to add.
+ * @param threads Int type variable.
+ * @return New HashMap.
+ */
+template<typename KeyT, typename ValueT>
+HashMap<KeyT, ValueT> union_with (const HashMap<KeyT, ValueT> &a,
+                                  const HashMap<KeyT, ValueT> &b,
+                                  int threads = default_thread_count ())
+{ return set_algebra::union_with (a, b, threads); }
+
+/**
+ * The pairs of a whose key isn't in b.
+ * @param a HashMap to take pairs from.
+ * @param b HashMap of the keys to drop.
+ * @param threads Int type variable.
+ * @return New HashMap.
+ */
+template<typename KeyT, typename ValueT>
+HashMap<KeyT, ValueT> difference (const HashMap<KeyT, ValueT> &a,
+                                  const HashMap<KeyT, ValueT> &b,
+                                  int threads = default_thread_count ())
+{ return set_algebra::difference (a, b, threads); }
+
+/**
+ * Equi-join of two maps on their keys: every key of both maps, with the
+ * pair of its values.
+ * @param a HashMap of the first values.
+ * @param b HashMap of the second values.
+ * @param threads Int type variable.
+ * @return New HashMap of (value in a, value in b) pairs.
+ */
+template<typename KeyT, typename ValueT, typename OtherT>
+HashMap<KeyT, std::pair<ValueT, OtherT>>
+hash_join (const HashMap<KeyT, ValueT> &a, const HashMap<KeyT, OtherT> &b,
+           int threads = default_thread_count ())
+{ return set_algebra::hash_join (a, b, threads); }
+
+#endif //_SETALGEBRA_HPP_
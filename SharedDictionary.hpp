@@ -0,0 +1,585 @@
+#include "Dictionary.hpp"
+#include "Serialization.hpp"
+#include <thread>
+#include <sys/mman.h>
+
+#ifndef _SHAREDDICTIONARY_HPP_
+#define _SHAREDDICTIONARY_HPP_
+#define SHARED_MAGIC 0x44524853u
+#define SHARED_SIZE_CLASSES 48
+#define SHARED_MIN_BLOCK 32
+
+/**
+ * Dictionary living in a POSIX shared memory object, so the processes of a
+ * pre-forked server share one copy instead of holding one each.
+ * The object is a fixed size arena: a header, a bucket array and the
+ * entries, all linked by offsets from the start of the arena so every
+ * process can map it at its own address. Blocks come from a bump pointer
+ * and are recycled through free lists of power of two size classes.
+ * One process, the one which created the object, writes; any number of
+ * processes read, lock free, through a sequence lock: every write makes the
+ * sequence odd while it runs, and a reader copies its result out and
+ * retries if the sequence was odd or moved meanwhile. A reader may follow
+ * a link of a half written entry, so every offset is checked against the
+ * arena before it is read; a torn read costs a retry, never a fault.
+ * If the writer dies in the middle of a write the sequence stays odd and
+ * the readers spin: the object has to be created again.
+ * The pid of the writer is kept in the header, so a process forked from the
+ * writer inherits its instance read only: its writes throw instead of
+ * racing with the writer.
+ */
+class SharedDictionary
+{
+ public:
+  /**
+   * Create a shared dictionary, replacing any object of the same name.
+   * The creating instance is the writer, in the calling process only.
+   * @param name Name of the shared memory object, starting with '/'.
+   * @param arena_bytes Size of the arena, fixed for its lifetime.
+   */
+  SharedDictionary (const std::string &name, std::size_t arena_bytes)
+      : _name (name), _arena (nullptr), _arena_bytes (arena_bytes),
+        _writer (true)
+  {
+    if (arena_bytes < header_bytes () + (START_CAPACITY + 1) * SHARED_MIN_BLOCK)
+    { throw std::invalid_argument ("Arena is too small."); }
+    ::shm_unlink (name.c_str ());
+    int fd = ::shm_open (name.c_str (), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+    { throw_errno ("shm_open " + name); }
+    if (::ftruncate (fd, (off_t) arena_bytes) != 0)
+    {
+      int error = errno;
+      ::close (fd);
+      ::shm_unlink (name.c_str ());
+      errno = error;
+      throw_errno ("ftruncate " + name);
+    }
+    this->map_arena (fd, PROT_READ | PROT_WRITE);
+    header &head = this->head ();
+    head.magic = SHARED_MAGIC;
+    head.arena_bytes = arena_bytes;
+    head.seed = string_hasher::random_seed ();
+    head.writer = (std::uint64_t) ::getpid ();
+    this->reset ();
+  }
+
+  /**
+   * Open an existing shared dictionary for reading.
+   * @param name Name given to the writer.
+   */
+  explicit SharedDictionary (const std::string &name)
+      : _name (name), _arena (nullptr), _arena_bytes (0), _writer (false)
+  {
+    int fd = ::shm_open (name.c_str (), O_RDONLY, 0);
+    if (fd < 0)
+    { throw_errno ("shm_open " + name); }
+    struct stat status;
+    if (::fstat (fd, &status) != 0)
+    {
+      int error = errno;
+      ::close (fd);
+      errno = error;
+      throw_errno ("fstat " + name);
+    }
+    this->_arena_bytes = (std::size_t) status.st_size;
+    if (this->_arena_bytes < header_bytes ())
+    {
+      ::close (fd);
+      throw std::runtime_error ("Not a shared dictionary.");
+    }
+    this->map_arena (fd, PROT_READ);
+    if (this->head ().magic != SHARED_MAGIC
+        || this->head ().arena_bytes != this->_arena_bytes)
+    {
+      ::munmap (this->_arena, this->_arena_bytes);
+      throw std::runtime_error ("Not a shared dictionary.");
+    }
+  }
+
+  SharedDictionary (const SharedDictionary &) = delete;
+
+  SharedDictionary &operator= (const SharedDictionary &) = delete;
+
+  /**
+   * Unmap the arena. The object itself stays until remove is called.
+   */
+  ~SharedDictionary ()
+  { ::munmap (this->_arena, this->_arena_bytes); }
+
+  /**
+   * Remove the shared memory object of the given name. Processes which
+   * have it mapped keep using it.
+   * @param name Name of the shared memory object.
+   */
+  static void remove (const std::string &name)
+  { ::shm_unlink (name.c_str ()); }
+
+  /**
+   * Number of pairs.
+   * @return Size_t value.
+   */
+  std::size_t size () const
+  { return (std::size_t) load (this->head ().size); }
+
+  /**
+   * Number of buckets.
+   * @return Size_t value.
+   */
+  std::size_t capacity () const
+  { return (std::size_t) load (this->head ().capacity); }
+
+  /**
+   * Check if the dictionary is empty.
+   * @return Boolean value.
+   */
+  bool empty () const
+  { return this->size () == 0; }
+
+  /**
+   * The ratio between the size and the capacity.
+   * @return Double value.
+   */
+  double get_load_factor () const
+  { return (double) this->size () / (double) this->capacity (); }
+
+  /**
+   * Bytes of the arena not handed out yet, free lists excluded.
+   * @return Size_t value.
+   */
+  std::size_t free_bytes () const
+  { return this->_arena_bytes - (std::size_t) load (this->head ().top); }
+
+  /**
+   * Copy the value of the given key out of the arena.
+   * @param key String.
+   * @param value Receives the value if the key exists.
+   * @return True if the key exists.
+   */
+  bool try_get (const std::string &key, std::string &value) const
+  {
+    std::uint64_t hash = this->hash_key (key);
+    for (;;)
+    {
+      std::uint64_t sequence = __atomic_load_n (&this->head ().sequence,
+                                                __ATOMIC_ACQUIRE);
+      if ((sequence & 1) == 0)
+      {
+        int found = this->read_pair (key, hash, value);
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+        if (found != TORN_READ
+            && __atomic_load_n (&this->head ().sequence, __ATOMIC_RELAXED)
+               == sequence)
+        { return found == FOUND; }
+      }
+      std::this_thread::yield ();
+    }
+  }
+
+  /**
+   * Check if given key is in the dictionary.
+   * @param key String.
+   * @return Boolean Value.
+   */
+  bool contains_key (const std::string &key) const
+  {
+    std::string value;
+    return this->try_get (key, value);
+  }
+
+  /**
+   * Value of the given key.
+   * If key doesnt exists throw InvalidKey.
+   * @param key String.
+   * @return Copy of the value.
+   */
+  std::string at (const std::string &key) const
+  {
+    std::string value;
+    if (!this->try_get (key, value))
+    { throw InvalidKey ("Key doesn't exists."); }
+    return value;
+  }
+
+  /**
+   * Insert new pair<Key, Value> into the dictionary, if the key doesn't
+   * exist.
+   * @param key String.
+   * @param value String.
+   * @return True if inserted.
+   */
+  bool insert (const std::string &key, const std::string &value)
+  { return this->put (key, value, false); }
+
+  /**
+   * Insert new pair<Key, Value> into the dictionary, or overwrite the value
+   * of an existing key.
+   * @param key String.
+   * @param value String.
+   * @return True if a new pair was inserted, false if assigned.
+   */
+  bool insert_or_assign (const std::string &key, const std::string &value)
+  { return this->put (key, value, true); }
+
+  /**
+   * Remove the pair of the given key, throw InvalidKey if it doesn't exist.
+   * @param key String.
+   * @return True if removed.
+   */
+  bool erase (const std::string &key)
+  {
+    if (!this->try_erase (key))
+    { throw InvalidKey ("Key doesn't exists."); }
+    return true;
+  }
+
+  /**
+   * Remove the pair of the given key, with no exception on a miss.
+   * @param key String.
+   * @return True if the key was found and removed.
+   */
+  bool try_erase (const std::string &key)
+  {
+    this->check_writer ();
+    std::uint64_t hash = this->hash_key (key);
+    std::uint64_t *link = this->find_link (key, hash);
+    if (*link == 0)
+    { return false; }
+    write_guard guard (this->head ());
+    entry &old_entry = this->entry_at (*link);
+    std::uint64_t offset = *link;
+    store (*link, old_entry.next);
+    this->release (offset, old_entry.size_class);
+    store (this->head ().size, this->head ().size - 1);
+    return true;
+  }
+
+  /**
+   * Remove all pairs, and give the whole arena back to the allocator.
+   */
+  void clear ()
+  {
+    this->check_writer ();
+    write_guard guard (this->head ());
+    this->reset ();
+  }
+
+ private:
+  /**
+   * The header at the start of the arena. Fields the readers use are read
+   * and written with atomic loads and stores.
+   */
+  struct header
+  {
+    std::uint32_t magic;
+    std::uint64_t sequence;
+    std::uint64_t arena_bytes;
+    std::uint64_t seed;
+    std::uint64_t writer;
+    std::uint64_t top;
+    std::uint64_t buckets;
+    std::uint64_t capacity;
+    std::uint64_t size;
+    std::uint64_t free_lists[SHARED_SIZE_CLASSES];
+  };
+
+  /**
+   * An entry, followed by the bytes of its key and value.
+   */
+  struct entry
+  {
+    std::uint64_t next;
+    std::uint64_t hash;
+    std::uint32_t key_length;
+    std::uint32_t value_length;
+    std::uint32_t size_class;
+  };
+
+  /**
+   * Makes the sequence odd for the lifetime of a write.
+   */
+  class write_guard
+  {
+   public:
+    explicit write_guard (header &head) : _head (head)
+    {
+      store (head.sequence, head.sequence + 1);
+      __atomic_thread_fence (__ATOMIC_RELEASE);
+    }
+
+    ~write_guard ()
+    {
+      __atomic_store_n (&this->_head.sequence, this->_head.sequence + 1,
+                        __ATOMIC_RELEASE);
+    }
+
+   private:
+    header &_head;
+  };
+
+  /**
+   * Gives access to the seeded string hash of HashMap.
+   */
+  struct string_hasher : HashMap<std::string, std::string>
+  {
+    using HashMap<std::string, std::string>::random_seed;
+    using HashMap<std::string, std::string>::seeded_hash;
+  };
+
+  enum
+  {
+    MISSING, FOUND, TORN_READ
+  };
+
+  std::string _name;
+  char *_arena;
+  std::size_t _arena_bytes;
+  bool _writer;
+
+  static std::size_t header_bytes ()
+  { return (sizeof (header) + 63) & ~(std::size_t) 63; }
+
+  static std::uint64_t load (const std::uint64_t &field)
+  { return __atomic_load_n (&field, __ATOMIC_RELAXED); }
+
+  static void store (std::uint64_t &field, std::uint64_t value)
+  { __atomic_store_n (&field, value, __ATOMIC_RELAXED); }
+
+  static std::uint64_t block_bytes (std::uint32_t size_class)
+  { return (std::uint64_t) SHARED_MIN_BLOCK << size_class; }
+
+  void map_arena (int fd, int protection)
+  {
+    void *arena = ::mmap (nullptr, this->_arena_bytes, protection,
+                          MAP_SHARED, fd, 0);
+    int error = errno;
+    ::close (fd);
+    if (arena == MAP_FAILED)
+    {
+      errno = error;
+      throw_errno ("mmap " + this->_name);
+    }
+    this->_arena = (char *) arena;
+  }
+
+  header &head () const
+  { return *(header *) this->_arena; }
+
+  entry &entry_at (std::uint64_t offset) const
+  { return *(entry *) (this->_arena + offset); }
+
+  std::uint64_t *bucket_at (std::uint64_t buckets, std::uint64_t index) const
+  { return (std::uint64_t *) (this->_arena + buckets) + index; }
+
+  std::uint64_t hash_key (const std::string &key) const
+  { return string_hasher::seeded_hash (key, (std::size_t) this->head ().seed); }
+
+  void check_writer () const
+  {
+    if (!this->_writer
+        || this->head ().writer != (std::uint64_t) ::getpid ())
+    { throw std::logic_error ("Shared dictionary is read only."); }
+  }
+
+  /**
+   * Check that a block of the given length at offset lies in the arena.
+   */
+  bool in_arena (std::uint64_t offset, std::uint64_t length) const
+  {
+    return offset >= header_bytes () && offset % 8 == 0
+           && offset <= this->_arena_bytes
+           && length <= this->_arena_bytes - offset;
+  }
+
+  /**
+   * Look the key up without the sequence lock, checking every offset.
+   * @return FOUND, MISSING, or TORN_READ if a link led out of the arena.
+   */
+  int read_pair (const std::string &key, std::uint64_t hash,
+                 std::string &value) const
+  {
+    const header &head = this->head ();
+    std::uint64_t buckets = load (head.buckets);
+    std::uint64_t capacity = load (head.capacity);
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0
+        || !in_arena (buckets, capacity * 8))
+    { return TORN_READ; }
+    std::uint64_t offset = load (*this->bucket_at (buckets,
+                                                   hash & (capacity - 1)));
+    // A chain longer than the arena could hold is a cycle of a torn read
+    for (std::size_t steps = this->_arena_bytes / SHARED_MIN_BLOCK;
+         offset != 0; --steps)
+    {
+      if (steps == 0 || !in_arena (offset, sizeof (entry)))
+      { return TORN_READ; }
+      const entry &current = this->entry_at (offset);
+      std::uint64_t key_length = load32 (current.key_length);
+      std::uint64_t value_length = load32 (current.value_length);
+      if (!in_arena (offset, sizeof (entry) + key_length + value_length))
+      { return TORN_READ; }
+      const char *data = (const char *) &current + sizeof (entry);
+      if (load (current.hash) == hash && key_length == key.size ()
+          && std::memcmp (data, key.data (), key_length) == 0)
+      {
+        value.assign (data + key_length, value_length);
+        return FOUND;
+      }
+      offset = load (current.next);
+    }
+    return MISSING;
+  }
+
+  static std::uint64_t load32 (const std::uint32_t &field)
+  { return __atomic_load_n (&field, __ATOMIC_RELAXED); }
+
+  /**
+   * Link pointing at the entry of the key, or at the end of its chain.
+   * Only the writer calls it, the arena doesn't change under it.
+   */
+  std::uint64_t *find_link (const std::string &key, std::uint64_t hash) const
+  {
+    const header &head = this->head ();
+    std::uint64_t *link = this->bucket_at (head.buckets,
+                                           hash & (head.capacity - 1));
+    while (*link != 0)
+    {
+      const entry &current = this->entry_at (*link);
+      if (current.hash == hash && current.key_length == key.size ()
+          && std::memcmp ((const char *) &current + sizeof (entry),
+                          key.data (), key.size ()) == 0)
+      { break; }
+      link = &this->entry_at (*link).next;
+    }
+    return link;
+  }
+
+  bool put (const std::string &key, const std::string &value, bool assign)
+  {
+    this->check_writer ();
+    std::uint64_t hash = this->hash_key (key);
+    std::uint64_t *link = this->find_link (key, hash);
+    bool inserted = *link == 0;
+    if (!inserted && !assign)
+    { return false; }
+    if (inserted && (double) (this->head ().size + 1)
+                    > (double) this->head ().capacity * TOP_THRESHOLD)
+    {
+      this->rehash (this->head ().capacity * 2);
+      link = this->find_link (key, hash);
+    }
+    std::uint32_t size_class;
+    std::uint64_t offset = this->allocate (sizeof (entry) + key.size ()
+                                           + value.size (), size_class);
+    write_guard guard (this->head ());
+    entry &fresh = this->entry_at (offset);
+    fresh.hash = hash;
+    fresh.key_length = (std::uint32_t) key.size ();
+    fresh.value_length = (std::uint32_t) value.size ();
+    fresh.size_class = size_class;
+    char *data = (char *) &fresh + sizeof (entry);
+    std::memcpy (data, key.data (), key.size ());
+    std::memcpy (data + key.size (), value.data (), value.size ());
+    if (inserted)
+    {
+      fresh.next = 0;
+      store (this->head ().size, this->head ().size + 1);
+    }
+    else
+    {
+      entry &old_entry = this->entry_at (*link);
+      fresh.next = old_entry.next;
+      this->release (*link, old_entry.size_class);
+    }
+    store (*link, offset);
+    return inserted;
+  }
+
+  /**
+   * Move every entry to a new bucket array of the given capacity.
+   */
+  void rehash (std::uint64_t capacity)
+  {
+    std::uint32_t buckets_class;
+    std::uint64_t buckets = this->allocate (capacity * 8, buckets_class);
+    write_guard guard (this->head ());
+    header &head = this->head ();
+    std::memset (this->_arena + buckets, 0, capacity * 8);
+    for (std::uint64_t i = 0; i < head.capacity; ++i)
+    {
+      std::uint64_t offset = *this->bucket_at (head.buckets, i);
+      while (offset != 0)
+      {
+        entry &current = this->entry_at (offset);
+        std::uint64_t next = current.next;
+        std::uint64_t *bucket = this->bucket_at (buckets,
+                                                 current.hash & (capacity - 1));
+        store (current.next, *bucket);
+        *bucket = offset;
+        offset = next;
+      }
+    }
+    this->release (head.buckets, this->class_of (head.capacity * 8));
+    store (head.buckets, buckets);
+    store (head.capacity, capacity);
+  }
+
+  static std::uint32_t class_of (std::uint64_t bytes)
+  {
+    std::uint32_t size_class = 0;
+    while (block_bytes (size_class) < bytes)
+    { ++size_class; }
+    return size_class;
+  }
+
+  /**
+   * Hand out a block of at least the given bytes, from the free list of its
+   * size class or else from the bump pointer.
+   * If the arena is full throw error.
+   */
+  std::uint64_t allocate (std::uint64_t bytes, std::uint32_t &size_class)
+  {
+    header &head = this->head ();
+    size_class = class_of (bytes);
+    if (size_class >= SHARED_SIZE_CLASSES)
+    { throw std::length_error ("Shared dictionary arena is full."); }
+    std::uint64_t offset = head.free_lists[size_class];
+    if (offset != 0)
+    {
+      head.free_lists[size_class] = *(std::uint64_t *) (this->_arena + offset);
+      return offset;
+    }
+    if (block_bytes (size_class) > head.arena_bytes - head.top)
+    { throw std::length_error ("Shared dictionary arena is full."); }
+    offset = head.top;
+    head.top += block_bytes (size_class);
+    return offset;
+  }
+
+  void release (std::uint64_t offset, std::uint32_t size_class)
+  {
+    header &head = this->head ();
+    store (*(std::uint64_t *) (this->_arena + offset),
+           head.free_lists[size_class]);
+    head.free_lists[size_class] = offset;
+  }
+
+  /**
+   * Drop every block and start over with an empty bucket array.
+   */
+  void reset ()
+  {
+    header &head = this->head ();
+    head.top = header_bytes ();
+    for (std::uint64_t &free_list: head.free_lists)
+    { free_list = 0; }
+    std::uint32_t buckets_class;
+    std::uint64_t buckets = this->allocate (START_CAPACITY * 8,
+                                            buckets_class);
+    std::memset (this->_arena + buckets, 0, START_CAPACITY * 8);
+    store (head.buckets, buckets);
+    store (head.capacity, START_CAPACITY);
+    store (head.size, 0);
+  }
+};
+
+#endif //_SHAREDDICTIONARY_HPP_
@@ -0,0 +1,442 @@
+#include "HashMap.hpp"
+#include <new>
+
+#ifndef _SMALLHASHMAP_HPP_
+#define _SMALLHASHMAP_HPP_
+#define SMALL_MAP_PAIRS 8
+
+/**
+ * Map for the many maps which only ever hold a few pairs.
+ * Up to InlinePairs pairs are stored inside the object itself and searched
+ * linearly, with no hashing and no heap allocation. The pair after that
+ * moves everything into a HashMap, and once erasing brings the HashMap down
+ * to half the inline room, the pairs move back inline.
+ * Iteration yields the pairs in insertion order while inline (pairs moved
+ * back from a HashMap keep its order), in HashMap order otherwise.
+ */
+template<typename KeyT, typename ValueT,
+    std::size_t InlinePairs = SMALL_MAP_PAIRS>
+class SmallHashMap
+{
+  static_assert (InlinePairs > 0, "SmallHashMap needs room for a pair.");
+
+  class iterator_t;
+  typedef std::pair<KeyT, ValueT> pair_type;
+
+ public:
+  typedef iterator_t const_iterator;
+
+  SmallHashMap () : _count (0)
+  {}
+
+  SmallHashMap (const std::vector<KeyT> &keys_vector,
+                const std::vector<ValueT> &values_vector) : SmallHashMap ()
+  {
+    if (keys_vector.size () != values_vector.size ())
+    { throw std::length_error ("The size of the vectors is unmatched."); }
+    for (std::size_t i = 0; i < keys_vector.size (); ++i)
+    { this->insert_or_assign (keys_vector[i], values_vector[i]); }
+  }
+
+  /**
+   * Copy ctor.
+   * @param other SmallHashMap to copy.
+   */
+  SmallHashMap (const SmallHashMap<KeyT, ValueT, InlinePairs> &other)
+      : _count (0)
+  {
+    if (other._hashed)
+    {
+      this->_hashed.reset (new HashMap<KeyT, ValueT> (*other._hashed));
+      return;
+    }
+    for (; this->_count < other._count; ++this->_count)
+    {
+      new (&this->inline_pairs ()[this->_count])
+          pair_type (other.inline_pairs ()[this->_count]);
+    }
+  }
+
+  ~SmallHashMap ()
+  { this->clear (); }
+
+  SmallHashMap<KeyT, ValueT, InlinePairs> &
+  operator= (SmallHashMap<KeyT, ValueT, InlinePairs> rhs)
+  {
+    swap (*this, rhs);
+    return *this;
+  }
+
+  friend void swap (SmallHashMap<KeyT, ValueT, InlinePairs> &src,
+                    SmallHashMap<KeyT, ValueT, InlinePairs> &dst)
+  {
+    SmallHashMap<KeyT, ValueT, InlinePairs> temp;
+    temp.take (src);
+    src.take (dst);
+    dst.take (temp);
+  }
+
+  /**
+   * Size of elements inside the map.
+   * @return Size_t value.
+   */
+  std::size_t size () const
+  { return this->_hashed ? this->_hashed->size () : this->_count; }
+
+  /**
+   * Check if the map is empty.
+   * @return Boolean value.
+   */
+  bool empty () const
+  { return this->size () == 0; }
+
+  /**
+   * Check if the pairs are stored inline, rather than in a HashMap.
+   * @return Boolean value.
+   */
+  bool is_inline () const
+  { return !this->_hashed; }
+
+  /**
+   * Insert new pair<Key, Value> into the map.
+   * If key already exists, do nothing.
+   * @param key Generic type value.
+   * @param value Generic type value.
+   * @return True if the pair was inserted.
+   */
+  bool insert (const KeyT &key, const ValueT &value)
+  {
+    if (this->_hashed)
+    { return this->_hashed->insert (key, value); }
+    if (this->find_inline (key) != nullptr)
+    { return false; }
+    this->add_missing (key, value);
+    return true;
+  }
+
+  /**
+   * Insert new pair<Key, Value> into the map, or overwrite the value of an
+   * existing key.
+   * @param key Generic type value.
+   * @param value Generic type value.
+   * @return True if a new pair was inserted, false if a value was replaced.
+   */
+  bool insert_or_assign (const KeyT &key, const ValueT &value)
+  {
+    if (this->_hashed)
+    { return this->_hashed->insert_or_assign (key, value); }
+    pair_type *pair_ptr = this->find_inline (key);
+    if (pair_ptr == nullptr)
+    {
+      this->add_missing (key, value);
+      return true;
+    }
+    pair_ptr->second = value;
+    return false;
+  }
+
+  /**
+   * Check if given key is already in the map.
+   * @param key Generic type value.
+   * @return Boolean Value.
+   */
+  bool contains_key (const KeyT &key) const
+  {
+    if (this->_hashed)
+    { return this->_hashed->contains_key (key); }
+    return this->find_inline (key) != nullptr;
+  }
+
+  /**
+   * Given reference to value by key.
+   * If key doesnt exists throw error.
+   * @param key Generic type value.
+   * @return Reference to generic type variable named value.
+   */
+  const ValueT &at (const KeyT &key) const
+  {
+    if (this->_hashed)
+    {
+      const HashMap<KeyT, ValueT> &hashed = *this->_hashed;
+      return hashed.at (key);
+    }
+    const pair_type *pair_ptr = this->find_inline (key);
+    if (pair_ptr == nullptr)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return pair_ptr->second;
+  }
+
+  /**
+   * Given reference to value by key.
+   * If key doesnt exists throw error.
+   * @param key Generic type value.
+   * @return Reference to generic type variable named value.
+   */
+  ValueT &at (const KeyT &key)
+  {
+    if (this->_hashed)
+    { return this->_hashed->at (key); }
+    pair_type *pair_ptr = this->find_inline (key);
+    if (pair_ptr == nullptr)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return pair_ptr->second;
+  }
+
+  ValueT &operator[] (const KeyT &key)
+  {
+    if (this->_hashed)
+    { return (*this->_hashed)[key]; }
+    pair_type *pair_ptr = this->find_inline (key);
+    if (pair_ptr != nullptr)
+    { return pair_ptr->second; }
+    return *this->add_missing (key, ValueT ());
+  }
+
+  ValueT operator[] (const KeyT &key) const
+  { return this->at (key); }
+
+  /**
+   * Remove the pair of the given key.
+   * The inline pairs after it move down one place, keeping their order.
+   * @param key Generic type value.
+   * @return True if the key was found and removed.
+   */
+  bool erase (const KeyT &key)
+  {
+    if (this->_hashed)
+    {
+      if (!this->_hashed->erase (key))
+      { return false; }
+      if (this->_hashed->size () <= InlinePairs / 2)
+      { this->move_inline (); }
+      return true;
+    }
+    pair_type *pair_ptr = this->find_inline (key);
+    if (pair_ptr == nullptr)
+    { return false; }
+    pair_type *last = &this->inline_pairs ()[this->_count - 1];
+    for (; pair_ptr != last; ++pair_ptr)
+    { *pair_ptr = std::move (pair_ptr[1]); }
+    last->~pair_type ();
+    --this->_count;
+    return true;
+  }
+
+  /**
+   * Remove all the pairs, and go back to inline storage.
+   */
+  void clear ()
+  {
+    this->_hashed.reset ();
+    for (std::size_t i = 0; i < this->_count; ++i)
+    { this->inline_pairs ()[i].~pair_type (); }
+    this->_count = 0;
+  }
+
+  const_iterator begin () const
+  { return this->cbegin (); }
+
+  const_iterator cbegin () const
+  {
+    if (this->_hashed)
+    { return const_iterator (this->_hashed->cbegin ()); }
+    return const_iterator (this->inline_pairs ());
+  }
+
+  const_iterator end () const
+  { return this->cend (); }
+
+  const_iterator cend () const
+  {
+    if (this->_hashed)
+    { return const_iterator (this->_hashed->cend ()); }
+    return const_iterator (this->inline_pairs () + this->_count);
+  }
+
+  bool operator== (const SmallHashMap<KeyT, ValueT, InlinePairs> &rhs) const
+  {
+    if (this->size () != rhs.size ())
+    { return false; }
+    for (const auto &pair: rhs)
+    {
+      if (!this->contains_key (pair.first)
+          || !(this->at (pair.first) == pair.second))
+      { return false; }
+    }
+    return true;
+  }
+
+  bool operator!= (const SmallHashMap<KeyT, ValueT, InlinePairs> &rhs) const
+  { return !this->operator== (rhs); }
+
+ private:
+  typename std::aligned_storage<sizeof (pair_type),
+                                alignof (pair_type)>::type _pairs[InlinePairs];
+  std::size_t _count;
+  /**
+   * The pairs, once they outgrew the inline room. Null while inline.
+   */
+  std::unique_ptr<HashMap<KeyT, ValueT>> _hashed;
+
+  pair_type *inline_pairs ()
+  { return reinterpret_cast<pair_type *> (this->_pairs); }
+
+  const pair_type *inline_pairs () const
+  { return reinterpret_cast<const pair_type *> (this->_pairs); }
+
+  /**
+   * Linear search of the inline pairs.
+   * @return Pointer to the pair, or nullptr if the key is missing.
+   */
+  pair_type *find_inline (const KeyT &key)
+  {
+    pair_type *pairs = this->inline_pairs ();
+    for (std::size_t i = 0; i < this->_count; ++i)
+    {
+      if (pairs[i].first == key)
+      { return &pairs[i]; }
+    }
+    return nullptr;
+  }
+
+  const pair_type *find_inline (const KeyT &key) const
+  { return const_cast<SmallHashMap *> (this)->find_inline (key); }
+
+  /**
+   * Add a pair whose key is known to be missing from the inline pairs,
+   * moving to a HashMap if there is no room left.
+   * @return Pointer to the value of the new pair.
+   */
+  ValueT *add_missing (const KeyT &key, const ValueT &value)
+  {
+    if (this->_count == InlinePairs)
+    {
+      this->move_hashed ();
+      this->_hashed->insert (key, value);
+      return this->_hashed->try_get (key);
+    }
+    pair_type *pair_ptr = new (&this->inline_pairs ()[this->_count])
+        pair_type (key, value);
+    ++this->_count;
+    return &pair_ptr->second;
+  }
+
+  /**
+   * Move the inline pairs into a new HashMap, sized for one more pair.
+   */
+  void move_hashed ()
+  {
+    std::unique_ptr<HashMap<KeyT, ValueT>> hashed (new HashMap<KeyT, ValueT> ());
+    hashed->reserve (this->_count + 1);
+    for (std::size_t i = 0; i < this->_count; ++i)
+    {
+      const pair_type &pair = this->inline_pairs ()[i];
+      hashed->insert (pair.first, pair.second);
+    }
+    this->clear ();
+    this->_hashed = std::move (hashed);
+  }
+
+  /**
+   * Move the pairs of the HashMap back inline, they must fit.
+   */
+  void move_inline ()
+  {
+    std::unique_ptr<HashMap<KeyT, ValueT>> hashed (std::move (this->_hashed));
+    try
+    {
+      for (const auto &pair: *hashed)
+      {
+        new (&this->inline_pairs ()[this->_count]) pair_type (pair);
+        ++this->_count;
+      }
+    }
+    catch (...)
+    {
+      this->clear ();
+      this->_hashed = std::move (hashed);
+      throw;
+    }
+  }
+
+  /**
+   * Move the pairs of other into this empty map, leaving other empty.
+   */
+  void take (SmallHashMap<KeyT, ValueT, InlinePairs> &other)
+  {
+    this->_hashed = std::move (other._hashed);
+    for (; this->_count < other._count; ++this->_count)
+    {
+      new (&this->inline_pairs ()[this->_count])
+          pair_type (std::move (other.inline_pairs ()[this->_count]));
+    }
+    other.clear ();
+  }
+
+  class iterator_t
+  {
+    typedef typename HashMap<KeyT, ValueT>::const_iterator hashed_iterator;
+
+   private:
+    /**
+     * The current inline pair, or nullptr when walking a HashMap.
+     */
+    const pair_type *_inline;
+    hashed_iterator _hashed;
+
+    /**
+     * HashMap to build the unused hashed iterator of inline walks from.
+     * Allocates nothing, see HashMap ().
+     */
+    static const HashMap<KeyT, ValueT> &no_map ()
+    {
+      static const HashMap<KeyT, ValueT> map;
+      return map;
+    }
+
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef const pair_type value_type;
+    typedef value_type &reference;
+    typedef value_type *pointer;
+    typedef std::ptrdiff_t difference_type;
+
+    explicit iterator_t (const pair_type *pair)
+        : _inline (pair), _hashed (no_map ().cend ())
+    {}
+
+    explicit iterator_t (const hashed_iterator &it)
+        : _inline (nullptr), _hashed (it)
+    {}
+
+    reference operator* () const
+    { return this->_inline != nullptr ? *this->_inline : *this->_hashed; }
+
+    pointer operator-> () const
+    { return &(this->operator* ()); }
+
+    iterator_t &operator++ ()
+    {
+      if (this->_inline != nullptr)
+      { ++this->_inline; }
+      else
+      { ++this->_hashed; }
+      return *this;
+    }
+
+    iterator_t operator++ (int)
+    {
+      iterator_t it (*this);
+      this->operator++ ();
+      return it;
+    }
+
+    bool operator== (const iterator_t &rhs) const
+    { return this->_inline == rhs._inline && this->_hashed == rhs._hashed; }
+
+    bool operator!= (const iterator_t &rhs) const
+    { return !this->operator== (rhs); }
+  };
+};
+
+#endif //_SMALLHASHMAP_HPP_
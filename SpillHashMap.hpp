@@ -0,0 +1,467 @@
+#include "HashMap.hpp"
+#include "Serialization.hpp"
+
+#ifndef _SPILLHASHMAP_HPP_
+#define _SPILLHASHMAP_HPP_
+#define SPILL_SEGMENT_BITS 6
+#define SPILL_WRITE_BUFFER (64 << 10)
+#define SPILL_PAIR_OVERHEAD 48
+
+/**
+ * Map for data sets larger than the memory, spilling to disk.
+ * Pairs are partitioned into 2^segment_bits segments by the high bits of
+ * their hash. A segment is either resident, all its pairs in an in-memory
+ * HashMap, or spilled, all its pairs in the file segment.<index> of the
+ * directory. Resident segments are kept under a memory budget (an estimate
+ * of the bytes of their pairs); the least recently used ones are spilled
+ * first, written out with one sequential write, or just dropped if their
+ * file is still up to date.
+ * insert_or_assign on a spilled segment doesn't read it back: the pair is
+ * buffered and appended to the segment file, later pairs of a key winning
+ * when the segment is loaded again. Lookups and erase load the whole
+ * segment with one sequential read. bulk_lookup sorts a batch of keys by
+ * segment and loads every segment once, so the I/O of a batch stays
+ * sequential whatever its keys.
+ * The files are scratch space: existing segment files are overwritten, and
+ * the destructor removes them. Keys and values must be encodable by
+ * put_value (trivially copyable types or std::string).
+ */
+template<typename KeyT, typename ValueT>
+class SpillHashMap
+{
+ public:
+  /**
+   * Open a spilling map over the given directory, creating the directory
+   * if it doesn't exist.
+   * @param directory Path of the directory for the segment files.
+   * @param memory_budget Bytes the resident segments may use.
+   * @param segment_bits Log 2 of the number of segments, up to 16.
+   */
+  SpillHashMap (const std::string &directory, std::size_t memory_budget,
+                int segment_bits = SPILL_SEGMENT_BITS)
+      : _directory (directory), _memory_budget (memory_budget),
+        _segment_bits (segment_bits), _resident_bytes (0), _clock (0),
+        _segment_loads (0), _segment_spills (0)
+  {
+    if (segment_bits < 0 || segment_bits > 16)
+    { throw std::invalid_argument ("Segment bits must be between 0 and 16."); }
+    if (::mkdir (directory.c_str (), 0755) != 0 && errno != EEXIST)
+    { throw_errno ("mkdir " + directory); }
+    this->_segments.resize ((std::size_t) 1 << segment_bits);
+    for (std::size_t i = 0; i < this->_segments.size (); ++i)
+    {
+      this->_segments[i].map.reset (new HashMap<KeyT, ValueT> ());
+      ::unlink (this->segment_path (i).c_str ());
+    }
+  }
+
+  SpillHashMap (const SpillHashMap &) = delete;
+
+  SpillHashMap &operator= (const SpillHashMap &) = delete;
+
+  ~SpillHashMap ()
+  {
+    for (std::size_t i = 0; i < this->_segments.size (); ++i)
+    { ::unlink (this->segment_path (i).c_str ()); }
+  }
+
+  /**
+   * Number of pairs. Spilled segments with appended pairs are loaded, one
+   * at a time, to drop their duplicate keys.
+   * @return Size_t value.
+   */
+  std::size_t size ()
+  {
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < this->_segments.size (); ++i)
+    {
+      if (!this->_segments[i].exact)
+      { this->load (i); }
+      total += this->_segments[i].count;
+    }
+    return total;
+  }
+
+  /**
+   * Check if the map is empty.
+   * @return Boolean value.
+   */
+  bool empty ()
+  { return this->size () == 0; }
+
+  /**
+   * Estimated bytes of the resident segments.
+   * @return Size_t value.
+   */
+  std::size_t resident_bytes () const
+  { return this->_resident_bytes; }
+
+  /**
+   * Number of segments read back from disk so far.
+   * @return Size_t value.
+   */
+  std::size_t segment_loads () const
+  { return this->_segment_loads; }
+
+  /**
+   * Number of segments written out to disk so far.
+   * @return Size_t value.
+   */
+  std::size_t segment_spills () const
+  { return this->_segment_spills; }
+
+  /**
+   * Insert new pair<Key, Value> into the map, or overwrite the value of an
+   * existing key. Never reads a spilled segment back.
+   * @param key Generic type value.
+   * @param value Generic type value.
+   */
+  void insert_or_assign (const KeyT &key, const ValueT &value)
+  {
+    std::size_t index = this->segment_of (key);
+    segment &seg = this->_segments[index];
+    if (!seg.map)
+    {
+      put_value (seg.pending, key);
+      put_value (seg.pending, value);
+      seg.exact = false;
+      if (seg.pending.size () >= SPILL_WRITE_BUFFER)
+      { this->flush (index); }
+      return;
+    }
+    this->touch (index);
+    const ValueT *old_value = seg.map->try_get (key);
+    if (old_value != nullptr)
+    { this->forget_bytes (seg, pair_bytes (key, *old_value)); }
+    else
+    { ++seg.count; }
+    seg.map->insert_or_assign (key, value);
+    seg.bytes += pair_bytes (key, value);
+    this->_resident_bytes += pair_bytes (key, value);
+    seg.dirty = true;
+    this->fit_budget (index);
+  }
+
+  /**
+   * Check if given key is in the map, loading its segment if spilled.
+   * @param key Generic type value.
+   * @return Boolean Value.
+   */
+  bool contains_key (const KeyT &key)
+  { return this->try_get (key) != nullptr; }
+
+  /**
+   * Value of the given key, loading its segment if spilled.
+   * The pointer is valid until the next call on the map, which may spill
+   * the segment.
+   * @param key Generic type value.
+   * @return Pointer to the value, or nullptr if the key doesn't exist.
+   */
+  const ValueT *try_get (const KeyT &key)
+  {
+    std::size_t index = this->segment_of (key);
+    this->load (index);
+    const HashMap<KeyT, ValueT> &map = *this->_segments[index].map;
+    return map.try_get (key);
+  }
+
+  /**
+   * Value of the given key, or the fallback if the key doesn't exist.
+   * @param key Generic type value.
+   * @param fallback Value returned on a miss.
+   * @return Copy of the value.
+   */
+  ValueT get_or (const KeyT &key, const ValueT &fallback)
+  {
+    const ValueT *value_ptr = this->try_get (key);
+    return value_ptr == nullptr ? fallback : *value_ptr;
+  }
+
+  /**
+   * Value of the given key.
+   * If key doesnt exists throw error.
+   * @param key Generic type value.
+   * @return Copy of the value.
+   */
+  ValueT at (const KeyT &key)
+  {
+    const ValueT *value_ptr = this->try_get (key);
+    if (value_ptr == nullptr)
+    { throw std::invalid_argument ("Key doesn't exists."); }
+    return *value_ptr;
+  }
+
+  /**
+   * Remove the pair of the given key, loading its segment if spilled.
+   * @param key Generic type value.
+   * @return True if the key was found and removed.
+   */
+  bool erase (const KeyT &key)
+  {
+    std::size_t index = this->segment_of (key);
+    this->load (index);
+    segment &seg = this->_segments[index];
+    const ValueT *value_ptr = seg.map->try_get (key);
+    if (value_ptr == nullptr)
+    { return false; }
+    this->forget_bytes (seg, pair_bytes (key, *value_ptr));
+    seg.map->erase (key);
+    --seg.count;
+    seg.dirty = true;
+    return true;
+  }
+
+  /**
+   * Look a batch of keys up, one segment at a time: the resident segments
+   * first, then every spilled segment of the batch, loaded once.
+   * @param keys Keys to look up.
+   * @param visit Callable of (index of the key in keys, const ValueT *),
+   * the pointer being nullptr for missing keys and valid during the call.
+   */
+  template<typename Visit>
+  void bulk_lookup (const std::vector<KeyT> &keys, Visit visit)
+  {
+    std::vector<std::vector<std::size_t>> batches (this->_segments.size ());
+    for (std::size_t i = 0; i < keys.size (); ++i)
+    { batches[this->segment_of (keys[i])].push_back (i); }
+    // The order is fixed up front: loading a segment may spill one visited
+    std::vector<std::size_t> order;
+    for (int resident = 1; resident >= 0; --resident)
+    {
+      for (std::size_t index = 0; index < batches.size (); ++index)
+      {
+        if (!batches[index].empty ()
+            && (this->_segments[index].map != nullptr) == (resident == 1))
+        { order.push_back (index); }
+      }
+    }
+    for (std::size_t index: order)
+    {
+      this->load (index);
+      const HashMap<KeyT, ValueT> &map = *this->_segments[index].map;
+      for (std::size_t i: batches[index])
+      { visit (i, map.try_get (keys[i])); }
+    }
+  }
+
+  /**
+   * Call visit on every pair, one segment at a time, loading the spilled
+   * segments in turn.
+   * @param visit Callable of (const KeyT &, const ValueT &).
+   */
+  template<typename Visit>
+  void for_each (Visit visit)
+  {
+    for (std::size_t index = 0; index < this->_segments.size (); ++index)
+    {
+      this->load (index);
+      for (const auto &pair: *this->_segments[index].map)
+      { visit (pair.first, pair.second); }
+    }
+  }
+
+  /**
+   * Write out the buffered pairs of every spilled segment.
+   */
+  void flush ()
+  {
+    for (std::size_t index = 0; index < this->_segments.size (); ++index)
+    { this->flush (index); }
+  }
+
+ private:
+  struct segment
+  {
+    /**
+     * The pairs, if the segment is resident.
+     */
+    std::unique_ptr<HashMap<KeyT, ValueT>> map;
+    /**
+     * Pairs appended to a spilled segment, not written out yet.
+     */
+    std::string pending;
+    std::size_t count = 0;
+    std::size_t bytes = 0;
+    std::uint64_t last_use = 0;
+    /**
+     * False once pairs were appended blindly, count is then a guess.
+     */
+    bool exact = true;
+    /**
+     * True if the resident pairs differ from the segment file.
+     */
+    bool dirty = false;
+  };
+
+  std::string _directory;
+  std::size_t _memory_budget;
+  int _segment_bits;
+  std::vector<segment> _segments;
+  std::size_t _resident_bytes;
+  std::uint64_t _clock;
+  std::size_t _segment_loads;
+  std::size_t _segment_spills;
+
+  /**
+   * Estimated bytes of a resident pair: the pair, its list node and share
+   * of the buckets, and the heap memory it owns.
+   */
+  static std::size_t pair_bytes (const KeyT &key, const ValueT &value)
+  {
+    return sizeof (std::pair<KeyT, ValueT>) + SPILL_PAIR_OVERHEAD
+           + heap_bytes (key) + heap_bytes (value);
+  }
+
+  /**
+   * Segment of a key, the high bits of its mixed hash, so segments don't
+   * depend on the low bits the segment maps use for their buckets.
+   */
+  std::size_t segment_of (const KeyT &key) const
+  {
+    if (this->_segment_bits == 0)
+    { return 0; }
+    std::uint64_t hash = std::hash<KeyT>{} (key);
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    hash ^= hash >> 31;
+    return (std::size_t) (hash >> (64 - this->_segment_bits));
+  }
+
+  void forget_bytes (segment &seg, std::size_t bytes)
+  {
+    seg.bytes -= bytes;
+    this->_resident_bytes -= bytes;
+  }
+
+  std::string segment_path (std::size_t index) const
+  { return this->_directory + "/segment." + std::to_string (index); }
+
+  void touch (std::size_t index)
+  { this->_segments[index].last_use = ++this->_clock; }
+
+  /**
+   * Write bytes to the file of a segment, appending or replacing it.
+   */
+  void write_segment (std::size_t index, const std::string &data,
+                      bool replace)
+  {
+    std::string path = this->segment_path (index);
+    int fd = ::open (path.c_str (), O_WRONLY | O_CREAT | O_CLOEXEC
+                                    | (replace ? O_TRUNC : O_APPEND), 0644);
+    if (fd < 0)
+    { throw_errno ("open " + path); }
+    try
+    { write_all (fd, data.data (), data.size ()); }
+    catch (...)
+    {
+      ::close (fd);
+      throw;
+    }
+    ::close (fd);
+  }
+
+  /**
+   * Append the buffered pairs of a spilled segment to its file.
+   */
+  void flush (std::size_t index)
+  {
+    segment &seg = this->_segments[index];
+    if (seg.pending.empty ())
+    { return; }
+    this->write_segment (index, seg.pending, false);
+    seg.pending.clear ();
+    seg.pending.shrink_to_fit ();
+  }
+
+  /**
+   * Make a segment resident, reading its file back (one sequential read),
+   * and spill others if it pushes the map over the budget.
+   */
+  void load (std::size_t index)
+  {
+    segment &seg = this->_segments[index];
+    this->touch (index);
+    if (seg.map)
+    { return; }
+    this->flush (index);
+    std::unique_ptr<HashMap<KeyT, ValueT>> map (new HashMap<KeyT, ValueT> ());
+    std::string buffer;
+    if (this->read_segment (index, buffer))
+    {
+      map->reserve (seg.count);
+      const char *pos = buffer.data ();
+      const char *end = pos + buffer.size ();
+      KeyT key;
+      ValueT value;
+      while (pos != end)
+      {
+        if (!get_value (pos, end, key) || !get_value (pos, end, value))
+        { throw std::runtime_error ("Corrupted segment file."); }
+        map->insert_or_assign (key, value);
+      }
+      ++this->_segment_loads;
+    }
+    seg.bytes = 0;
+    for (const auto &pair: *map)
+    { seg.bytes += pair_bytes (pair.first, pair.second); }
+    seg.map = std::move (map);
+    seg.count = seg.map->size ();
+    seg.exact = true;
+    seg.dirty = false;
+    this->_resident_bytes += seg.bytes;
+    this->fit_budget (index);
+  }
+
+  bool read_segment (std::size_t index, std::string &buffer) const
+  { return read_file (this->segment_path (index), buffer); }
+
+  /**
+   * Spill the least recently used resident segments, other than keep,
+   * until the resident pairs fit the budget.
+   * @param keep Index of the segment in use.
+   */
+  void fit_budget (std::size_t keep)
+  {
+    while (this->_resident_bytes > this->_memory_budget)
+    {
+      std::size_t coldest = keep;
+      for (std::size_t i = 0; i < this->_segments.size (); ++i)
+      {
+        const segment &seg = this->_segments[i];
+        if (i != keep && seg.map && seg.count != 0
+            && (coldest == keep
+                || seg.last_use < this->_segments[coldest].last_use))
+        { coldest = i; }
+      }
+      if (coldest == keep)
+      { return; }
+      this->spill (coldest);
+    }
+  }
+
+  /**
+   * Write a resident segment out, unless its file is up to date, and drop
+   * its pairs from memory.
+   */
+  void spill (std::size_t index)
+  {
+    segment &seg = this->_segments[index];
+    if (seg.dirty)
+    {
+      std::string buffer;
+      for (const auto &pair: *seg.map)
+      {
+        put_value (buffer, pair.first);
+        put_value (buffer, pair.second);
+      }
+      this->write_segment (index, buffer, true);
+      ++this->_segment_spills;
+    }
+    this->_resident_bytes -= seg.bytes;
+    seg.bytes = 0;
+    seg.map.reset ();
+    seg.dirty = false;
+  }
+};
+
+#endif //_SPILLHASHMAP_HPP_
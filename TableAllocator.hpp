@@ -0,0 +1,168 @@
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#endif
+
+#ifndef _TABLEALLOCATOR_HPP_
+#define _TABLEALLOCATOR_HPP_
+#define HUGE_PAGE_SIZE ((std::size_t) 2 << 20)
+#define NUMA_MAX_NODES 1024
+
+/**
+ * Page size of a table array.
+ * SMALL_PAGES: regular heap memory, the default.
+ * TRANSPARENT_HUGE_PAGES: a 2MB aligned mapping advised (madvise) to be
+ * backed by transparent huge pages.
+ * EXPLICIT_HUGE_PAGES: a MAP_HUGETLB mapping from the reserved huge page
+ * pool, falling back to transparent huge pages if the pool is empty.
+ */
+enum page_policy
+{
+  SMALL_PAGES, TRANSPARENT_HUGE_PAGES, EXPLICIT_HUGE_PAGES
+};
+
+/**
+ * NUMA placement of a table array.
+ * NUMA_LOCAL: pages go to the node of the thread which touches them first,
+ * the default.
+ * NUMA_INTERLEAVE: pages are spread round robin over the allowed nodes, so
+ * random lookups from every node see the same average latency.
+ * NUMA_BIND: pages are taken from a single node.
+ */
+enum numa_policy
+{
+  NUMA_LOCAL, NUMA_INTERLEAVE, NUMA_BIND
+};
+
+/**
+ * How the table arrays of a map are allocated.
+ * Only tables of at least HUGE_PAGE_SIZE bytes are mapped, smaller ones
+ * always stay on the heap. The NUMA placement is a hint: where the kernel
+ * has no NUMA support, or refuses the policy, the table is kept anyway.
+ */
+struct table_policy
+{
+  page_policy pages = SMALL_PAGES;
+  numa_policy numa = NUMA_LOCAL;
+  int node = 0;
+};
+
+/**
+ * Check if a table of the given size is mapped under the policy, rather
+ * than allocated on the heap.
+ * @param bytes Size of the table.
+ * @param policy Allocation policy.
+ * @return True if map_table should be used.
+ */
+inline bool maps_table (std::size_t bytes, const table_policy &policy)
+{
+  return bytes >= HUGE_PAGE_SIZE
+         && (policy.pages != SMALL_PAGES || policy.numa != NUMA_LOCAL);
+}
+
+/**
+ * Length of the mapping of a table, a whole number of huge pages.
+ * @param bytes Size of the table.
+ * @return Size_t value.
+ */
+inline std::size_t table_length (std::size_t bytes)
+{ return (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1); }
+
+/**
+ * Apply the NUMA placement of the policy to a mapping which wasn't touched
+ * yet. Failures are ignored, the placement is only a hint.
+ * @param table Start of the mapping.
+ * @param length Length of the mapping.
+ * @param policy Allocation policy.
+ */
+inline void bind_table (void *table, std::size_t length,
+                        const table_policy &policy)
+{
+#if defined (SYS_mbind) && defined (SYS_get_mempolicy)
+  const std::size_t word_bits = 8 * sizeof (unsigned long);
+  unsigned long nodes[NUMA_MAX_NODES / word_bits] = {};
+  int mode;
+  if (policy.numa == NUMA_BIND)
+  {
+    if (policy.node < 0 || policy.node >= NUMA_MAX_NODES)
+    { return; }
+    nodes[policy.node / word_bits] |= 1UL << (policy.node % word_bits);
+    mode = MPOL_BIND;
+  }
+  else if (policy.numa == NUMA_INTERLEAVE)
+  {
+    if (::syscall (SYS_get_mempolicy, nullptr, nodes, NUMA_MAX_NODES,
+                   nullptr, MPOL_F_MEMS_ALLOWED) != 0)
+    { return; }
+    mode = MPOL_INTERLEAVE;
+  }
+  else
+  { return; }
+  // The kernel reads one bit less than the given node count
+  ::syscall (SYS_mbind, table, length, mode, nodes, NUMA_MAX_NODES + 1, 0);
+#else
+  (void) table;
+  (void) length;
+  (void) policy;
+#endif
+}
+
+/**
+ * Map zeroed memory for a table, with the pages and the NUMA placement of
+ * the policy. Explicit huge pages fall back to an aligned mapping with
+ * transparent huge pages when none are reserved.
+ * @param bytes Size of the table.
+ * @param policy Allocation policy.
+ * @return Pointer to the table, aligned to HUGE_PAGE_SIZE.
+ */
+inline void *map_table (std::size_t bytes, const table_policy &policy)
+{
+  std::size_t length = table_length (bytes);
+  void *table = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (policy.pages == EXPLICIT_HUGE_PAGES)
+  {
+    table = ::mmap (nullptr, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+#endif
+  if (table == MAP_FAILED)
+  {
+    // Map an extra huge page and trim both ends, so every 2MB of the table
+    // can be backed by a single huge page
+    std::size_t padded = length + HUGE_PAGE_SIZE;
+    void *raw = ::mmap (nullptr, padded, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+    { throw std::bad_alloc (); }
+    char *start = static_cast<char *> (raw);
+    char *aligned = reinterpret_cast<char *> (
+        (reinterpret_cast<std::uintptr_t> (start) + HUGE_PAGE_SIZE - 1)
+        & ~(std::uintptr_t) (HUGE_PAGE_SIZE - 1));
+    if (aligned != start)
+    { ::munmap (start, (std::size_t) (aligned - start)); }
+    ::munmap (aligned + length, HUGE_PAGE_SIZE - (std::size_t) (aligned - start));
+    table = aligned;
+#ifdef MADV_HUGEPAGE
+    if (policy.pages != SMALL_PAGES)
+    { ::madvise (table, length, MADV_HUGEPAGE); }
+#endif
+  }
+  bind_table (table, length, policy);
+  return table;
+}
+
+/**
+ * Release a table returned by map_table.
+ * @param table Pointer to the table.
+ * @param bytes Size of the table, as given to map_table.
+ */
+inline void unmap_table (void *table, std::size_t bytes)
+{ ::munmap (table, table_length (bytes)); }
+
+#endif //_TABLEALLOCATOR_HPP_